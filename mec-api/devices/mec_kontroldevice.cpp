@@ -10,7 +10,9 @@ static const unsigned OSC_POLL_MS = 10;
 ////////////////////////////////////////////////
 KontrolDevice::KontrolDevice(ICallback &cb) :
         active_(false), callback_(cb),
-        listenPort_(0) {
+        listenPort_(0),
+        changeInterval_(Kontrol::OSCBroadcaster::DEFAULT_CHANGE_INTERVAL_MS),
+        maxPacketSize_(Kontrol::OSCBroadcaster::MAX_BUNDLE_SIZE) {
     model_ = Kontrol::KontrolModel::model();
 }
 
@@ -24,8 +26,9 @@ public:
     KontrolDeviceClientHandler(KontrolDevice &kd) : this_(kd) { ; }
 
     //Kontrol::KontrolCallback
-    void ping(Kontrol::ChangeSource src, const std::string &host, unsigned port, unsigned keepAlive) override {
-        this_.newClient(src, host, port, keepAlive);
+    void ping(Kontrol::ChangeSource src, const std::string &host, unsigned port, unsigned keepAlive,
+              uint64_t version, uint64_t lastSeen) override {
+        this_.newClient(src, host, port, keepAlive, version, lastSeen);
     }
 
     void rack(Kontrol::ChangeSource, const Kontrol::Rack &) override { ; }
@@ -69,10 +72,21 @@ bool KontrolDevice::init(void *arg) {
     model_->addCallback("clienthandler", std::make_shared<KontrolDeviceClientHandler>(*this));
 
     listenPort_ = static_cast<unsigned>(prefs.getInt("listen port", 6000));
+    changeInterval_ = static_cast<unsigned>(prefs.getInt("change interval", changeInterval_));
+    maxPacketSize_ = static_cast<unsigned>(prefs.getInt("max packet size", maxPacketSize_));
+
+    if (prefs.getBool("reactor", false)) {
+        // single network thread for the receiver and all clients
+        auto reactor = std::make_shared<Kontrol::OSCReactor>();
+        if (reactor->start()) {
+            reactor_ = reactor;
+            LOG_0("kontrol device : using reactor");
+        }
+    }
 
     if (listenPort_ > 0) {
         auto p = std::make_shared<Kontrol::OSCReceiver>(model_);
-        if (p->listen(listenPort_)) {
+        if (p->listen(listenPort_, reactor_)) {
             osc_receiver_ = p;
             LOG_0("kontrol device : listening on " << listenPort_);
         }
@@ -89,7 +103,9 @@ void KontrolDevice::newClient(
         Kontrol::ChangeSource src,
         const std::string &host,
         unsigned port,
-        unsigned keepalive) {
+        unsigned keepalive,
+        uint64_t version,
+        uint64_t lastSeen) {
 
     for (auto client : clients_) {
         if (client->isThisHost(host, port)) {
@@ -100,10 +116,12 @@ void KontrolDevice::newClient(
     std::string id = "client.osc:" + host + ":" + std::to_string(port);
 
     auto client = std::make_shared<Kontrol::OSCBroadcaster>(src, keepalive, true);
-    if (client->connect(host, port)) {
+    client->changeInterval(changeInterval_);
+    client->maxPacketSize(maxPacketSize_);
+    if (client->connect(host, port, reactor_)) {
         LOG_0("KontrolDevice::new client " << client->host() << " : " << client->port() << " KA = " << keepalive);
 //        client->sendPing(listenPort_);
-        client->ping(src, host, port, keepalive);
+        client->ping(src, host, port, keepalive, version, lastSeen);
         clients_.push_back((client));
         model_->addCallback(id, client);
     }
@@ -111,7 +129,11 @@ void KontrolDevice::newClient(
 
 
 void KontrolDevice::processorRun() {
+    // the processor thread owns the model, changes from device threads are applied here
+    model_->ownerThread(std::this_thread::get_id());
     while (active_) {
+        model_->processCommands();
+        model_->processSlew();
         if (osc_receiver_) {
             osc_receiver_->poll();
 
@@ -172,6 +194,12 @@ void KontrolDevice::deinit() {
     if (processor_.joinable()) {
         processor_.join();
     }
+    model_->ownerThread(std::thread::id());
+    model_->processCommands();
+    if (reactor_) {
+        reactor_->stop();
+        reactor_.reset();
+    }
 }
 
 bool KontrolDevice::isActive() {
@@ -24,16 +24,20 @@ public:
     virtual void deinit();
     virtual bool isActive();
 
-    void newClient(Kontrol::ChangeSource src, const std::string &host, unsigned port, unsigned keepalive);
+    void newClient(Kontrol::ChangeSource src, const std::string &host, unsigned port, unsigned keepalive,
+                   uint64_t version, uint64_t lastSeen);
     void processorRun();
 private:
 
     ICallback &callback_;
     bool active_;
     unsigned listenPort_;
+    unsigned changeInterval_;
+    unsigned maxPacketSize_;
 
     std::shared_ptr<Kontrol::KontrolModel> model_;
     std::shared_ptr<Kontrol::OSCReceiver> osc_receiver_;
+    std::shared_ptr<Kontrol::OSCReactor> reactor_;
     std::chrono::steady_clock::time_point lastPing_;
     std::vector<std::shared_ptr<Kontrol::OSCBroadcaster> > clients_;
     std::thread processor_;
@@ -3,6 +3,8 @@
 #include "mec_log.h"
 #include "../mec_voice.h"
 
+#include <cstring>
+
 #ifdef __linux__
 #include <alsa/asoundlib.h>
 extern unsigned int portInfo(snd_seq_t *seq, snd_seq_port_info_t *pinfo, unsigned int type, int portNumber);
@@ -65,13 +67,18 @@ bool findMidiPortId(unsigned &result, const std::string &portName, bool outputPo
 #endif // __linux__
 
 
-
-
+// midi input can be bursty (e.g. mpe), allow for more than the default
+static constexpr unsigned MIDI_QUEUE_SIZE = 1024;
+static constexpr unsigned NO_NRPN = 0xFFFF;
+static constexpr unsigned MAX_MIDI_MSG_SIZE = 16;
 
 
 ////////////////////////////////////////////////
 MidiDevice::MidiDevice(ICallback &cb) :
-        active_(false), callback_(cb) {
+        active_(false), callback_(cb), virtualOpen_(false), queue_(MIDI_QUEUE_SIZE),
+        pitchbendRange_(48.0f), mpeMode_(true),
+        cc14bit_(false), nrpn_(false), queuedInput_(false) {
+    resetTouches();
 }
 
 MidiDevice::~MidiDevice() {
@@ -103,8 +110,10 @@ bool MidiDevice::init(void *arg) {
     std::string input_device = prefs.getString("input device");
     if (!input_device.empty()) {
 
+        queuedInput_ = prefs.getBool("queued input", false);
+        unsigned queueSize = static_cast<unsigned>(prefs.getInt("input queue size", 100));
         try {
-            midiInDevice_.reset(new RtMidiIn(RtMidi::Api::UNSPECIFIED,"MEC MIDI IN DEVICE"));
+            midiInDevice_.reset(new RtMidiIn(RtMidi::Api::UNSPECIFIED,"MEC MIDI IN DEVICE", queueSize));
         } catch (RtMidiError &error) {
             midiInDevice_.reset();
             LOG_0("MidiDevice RtMidiIn ctor error:" << error.what());
@@ -113,6 +122,9 @@ bool MidiDevice::init(void *arg) {
 
         mpeMode_ = prefs.getBool("mpe", true);
         pitchbendRange_ = (float) prefs.getDouble("pitchbend range", 48.0);
+        cc14bit_ = prefs.getBool("14bit cc", false);
+        nrpn_ = prefs.getBool("nrpn", false);
+        resetTouches();
 
         unsigned port;
         if (findMidiPortId(port, input_device.c_str(), false)) {
@@ -136,7 +148,12 @@ bool MidiDevice::init(void *arg) {
         }
 
         midiInDevice_->ignoreTypes(true, true, true);
-        midiInDevice_->setCallback(getMidiCallback(), this);
+        if (queuedInput_) {
+            // rtmidi queues input, we drain it in process()
+            inMsg_.reserve(MAX_MIDI_MSG_SIZE);
+        } else {
+            midiInDevice_->setCallback(getMidiCallback(), this);
+        }
     } //midi input
 
     std::string output_device = prefs.getString("output device");
@@ -191,12 +208,19 @@ bool MidiDevice::init(void *arg) {
 }
 
 bool MidiDevice::process() {
+    if (queuedInput_ && midiInDevice_) {
+        while (true) {
+            double stamp = midiInDevice_->getMessage(&inMsg_);
+            if (inMsg_.empty()) break;
+            midiCallback(stamp, &inMsg_);
+        }
+    }
     return queue_.process(callback_);
 }
 
 void MidiDevice::deinit() {
     LOG_0("MidiDevice::deinit");
-    if (midiInDevice_) midiInDevice_->cancelCallback();
+    if (midiInDevice_ && !queuedInput_) midiInDevice_->cancelCallback();
     midiInDevice_.reset();
     active_ = false;
 }
@@ -206,181 +230,240 @@ bool MidiDevice::isActive() {
 }
 
 bool MidiDevice::midiCallback(double, std::vector<unsigned char> *message) {
-    int status = 0, data1 = 0, data2 = 0; //data3 = 0;
-    unsigned int n = message->size();
-    if (n > 3) LOG_0("midiCallback unexpect midi size" << n);
+    if (message->empty()) return false;
+    return parseMidi(message->data(), static_cast<unsigned>(message->size()));
+}
 
-    status = (int) message->at(0);
-    if (n > 1) data1 = (int) message->at(1);
-    if (n > 2) data2 = (int) message->at(2);
-//    if (n > 3) data3 = (int) message->at(3);
+void MidiDevice::resetTouches() {
+    for (unsigned i = 0; i < MAX_TOUCH; i++) {
+        VoiceData &touch = touches_[i];
+        touch.startNote_ = 0.0f;
+        touch.note_ = 0.0f;
+        touch.x_ = 0.0f;
+        touch.y_ = 0.0f;
+        touch.z_ = 0.0f;
+        touch.active_ = false;
+        touch.ch_ = 0;
+        touch.midiNote_ = 0;
+        // lowest ids are allocated first
+        freeTouches_[i] = static_cast<unsigned char>(MAX_TOUCH - 1 - i);
+    }
+    freeCount_ = MAX_TOUCH;
+    memset(noteTouch_, NO_TOUCH, sizeof(noteTouch_));
+    memset(ccMsb_, 0, sizeof(ccMsb_));
+    memset(nrpnMsb_, 0, sizeof(nrpnMsb_));
+    for (unsigned ch = 0; ch < MAX_CH; ch++) {
+        nrpnParam_[ch] = NO_NRPN;
+    }
+}
 
+void MidiDevice::addTouch(MecMsg::type type, int touchId, const VoiceData &touch) {
+    MecMsg msg;
+    msg.type_ = type;
+    msg.data_.touch_.touchId_ = touchId;
+    msg.data_.touch_.note_ = touch.note_;
+    msg.data_.touch_.x_ = touch.x_;
+    msg.data_.touch_.y_ = touch.y_;
+    msg.data_.touch_.z_ = touch.z_;
+    queue_.addToQueue(msg);
+}
 
-    int ch = status & 0x0F;
-    int type = status & 0xF0;
-    VoiceData &touch = touches_[ch];
+void MidiDevice::control(int ctrlId, float v) {
     MecMsg msg;
+    msg.type_ = MecMsg::CONTROL;
+    msg.data_.control_.controlId_ = ctrlId;
+    msg.data_.control_.value_ = v;
+    queue_.addToQueue(msg);
+}
+
+void MidiDevice::touchOn(unsigned ch, unsigned note, unsigned vel) {
+    if (mpeMode_) {
+        VoiceData &touch = touches_[ch];
+        if (touch.active_) {
+            // retrigger on same channel, finish previous touch
+            touch.y_ = 0.0f;
+            touch.z_ = 0.0f;
+            touch.active_ = false;
+            addTouch(MecMsg::TOUCH_OFF, ch, touch);
+        }
+        // pitchbend/timbre/pressure may arrive before the note on, so keep x/y
+        touch.startNote_ = (float) note;
+        touch.note_ = touch.startNote_ + (touch.x_ * pitchbendRange_);
+        touch.z_ = float(vel) / 127.0f;
+        touch.active_ = true;
+        touch.ch_ = static_cast<unsigned char>(ch);
+        touch.midiNote_ = static_cast<unsigned char>(note);
+        addTouch(MecMsg::TOUCH_ON, ch, touch);
+        return;
+    }
+
+    // not mpe mode, allow multi notes on 1 channel, each with its own touch id
+    unsigned char id = noteTouch_[ch][note];
+    if (id != NO_TOUCH) {
+        // repeated note on, without a note off
+        touchOff(ch, note, 0);
+    }
+    if (freeCount_ == 0) return; // all touches in use, drop note
+
+    id = freeTouches_[--freeCount_];
+    noteTouch_[ch][note] = id;
+
+    VoiceData &touch = touches_[id];
+    touch.startNote_ = (float) note;
+    touch.note_ = touch.startNote_;
+    touch.x_ = 0.0f;
+    touch.y_ = 0.0f;
+    touch.z_ = float(vel) / 127.0f;
+    touch.active_ = true;
+    touch.ch_ = static_cast<unsigned char>(ch);
+    touch.midiNote_ = static_cast<unsigned char>(note);
+    addTouch(MecMsg::TOUCH_ON, id, touch);
+}
+
+void MidiDevice::touchOff(unsigned ch, unsigned note, unsigned vel) {
+    if (mpeMode_) {
+        VoiceData &touch = touches_[ch];
+        if (!touch.active_) return;
+        touch.y_ = 0.0f;
+        touch.z_ = float(vel) / 127.0f;
+        touch.active_ = false;
+        // assumption: callback handler wants note to be touch finish position
+        addTouch(MecMsg::TOUCH_OFF, ch, touch);
+
+        touch.startNote_ = 0.0f;
+        touch.x_ = 0.0f;
+        return;
+    }
+
+    unsigned char id = noteTouch_[ch][note];
+    if (id == NO_TOUCH) return;
+    noteTouch_[ch][note] = NO_TOUCH;
+
+    VoiceData &touch = touches_[id];
+    touch.z_ = float(vel) / 127.0f;
+    touch.active_ = false;
+    addTouch(MecMsg::TOUCH_OFF, id, touch);
+
+    touch.startNote_ = 0.0f;
+    freeTouches_[freeCount_++] = id;
+}
+
+void MidiDevice::continuousController(unsigned ch, unsigned cc, unsigned v) {
+    if (mpeMode_ && cc == 74) {
+        VoiceData &touch = touches_[ch];
+        touch.y_ = float(v) / 127.0f;
+        if (touch.active_) addTouch(MecMsg::TOUCH_CONTINUE, ch, touch);
+        return;
+    }
+
+    if (nrpn_) {
+        switch (cc) {
+            case 99 : // nrpn msb
+                nrpnParam_[ch] = v << 7;
+                return;
+            case 98 : // nrpn lsb
+                nrpnParam_[ch] = (nrpnParam_[ch] == NO_NRPN ? 0 : (nrpnParam_[ch] & 0x3F80)) | v;
+                return;
+            case 101 : // rpn selection, deselects nrpn
+            case 100 :
+                nrpnParam_[ch] = NO_NRPN;
+                return;
+            case 6 : // data entry msb
+                if (nrpnParam_[ch] == NO_NRPN) break;
+                nrpnMsb_[ch] = static_cast<unsigned char>(v);
+                control(NRPN_CONTROL_BASE + nrpnParam_[ch], float(v) / 127.0f);
+                return;
+            case 38 : // data entry lsb
+                if (nrpnParam_[ch] == NO_NRPN) break;
+                control(NRPN_CONTROL_BASE + nrpnParam_[ch], float((nrpnMsb_[ch] << 7) | v) / 16383.0f);
+                return;
+            default:
+                break;
+        }
+    }
+
+    if (cc14bit_) {
+        if (cc < 32) {
+            ccMsb_[ch][cc] = static_cast<unsigned char>(v);
+        } else if (cc < 64) {
+            unsigned msbCC = cc - 32;
+            control(msbCC, float((ccMsb_[ch][msbCC] << 7) | v) / 16383.0f);
+            return;
+        }
+    }
+
+    control(cc, float(v) / 127.0f);
+}
+
+bool MidiDevice::parseMidi(const unsigned char *data, unsigned size) {
+    // channel messages only, system/sysex are ignored
+    if (size < 2 || data[0] < 0x80 || data[0] >= 0xF0) return false;
+
+    unsigned status = data[0];
+    unsigned ch = status & 0x0F;
+    unsigned type = status & 0xF0;
+    unsigned data1 = data[1] & 0x7F;
+    unsigned data2 = size > 2 ? data[2] & 0x7F : 0;
+
     switch (type) {
         case 0x90: {
             // note on (+note off if vel =0)
-            if (mpeMode_) {
-                if (touch.active_ || data2 == 0) {
-                    // touch.x_ = 0.0f;
-                    touch.y_ = 0.0f;
-                    touch.z_ = 0.0f;
-                    touch.active_ = false;
-                    // assumption: callback handler wants note to be touch finish position
-                    msg.type_ = MecMsg::TOUCH_OFF;
-                    msg.data_.touch_.touchId_ = ch;
-                    msg.data_.touch_.note_ = touch.note_;
-                    msg.data_.touch_.x_ = touch.x_;
-                    msg.data_.touch_.y_ = touch.y_;
-                    msg.data_.touch_.z_ = touch.z_;
-                    queue_.addToQueue(msg);
-
-                    touch.startNote_ = 0.0f;
-                }
-                if (data2 > 0) {
-                    touch.startNote_ = (float) data1;
-                    touch.note_ = (float) data1;
-                    touch.x_ = 0.0f;
-                    touch.y_ = 0.0f;
-                    touch.z_ = float(data2) / 127.0f;
-                    touch.active_ = true;
-
-                    msg.type_ = MecMsg::TOUCH_ON;
-                    msg.data_.touch_.touchId_ = ch;
-                    msg.data_.touch_.note_ = touch.note_;
-                    msg.data_.touch_.x_ = touch.x_;
-                    msg.data_.touch_.y_ = touch.y_;
-                    msg.data_.touch_.z_ = touch.z_;
-                    queue_.addToQueue(msg);
-                }
+            if (size < 3) return false;
+            if (data2 > 0) {
+                touchOn(ch, data1, data2);
             } else {
-                // not mpe mode, just send thru, allow multi notes on 1 channel
-                touch.startNote_ = (float) data1;
-                touch.note_ = (float) data1;
-                touch.x_ = 0.0f;
-                touch.y_ = 0.0f;
-                touch.z_ = float(data2) / 127.0f;
-                touch.active_ = true;
-
-                msg.type_ = MecMsg::TOUCH_ON;
-                msg.data_.touch_.touchId_ = ch;
-                msg.data_.touch_.note_ = touch.note_;
-                msg.data_.touch_.x_ = touch.x_;
-                msg.data_.touch_.y_ = touch.y_;
-                msg.data_.touch_.z_ = touch.z_;
-                queue_.addToQueue(msg);
+                touchOff(ch, data1, 0);
             }
             break;
         }
-
         case 0x80: {
             // note off
-            if (mpeMode_) {
-                // touch.note_ == data1 !!
-                // touch.x_ = 0.0f;
-                touch.y_ = 0.0f;
-                touch.z_ = float(data2) / 127.0f;
-                touch.active_ = false;
-                // assumption: callback handler wants note to be touch finish position
-                msg.type_ = MecMsg::TOUCH_OFF;
-                msg.data_.touch_.touchId_ = ch;
-                msg.data_.touch_.note_ = touch.note_;
-                msg.data_.touch_.x_ = touch.x_;
-                msg.data_.touch_.y_ = touch.y_;
-                msg.data_.touch_.z_ = touch.z_;
-                queue_.addToQueue(msg);
-
-                touch.startNote_ = 0.0f;
-            } else {
-                touch.note_ = (float) data1;
-                touch.x_ = 0.0f;
-                touch.y_ = 0.0f;
-                touch.z_ = float(data2) / 127.0f;
-                touch.active_ = true;
-
-                msg.type_ = MecMsg::TOUCH_OFF;
-                msg.data_.touch_.touchId_ = ch;
-                msg.data_.touch_.note_ = touch.note_;
-                msg.data_.touch_.x_ = touch.x_;
-                msg.data_.touch_.y_ = touch.y_;
-                msg.data_.touch_.z_ = touch.z_;
-                queue_.addToQueue(msg);
-
-                touch.startNote_ = 0.0f;
-            }
+            if (size < 3) return false;
+            touchOff(ch, data1, data2);
+            break;
+        }
+        case 0xA0: {
+            // poly pressure
+            if (size < 3 || mpeMode_) break;
+            unsigned char id = noteTouch_[ch][data1];
+            if (id == NO_TOUCH) break;
+            VoiceData &touch = touches_[id];
+            touch.z_ = float(data2) / 127.0f;
+            addTouch(MecMsg::TOUCH_CONTINUE, id, touch);
             break;
         }
         case 0xB0: {
             // CC
-            float v = float(data2) / 127.0f;
-            if (mpeMode_ && data1 == 74) {
-                if (touch.active_) {
-                    touch.y_ = v;
-
-                    msg.type_ = MecMsg::TOUCH_CONTINUE;
-                    msg.data_.touch_.touchId_ = ch;
-                    msg.data_.touch_.note_ = touch.note_;
-                    msg.data_.touch_.x_ = touch.x_;
-                    msg.data_.touch_.y_ = touch.y_;
-                    msg.data_.touch_.z_ = touch.z_;
-                    queue_.addToQueue(msg);
-                }
-            } else {
-                msg.type_ = MecMsg::CONTROL;
-                msg.data_.control_.controlId_ = data1;
-                msg.data_.control_.value_ = v;
-                queue_.addToQueue(msg);
-            }
+            if (size < 3) return false;
+            continuousController(ch, data1, data2);
             break;
         }
         case 0xD0: {
             // channel pressure
             float v = float(data1) / 127.0f;
             if (mpeMode_) {
-                if (touch.active_) {
-                    touch.z_ = v;
-
-                    msg.type_ = MecMsg::TOUCH_CONTINUE;
-                    msg.data_.touch_.touchId_ = ch;
-                    msg.data_.touch_.note_ = touch.note_;
-                    msg.data_.touch_.x_ = touch.x_;
-                    msg.data_.touch_.y_ = touch.y_;
-                    msg.data_.touch_.z_ = touch.z_;
-                    queue_.addToQueue(msg);
-                }
+                VoiceData &touch = touches_[ch];
+                touch.z_ = v;
+                if (touch.active_) addTouch(MecMsg::TOUCH_CONTINUE, ch, touch);
             } else {
-                msg.type_ = MecMsg::CONTROL;
-                msg.data_.control_.controlId_ = type;
-                msg.data_.control_.value_ = v;
-                queue_.addToQueue(msg);
+                control(type, v);
             }
             break;
         }
         case 0xE0: {
             // PB
+            if (size < 3) return false;
             float pb = (float) ((data2 << 7) + data1);
             float v = (pb / 8192.0f) - 1.0f;  // -1.0 to 1.0
             if (mpeMode_) {
+                VoiceData &touch = touches_[ch];
+                touch.x_ = v;
                 if (touch.active_) {
                     touch.note_ = touch.startNote_ + (v * pitchbendRange_);
-                    touch.x_ = v;
-
-                    msg.type_ = MecMsg::TOUCH_CONTINUE;
-                    msg.data_.touch_.touchId_ = ch;
-                    msg.data_.touch_.note_ = touch.note_;
-                    msg.data_.touch_.x_ = touch.x_;
-                    msg.data_.touch_.y_ = touch.y_;
-                    msg.data_.touch_.z_ = touch.z_;
-                    queue_.addToQueue(msg);
+                    addTouch(MecMsg::TOUCH_CONTINUE, ch, touch);
                 }
             } else {
-                msg.type_ = MecMsg::CONTROL;
-                msg.data_.control_.controlId_ = type;
-                msg.data_.control_.value_ = v;
-                queue_.addToQueue(msg);
+                control(type, v);
             }
             break;
         }
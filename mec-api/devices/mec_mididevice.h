@@ -32,6 +32,9 @@ public:
 
     void queueMecMsg(MecMsg &msg) { queue_.addToQueue(msg);}
 
+    // nrpn parameters are reported as controls, offset from this base
+    static constexpr int NRPN_CONTROL_BASE = 0x10000;
+
 protected:
     virtual RtMidiIn::RtMidiCallback getMidiCallback();
 
@@ -65,6 +68,9 @@ protected:
 
     bool send(const MidiMsg &msg);
 
+    // parse a raw midi message, safe to call from the rtmidi thread (no allocation)
+    bool parseMidi(const unsigned char *data, unsigned size);
+
     bool active_;
 
     ICallback &callback_;
@@ -74,6 +80,10 @@ protected:
 
     MsgQueue queue_;
 
+    static constexpr unsigned MAX_CH = 16;
+    static constexpr unsigned MAX_NOTE = 128;
+    static constexpr unsigned MAX_TOUCH = 16;
+
     struct VoiceData {
         float startNote_;
         float note_;
@@ -81,11 +91,39 @@ protected:
         float y_;
         float z_;
         bool active_;
+        unsigned char ch_;
+        unsigned char midiNote_;
     };
-    VoiceData touches_[16];
+    // mpe : indexed by channel, otherwise by allocated touch id
+    VoiceData touches_[MAX_TOUCH];
 
     float pitchbendRange_;
     bool mpeMode_;
+
+private:
+    void resetTouches();
+    void addTouch(MecMsg::type type, int touchId, const VoiceData &touch);
+    void control(int ctrlId, float v);
+    void touchOn(unsigned ch, unsigned note, unsigned vel);
+    void touchOff(unsigned ch, unsigned note, unsigned vel);
+    void continuousController(unsigned ch, unsigned cc, unsigned v);
+
+    // non mpe, (ch, note) -> touch id, NO_TOUCH if not sounding
+    static constexpr unsigned char NO_TOUCH = 0xFF;
+    unsigned char noteTouch_[MAX_CH][MAX_NOTE];
+    unsigned char freeTouches_[MAX_TOUCH];
+    unsigned freeCount_;
+
+    // 14 bit cc (0-31 msb, 32-63 lsb) and nrpn state, per channel
+    bool cc14bit_;
+    bool nrpn_;
+    unsigned char ccMsb_[MAX_CH][32];
+    unsigned nrpnParam_[MAX_CH];
+    unsigned char nrpnMsb_[MAX_CH];
+
+    // rtmidi queued (non callback) input, drained in process()
+    bool queuedInput_;
+    std::vector<unsigned char> inMsg_;
 };
 
 
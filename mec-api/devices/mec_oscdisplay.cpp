@@ -241,7 +241,7 @@ void OscDisplayParamMode::changePot(unsigned pot, float rawvalue) {
 
         if (rawvalue != std::numeric_limits<float>::max()) {
             float value = rawvalue / MAX_POT_VALUE;
-            calc = param->calcFloat(value);
+            calc = param->normalisedValue(value);
             //std::cerr << "changePot " << pot << " " << value << " cv " << calc.floatValue() << " pv " << param->current().floatValue() << std::endl;
         }
 
@@ -282,6 +282,12 @@ void Push2::changed(Kontrol::ChangeSource source, const Kontrol::Rack &rack, con
     if (currentPadMode()) currentPadMode()->changed(source, rack, module, parameter);
 }
 
+void Push2::changedParams(Kontrol::ChangeSource source, const Kontrol::Rack &rack,
+                          const std::vector<Kontrol::ChangedParam> &params) {
+    if (currentDisplayMode()) currentDisplayMode()->changedParams(source, rack, params);
+    if (currentPadMode()) currentPadMode()->changedParams(source, rack, params);
+}
+
 
 void Push2::resource(Kontrol::ChangeSource source, const Kontrol::Rack &rack,
                      const std::string& resType, const std::string &resValue) {
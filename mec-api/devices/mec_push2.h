@@ -73,6 +73,11 @@ public:
     void changed(Kontrol::ChangeSource, const Kontrol::Rack &, const Kontrol::Module &,
                  const Kontrol::Parameter &) override { ; }
 
+    void changedParams(Kontrol::ChangeSource src, const Kontrol::Rack &rack,
+                       const std::vector<Kontrol::ChangedParam> &params) override {
+        Kontrol::KontrolCallback::changedParams(src, rack, params);
+    }
+
     void resource(Kontrol::ChangeSource, const Kontrol::Rack &,
                   const std::string&, const std::string &) override { ; };
 
@@ -109,6 +114,11 @@ public:
     void changed(Kontrol::ChangeSource, const Kontrol::Rack &, const Kontrol::Module &,
                  const Kontrol::Parameter &) override { ; }
 
+    void changedParams(Kontrol::ChangeSource src, const Kontrol::Rack &rack,
+                       const std::vector<Kontrol::ChangedParam> &params) override {
+        Kontrol::KontrolCallback::changedParams(src, rack, params);
+    }
+
     void resource(Kontrol::ChangeSource, const Kontrol::Rack &,
                   const std::string&, const std::string &) override { ; };
 
@@ -158,6 +168,8 @@ public:
                const Kontrol::Parameter &parameter) override;
     void changed(Kontrol::ChangeSource source, const Kontrol::Rack &rack, const Kontrol::Module &module,
                  const Kontrol::Parameter &parameter) override;
+    void changedParams(Kontrol::ChangeSource source, const Kontrol::Rack &rack,
+                       const std::vector<Kontrol::ChangedParam> &params) override;
 
     void loadPreset(Kontrol::ChangeSource source, const Kontrol::Rack &rack, std::string preset) override;
 
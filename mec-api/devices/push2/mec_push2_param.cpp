@@ -351,6 +351,36 @@ void P2_ParamMode::changed(Kontrol::ChangeSource src, const Kontrol::Rack &rack,
     }
 }
 
+void P2_ParamMode::changedParams(Kontrol::ChangeSource src, const Kontrol::Rack &rack,
+                                 const std::vector<Kontrol::ChangedParam> &params) {
+    for (const auto &changed : params) {
+        P2_DisplayMode::changed(src, rack, *changed.module_, *changed.param_);
+    }
+
+    // e.g. preset load, look up the displayed page once for the whole batch
+    if (rack.id() != parent_.currentRack()) return;
+    auto pRack = model_->getRack(parent_.currentRack());
+    auto pModule = model_->getModule(pRack, parent_.currentModule());
+    auto pPage = model_->getPage(pModule, parent_.currentPage());
+    auto pParams = model_->getParams(pModule, pPage);
+    if (pParams.empty()) return;
+
+    for (const auto &changed : params) {
+        // a batch may span modules, which can have params of the same name
+        if (changed.module_->id() != pModule->id()) continue;
+        const Kontrol::Parameter &param = *changed.param_;
+        unsigned i = 0;
+        for (auto p: pParams) {
+            if (p->id() == param.id()) {
+                // already applied by the model, only the display is updated here
+                drawParam(i, param);
+                break;
+            }
+            i++;
+        }
+    }
+}
+
 std::vector<std::shared_ptr<Kontrol::Module>> P2_ParamMode::getModules(const std::shared_ptr<Kontrol::Rack>& pRack) {
     std::vector<std::shared_ptr<Kontrol::Module>> ret;
     auto modulelist = model_->getModules(pRack);
@@ -24,6 +24,9 @@ public:
 
     void changed(Kontrol::ChangeSource src, const Kontrol::Rack &, const Kontrol::Module &, const Kontrol::Parameter &) override;
 
+    void changedParams(Kontrol::ChangeSource src, const Kontrol::Rack &,
+                       const std::vector<Kontrol::ChangedParam> &params) override;
+
     void loadPreset(Kontrol::ChangeSource source, const Kontrol::Rack &rack, std::string preset) override;
 
     void midiLearn(Kontrol::ChangeSource src, bool b) override;
@@ -277,6 +277,17 @@ void MecApi_Impl::touchOff(const MusicalTouch &t) {
 
 
 
+// kontrol listeners that render (displays) can be deferred to their own thread with "deferred" : true
+static void addKontrolCallback(void *devprefs, const std::string &id,
+                               const std::shared_ptr<Kontrol::KontrolCallback> &cb) {
+    Preferences prefs(devprefs);
+    if (prefs.getBool("deferred", false)) {
+        Kontrol::KontrolModel::model()->addDeferredCallback(id, cb);
+    } else {
+        Kontrol::KontrolModel::model()->addCallback(id, cb);
+    }
+}
+
 void MecApi_Impl::initDevices() {
     if (fileprefs_ == nullptr || prefs_ == nullptr) {
         LOG_1("MecApi_Impl :: invalid preferences file");
@@ -324,7 +335,7 @@ void MecApi_Impl::initDevices() {
     if (prefs_->exists("push2")) {
         LOG_1("push2 initialise ");
         std::shared_ptr<Push2> device = std::make_shared<Push2>(*this);
-        Kontrol::KontrolModel::model()->addCallback("push2", device);
+        addKontrolCallback(prefs_->getSubTree("push2"), "push2", device);
         if (device->init(prefs_->getSubTree("push2"))) {
             if (device->isActive()) {
                 devices_.push_back(device);
@@ -345,7 +356,7 @@ void MecApi_Impl::initDevices() {
         LOG_1("oscdisplay initialise ");
         std::shared_ptr<OscDisplay> device = std::make_shared<OscDisplay>();
 //        std::shared_ptr<OscDisplay> device = std::make_shared<OscDisplay>(*this);
-        Kontrol::KontrolModel::model()->addCallback("oscdisplay", device);
+        addKontrolCallback(prefs_->getSubTree("oscdisplay"), "oscdisplay", device);
         if (device->init(prefs_->getSubTree("oscdisplay"))) {
             if (device->isActive()) {
                 devices_.push_back(device);
@@ -365,7 +376,7 @@ void MecApi_Impl::initDevices() {
     if (prefs_->exists("nui")) {
         LOG_1("nui initialise ");
         std::shared_ptr<Nui> device = std::make_shared<Nui>();
-        Kontrol::KontrolModel::model()->addCallback("nui", device);
+        addKontrolCallback(prefs_->getSubTree("nui"), "nui", device);
         if (device->init(prefs_->getSubTree("nui"))) {
             if (device->isActive()) {
                 devices_.push_back(device);
@@ -11,7 +11,7 @@ const int MAX_QUEUE_SIZE = 128;
 
 class MsgQueue_impl {
 public:
-    MsgQueue_impl();
+    MsgQueue_impl(unsigned size);
     ~MsgQueue_impl();
 
     bool addToQueue(MecMsg &);
@@ -24,7 +24,11 @@ private:
 
 /////////// Public Interface
 MsgQueue::MsgQueue() {
-    impl_.reset(new MsgQueue_impl());
+    impl_.reset(new MsgQueue_impl(MAX_QUEUE_SIZE));
+}
+
+MsgQueue::MsgQueue(unsigned size) {
+    impl_.reset(new MsgQueue_impl(size));
 }
 
 MsgQueue::~MsgQueue() {
@@ -96,7 +100,7 @@ bool MsgQueue::send(MecMsg& msg, ICallback &c) {
 
 /////////// Implementation
 
-MsgQueue_impl::MsgQueue_impl() : queue_(MAX_QUEUE_SIZE) {
+MsgQueue_impl::MsgQueue_impl(unsigned size) : queue_(size) {
 }
 
 MsgQueue_impl::~MsgQueue_impl() {
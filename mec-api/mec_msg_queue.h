@@ -41,11 +41,13 @@ class MsgQueue_impl;
 class MsgQueue {
 public:
     MsgQueue();
+    MsgQueue(unsigned size);
     ~MsgQueue();
     bool addToQueue(MecMsg&);
     bool nextMsg(MecMsg&);
     bool process(ICallback&);
-    bool send(MecMsg& msg, ICallback &c);
+    // dispatch a message to a callback, independent of any queue
+    static bool send(MecMsg& msg, ICallback &c);
 private:
     std::unique_ptr<MsgQueue_impl> impl_;
 };
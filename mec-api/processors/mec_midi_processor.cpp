@@ -3,10 +3,24 @@
 
 //#include "mec_log.h"
 
+#include <cmath>
+
 namespace mec {
 
-Midi_Processor::Midi_Processor(unsigned baseCh, float pbr) : baseChannel_(baseCh), pitchbendRange_ (pbr) {
-    ;
+static constexpr unsigned PB_CENTRE = 0x2000;
+
+Midi_Processor::Midi_Processor(unsigned baseCh, float pbr) :
+    baseChannel_(baseCh),
+    pitchbendRange_ (pbr),
+    polyAftertouch_(false),
+    pressureDeadband_(1),
+    pressureInterval_(5),
+    pitchGlide_(false),
+    pitchbend_(PB_CENTRE) {
+    for (unsigned i = 0; i < MAX_TOUCH; i++) {
+        touches_[i].active_ = false;
+        touches_[i].pressurePending_ = false;
+    }
 }
 
 Midi_Processor::~Midi_Processor() {
@@ -17,26 +31,148 @@ void Midi_Processor::setPitchbendRange(float v) {
     pitchbendRange_ = v;
 }
 
+void Midi_Processor::setPolyAftertouch(bool enable, unsigned deadband, unsigned interval) {
+    polyAftertouch_ = enable;
+    pressureDeadband_ = deadband > 0 ? deadband : 1;
+    pressureInterval_ = std::chrono::milliseconds(interval);
+}
+
+void Midi_Processor::setPitchGlide(bool enable) {
+    pitchGlide_ = enable;
+}
+
 /////////////////////////
 // ICallback interface
 void Midi_Processor::touchOn(int id, float note, float , float , float z) {
     unsigned ch = baseChannel_;
     unsigned mz = unipolar7bit(z);
-    noteOn(ch, (unsigned) note, mz);
+    if (id < 0 || id >= static_cast<int>(MAX_TOUCH)) {
+        noteOn(ch, (unsigned) note, mz);
+        return;
+    }
+
+    TouchData &touch = touches_[id];
+    if (touch.active_) {
+        // retriggered without an off, release previous note
+        noteOff(ch, touch.note_, 0);
+        touch.active_ = false;
+    }
+
+    // a single channel pitchbend cannot follow more than one touch
+    if (pitchGlide_ && pitchbend_ != PB_CENTRE && activeTouches() > 0) {
+        pitchbend_ = PB_CENTRE;
+        pitchbend(ch, pitchbend_);
+    }
+
+    touch.note_ = (unsigned) note;
+    touch.velocity_ = mz;
+    touch.pressure_ = 0;
+    touch.pressureTime_ = std::chrono::steady_clock::now();
+    touch.pressurePending_ = false;
+    touch.active_ = true;
+
+    noteOn(ch, touch.note_, mz);
+    if (pitchGlide_) glide(touch, note);
+}
+
+void Midi_Processor::touchContinue(int id, float note, float , float , float z) {
+    if (id < 0 || id >= static_cast<int>(MAX_TOUCH)) return;
+    TouchData &touch = touches_[id];
+    if (!touch.active_) return;
+
+    if (pitchGlide_) glide(touch, note);
+
+    if (polyAftertouch_) {
+        unsigned mz = unipolar7bit(z);
+        unsigned diff = mz > touch.pressure_ ? mz - touch.pressure_ : touch.pressure_ - mz;
+        // latest value is kept, and sent once the interval has expired (see poll)
+        touch.pendingPressure_ = mz;
+        touch.pressurePending_ = diff >= pressureDeadband_;
+        sendPressure(touch, std::chrono::steady_clock::now());
+    }
 }
 
-void Midi_Processor::touchContinue(int, float, float , float , float ) {
-    //TODO  : perhaps use for poly aftertouch?
-    ; // ignore
+void Midi_Processor::poll() {
+    if (!polyAftertouch_) return;
+    auto now = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < MAX_TOUCH; i++) {
+        if (touches_[i].active_) sendPressure(touches_[i], now);
+    }
+}
+
+void Midi_Processor::sendPressure(TouchData &touch, std::chrono::steady_clock::time_point now) {
+    if (!touch.pressurePending_ || now - touch.pressureTime_ < pressureInterval_) return;
+    touch.pressure_ = touch.pendingPressure_;
+    touch.pressureTime_ = now;
+    touch.pressurePending_ = false;
+    polyPressure(baseChannel_, touch.note_, touch.pressure_);
 }
 
 void Midi_Processor::touchOff(int id, float note, float , float , float z) {
     unsigned ch = baseChannel_;
     unsigned mz = unipolar7bit(z);
-    noteOff(ch, (unsigned) note, mz);
+    if (id < 0 || id >= static_cast<int>(MAX_TOUCH) || !touches_[id].active_) {
+        noteOff(ch, (unsigned) note, mz);
+        return;
+    }
+
+    TouchData &touch = touches_[id];
+    if (polyAftertouch_ && touch.pressure_ > 0) {
+        polyPressure(ch, touch.note_, 0);
+    }
+    noteOff(ch, touch.note_, mz);
+    touch.pressurePending_ = false;
+    touch.active_ = false;
+
+    if (pitchGlide_ && pitchbend_ != PB_CENTRE && activeTouches() == 0) {
+        pitchbend_ = PB_CENTRE;
+        pitchbend(ch, pitchbend_);
+    }
+}
+
+unsigned Midi_Processor::activeTouches() const {
+    unsigned n = 0;
+    for (unsigned i = 0; i < MAX_TOUCH; i++) {
+        if (touches_[i].active_) n++;
+    }
+    return n;
+}
+
+void Midi_Processor::glide(TouchData &touch, float note) {
+    float semis = note - static_cast<float>(touch.note_);
+
+    // monophonic, bend the channel relative to the sounding note
+    if (activeTouches() == 1 && pitchbendRange_ > 0.0f && std::fabs(semis) <= pitchbendRange_) {
+        float v = semis / pitchbendRange_;
+        unsigned pb = bipolar14bit(v);
+        if (pb > 0x3FFF) pb = 0x3FFF;
+        if (pb != pitchbend_) {
+            pitchbend_ = pb;
+            pitchbend(baseChannel_, pitchbend_);
+        }
+        return;
+    }
+
+    // polyphonic (or out of bend range), step to the nearest semitone
+    if (note < 0.0f) return;
+    unsigned nearest = static_cast<unsigned>(note + 0.5f);
+    if (nearest > 127) nearest = 127;
+    if (nearest != touch.note_) {
+        // the new note is at pitch, so must not carry the bend
+        if (pitchbend_ != PB_CENTRE) {
+            pitchbend_ = PB_CENTRE;
+            pitchbend(baseChannel_, pitchbend_);
+        }
+        unsigned vel = touch.pressure_ > 0 ? touch.pressure_ : touch.velocity_;
+        noteOn(baseChannel_, nearest, vel > 0 ? vel : 1);
+        noteOff(baseChannel_, touch.note_, 0);
+        touch.note_ = nearest;
+    }
 }
 
 void Midi_Processor::control(int attr, float v) {
+    // only midi cc are forwarded (e.g. not nrpn)
+    if (attr < 0 || attr >= MAX_CC) return;
 
     if (global_[attr] != v ) {
         global_[attr] = v;
@@ -80,6 +216,13 @@ bool Midi_Processor::pressure(unsigned ch, unsigned v) {
     return true;
 }
 
+bool Midi_Processor::polyPressure(unsigned ch, unsigned note, unsigned v) {
+    // LOG_1( "midi poly pressure ch " << ch << " note " << note << " v  " << v)
+    MidiMsg msg(static_cast<char>(0xA0 + ch), static_cast<char>(note), static_cast<char>(v));
+    process(msg);
+    return true;
+}
+
 bool Midi_Processor::pitchbend(unsigned ch, unsigned v) {
     // LOG_1( "midi pitchbend ch " << ch << " v  " << v)
     MidiMsg msg(static_cast<char>(0xE0 + ch), static_cast<char>(v & 0x7f), static_cast<char>((v & 0x3F80) >> 7));
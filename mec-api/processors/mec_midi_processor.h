@@ -7,6 +7,7 @@
 #include "../mec_api.h"
 
 #include <list>
+#include <chrono>
 
 namespace mec {
 
@@ -29,6 +30,16 @@ public:
     virtual void  process(MidiMsg& msg) = 0;
     void setPitchbendRange(float pbr);
 
+    // single channel expressive mode
+    // poly aftertouch : z sent as poly key pressure, only when changed by more than deadband
+    //                   and no more often than interval (ms)
+    // pitch glide : emulate per note pitch on non-mpe synths, channel pitchbend when monophonic,
+    //               otherwise retrigger on nearest semitone
+    void setPolyAftertouch(bool enable, unsigned deadband = 1, unsigned interval = 5);
+    void setPitchGlide(bool enable);
+    // send poly pressure deferred by the interval, call periodically e.g. before flushing output
+    void poll();
+
     // ICallback handling
     virtual void touchOn(int touchId, float note, float x, float y, float z);
     virtual void touchContinue(int touchId, float note, float x, float y, float z);
@@ -43,15 +54,41 @@ protected:
     bool noteOff(unsigned ch, unsigned note, unsigned vel);
     bool cc(unsigned ch, unsigned cc, unsigned v);
     bool pressure(unsigned ch, unsigned v);
+    bool polyPressure(unsigned ch, unsigned note, unsigned v);
     bool pitchbend(unsigned ch, unsigned v);
 
     unsigned bipolar14bit(float v) {return static_cast<unsigned int>((v * 0x2000) + 0x2000);}
     unsigned bipolar7bit(float v)  {return static_cast<unsigned int>(((v / 2.0f) + 0.5f) * 127); }
     unsigned unipolar7bit(float v) {return static_cast<unsigned int>(v * 127);}
 
-    float global_[127];
+    static constexpr int MAX_CC = 128;
+    float global_[MAX_CC];
     float pitchbendRange_;
     unsigned baseChannel_;
+
+private:
+    static constexpr unsigned MAX_TOUCH=16;
+
+    struct TouchData {
+        unsigned    note_;      // sounding note
+        unsigned    velocity_;
+        unsigned    pressure_;  // last sent poly pressure
+        std::chrono::steady_clock::time_point  pressureTime_;
+        unsigned    pendingPressure_;  // latest pressure, not yet sent
+        bool        pressurePending_;
+        bool        active_;
+    };
+
+    unsigned activeTouches() const;
+    void     glide(TouchData& touch, float note);
+    void     sendPressure(TouchData& touch, std::chrono::steady_clock::time_point now);
+
+    TouchData touches_[MAX_TOUCH];
+    bool      polyAftertouch_;
+    unsigned  pressureDeadband_;
+    std::chrono::milliseconds pressureInterval_;
+    bool      pitchGlide_;
+    unsigned  pitchbend_;
 };
 
 }
@@ -126,6 +126,8 @@ void MPE_Processor::touchOff(int id, float note, float x, float y, float z) {
 }
 
 void MPE_Processor::control(int attr, float v) {
+    // only midi cc are forwarded (e.g. not nrpn)
+    if (attr < 0 || attr >= MAX_CC) return;
 
     if (global_[attr] != v ) {
         global_[attr] = v;
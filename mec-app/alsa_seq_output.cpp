@@ -0,0 +1,211 @@
+#include "alsa_seq_output.h"
+
+#include "mec_app.h"
+
+#ifdef __linux__
+#include <alsa/asoundlib.h>
+
+class AlsaSeqOutput_impl {
+public:
+    AlsaSeqOutput_impl(unsigned latencyMs) :
+        seq_(nullptr), coder_(nullptr), port_(-1), queue_(-1), pending_(0),
+        latency_(std::chrono::milliseconds(latencyMs)) {
+    }
+
+    ~AlsaSeqOutput_impl() {
+        close();
+    }
+
+    bool create(const std::string &portname, bool virt) {
+        close();
+
+        // non blocking, so a full output pool cannot stall the mec thread
+        if (snd_seq_open(&seq_, "default", SND_SEQ_OPEN_OUTPUT, SND_SEQ_NONBLOCK) < 0) {
+            LOG_0("Alsa seq output unable to open sequencer");
+            seq_ = nullptr;
+            return false;
+        }
+        snd_seq_set_client_name(seq_, "MEC MIDI OUTPUT");
+
+        port_ = snd_seq_create_simple_port(seq_, "MIDI OUT",
+                                           SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ,
+                                           SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+        if (port_ < 0) {
+            LOG_0("Alsa seq output unable to create port");
+            close();
+            return false;
+        }
+
+        if (snd_midi_event_new(MAX_EVENT_SIZE, &coder_) < 0) {
+            LOG_0("Alsa seq output unable to create midi encoder");
+            close();
+            return false;
+        }
+
+        if (latency_.count() > 0) {
+            queue_ = snd_seq_alloc_named_queue(seq_, "MEC");
+            if (queue_ < 0) {
+                LOG_0("Alsa seq output unable to allocate queue");
+                close();
+                return false;
+            }
+            snd_seq_start_queue(seq_, queue_, nullptr);
+            snd_seq_drain_output(seq_);
+            // queue real time is measured from here, events are scheduled against it in absolute time
+            queueStart_ = std::chrono::steady_clock::now();
+        }
+
+        if (virt) {
+            LOG_0("Alsa seq virtual output created :" << portname);
+            return true;
+        }
+
+        snd_seq_addr_t addr;
+        if (snd_seq_parse_address(seq_, &addr, portname.c_str()) < 0) {
+            LOG_0("Port not found : [" << portname << "]");
+            close();
+            return false;
+        }
+        if (snd_seq_connect_to(seq_, port_, addr.client, addr.port) < 0) {
+            LOG_0("Alsa seq output unable to connect to : [" << portname << "]");
+            close();
+            return false;
+        }
+        LOG_0("Alsa seq output opened :" << portname);
+        return true;
+    }
+
+    bool isOpen() { return seq_ != nullptr; }
+
+    bool sendMsg(std::vector<unsigned char> &msg) {
+        if (!isOpen()) return false;
+
+        snd_seq_event_t ev;
+        snd_seq_ev_clear(&ev);
+        snd_midi_event_reset_encode(coder_);
+        long n = snd_midi_event_encode(coder_, msg.data(), static_cast<long>(msg.size()), &ev);
+        if (n <= 0 || ev.type == SND_SEQ_EVENT_NONE) return false;
+
+        snd_seq_ev_set_source(&ev, port_);
+        snd_seq_ev_set_subs(&ev);
+        if (queue_ >= 0) {
+            // arrival + latency, in queue time. if sending was delayed beyond the latency, it is
+            // in the past, and delivered immediately
+            auto arrived = eventTime_ > queueStart_ ? eventTime_ : std::chrono::steady_clock::now();
+            auto due = std::chrono::duration_cast<std::chrono::nanoseconds>(arrived - queueStart_ + latency_);
+            snd_seq_real_time_t t;
+            t.tv_sec = static_cast<unsigned>(due.count() / 1000000000LL);
+            t.tv_nsec = static_cast<unsigned>(due.count() % 1000000000LL);
+            snd_seq_ev_schedule_real(&ev, queue_, 0, &t);
+        } else {
+            snd_seq_ev_set_direct(&ev);
+        }
+
+        int rc = snd_seq_event_output(seq_, &ev);
+        if (rc == -EAGAIN) {
+            // output buffer full, push out what we have and retry once
+            snd_seq_drain_output(seq_);
+            rc = snd_seq_event_output(seq_, &ev);
+        }
+        if (rc < 0) {
+            LOG_0("Alsa seq output write error:" << snd_strerror(rc));
+            return false;
+        }
+        pending_++;
+        return true;
+    }
+
+    void eventTime(std::chrono::steady_clock::time_point t) { eventTime_ = t; }
+
+    void flush() {
+        if (!isOpen() || pending_ == 0) return;
+        // returns the bytes still buffered, so only done once that is zero, otherwise retried next cycle
+        int rc = snd_seq_drain_output(seq_);
+        if (rc == 0) {
+            pending_ = 0;
+        } else if (rc < 0 && rc != -EAGAIN) {
+            LOG_0("Alsa seq output drain error:" << snd_strerror(rc));
+            snd_seq_drop_output(seq_);
+            pending_ = 0;
+        }
+    }
+
+private:
+    static constexpr unsigned MAX_EVENT_SIZE = 256;
+
+    void close() {
+        if (coder_) {
+            snd_midi_event_free(coder_);
+            coder_ = nullptr;
+        }
+        if (seq_) {
+            if (queue_ >= 0) {
+                snd_seq_stop_queue(seq_, queue_, nullptr);
+                snd_seq_drain_output(seq_);
+                snd_seq_free_queue(seq_, queue_);
+            }
+            if (port_ >= 0) snd_seq_delete_simple_port(seq_, port_);
+            snd_seq_close(seq_);
+            seq_ = nullptr;
+        }
+        port_ = -1;
+        queue_ = -1;
+        pending_ = 0;
+    }
+
+    snd_seq_t *seq_;
+    snd_midi_event_t *coder_;
+    int port_;
+    int queue_;
+    unsigned pending_;
+    std::chrono::nanoseconds latency_;
+    std::chrono::steady_clock::time_point queueStart_;
+    std::chrono::steady_clock::time_point eventTime_; // zero = now
+};
+
+#else
+
+class AlsaSeqOutput_impl {
+public:
+    AlsaSeqOutput_impl(unsigned) { ; }
+
+    bool create(const std::string &, bool) {
+        LOG_0("Alsa seq output is only available on linux");
+        return false;
+    }
+
+    bool isOpen() { return false; }
+    bool sendMsg(std::vector<unsigned char> &) { return false; }
+    void flush() { ; }
+    void eventTime(std::chrono::steady_clock::time_point) { ; }
+};
+
+#endif // __linux__
+
+
+AlsaSeqOutput::AlsaSeqOutput(unsigned latencyMs) : impl_(new AlsaSeqOutput_impl(latencyMs)) {
+}
+
+AlsaSeqOutput::~AlsaSeqOutput() {
+    impl_.reset();
+}
+
+bool AlsaSeqOutput::create(const std::string &portname, bool virt) {
+    return impl_->create(portname, virt);
+}
+
+bool AlsaSeqOutput::isOpen() {
+    return impl_->isOpen();
+}
+
+bool AlsaSeqOutput::sendMsg(std::vector<unsigned char> &msg) {
+    return impl_->sendMsg(msg);
+}
+
+void AlsaSeqOutput::flush() {
+    impl_->flush();
+}
+
+void AlsaSeqOutput::eventTime(std::chrono::steady_clock::time_point t) {
+    impl_->eventTime(t);
+}
@@ -0,0 +1,30 @@
+#ifndef MEC_ALSA_SEQ_OUTPUT_H
+#define MEC_ALSA_SEQ_OUTPUT_H
+
+#include "midi_output.h"
+
+//////////////
+// native alsa sequencer output (linux only)
+// events are written to the client output buffer, scheduled on a sequencer queue at the time
+// they arrived (see eventTime) plus a constant latency, and drained once per cycle by flush().
+// so delivery is timed by the kernel, and the delay before an event is sent (e.g. the queue
+// thread's polling) is absorbed, as long as it is within the latency
+
+class AlsaSeqOutput_impl;
+
+class AlsaSeqOutput : public IMidiOutput {
+public:
+    AlsaSeqOutput(unsigned latencyMs = 0);
+    virtual ~AlsaSeqOutput();
+
+    bool create(const std::string &portname, bool virt = false) override;
+    bool isOpen() override;
+    bool sendMsg(std::vector<unsigned char> &msg) override;
+    void flush() override;
+    void eventTime(std::chrono::steady_clock::time_point t) override;
+
+private:
+    std::unique_ptr<AlsaSeqOutput_impl> impl_;
+};
+
+#endif //MEC_ALSA_SEQ_OUTPUT_H
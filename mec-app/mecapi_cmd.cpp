@@ -23,11 +23,13 @@ inline void pthread_exit(void *value_ptr)
 
 #include "mec_app.h"
 #include "midi_output.h"
+#include "alsa_seq_output.h"
 
 #include <mec_api.h>
 #include <mec_utils.h>
 #include <mec_prefs.h>
 #include <mec_msg_queue.h>
+#include <readerwriterqueue.h>
 #include <processors/mec_mpe_processor.h>
 
 
@@ -186,36 +188,50 @@ private:
     float xOffset_;
 };
 
+// "alsa seq" selects the native alsa sequencer backend, with "latency" (ms) scheduling
+static IMidiOutput *createMidiOutput(mec::Preferences &p) {
+    if (p.getBool("alsa seq", false)) {
+        return new AlsaSeqOutput(static_cast<unsigned>(p.getInt("latency", 0)));
+    }
+    return new MidiOutput();
+}
+
 class MecMidiProcessor : public mec::Midi_Processor {
 public:
     MecMidiProcessor(mec::Preferences &p) : prefs_(p) {
         setPitchbendRange(static_cast<float>(p.getDouble("pitchbend range", 48.0f)));
+        setPolyAftertouch(p.getBool("poly aftertouch", false),
+                          static_cast<unsigned>(p.getInt("pressure deadband", 1)),
+                          static_cast<unsigned>(p.getInt("pressure interval", 5)));
+        setPitchGlide(p.getBool("pitch glide", false));
+        output_.reset(createMidiOutput(prefs_));
         std::string device = prefs_.getString("device");
         int virt = prefs_.getInt("virtual", 0);
-        if (output_.create(device, virt > 0)) {
+        if (output_->create(device, virt > 0)) {
             LOG_1("MecMidiProcessor enabling for midi to " << device);
         }
-        if (!output_.isOpen()) {
+        if (!output_->isOpen()) {
             LOG_0("MecMidiProcessor not open, so invalid for" << device);
         }
     }
 
-    bool isValid() { return output_.isOpen(); }
+    bool isValid() { return output_->isOpen(); }
+    IMidiOutput *output() { return output_.get(); }
 
     void process(mec::Midi_Processor::MidiMsg &m) {
-        if (output_.isOpen()) {
+        if (output_->isOpen()) {
             std::vector<unsigned char> msg;
 
             for (int i = 0; i < m.size; i++) {
                 msg.push_back((unsigned char) m.data[i]);
             }
-            output_.sendMsg(msg);
+            output_->sendMsg(msg);
         }
     }
 
 private:
     mec::Preferences prefs_;
-    MidiOutput output_;
+    std::unique_ptr<IMidiOutput> output_;
 };
 
 
@@ -225,46 +241,56 @@ public:
     MecMpeProcessor(mec::Preferences &p) : prefs_(p) {
         // p.getInt("voices", 15);
         setPitchbendRange(static_cast<float>(p.getDouble("pitchbend range", 48.0f)));
+        output_.reset(createMidiOutput(prefs_));
         std::string device = prefs_.getString("device");
         int virt = prefs_.getInt("virtual", 0);
-        if (output_.create(device, virt > 0)) {
+        if (output_->create(device, virt > 0)) {
             LOG_1("MecMpeProcessor enabling for midi to " << device);
             LOG_1("TODO (MecMpeProcessor) :");
             LOG_1("- MPE init, including PB range");
         }
-        if (!output_.isOpen()) {
+        if (!output_->isOpen()) {
             LOG_0("MecMpeProcessor not open, so invalid for" << device);
         }
     }
 
-    bool isValid() { return output_.isOpen(); }
+    bool isValid() { return output_->isOpen(); }
+    IMidiOutput *output() { return output_.get(); }
 
     void process(mec::MPE_Processor::MidiMsg &m) {
-        if (output_.isOpen()) {
+        if (output_->isOpen()) {
             std::vector<unsigned char> msg;
 
             for (int i = 0; i < m.size; i++) {
                 msg.push_back((unsigned char) m.data[i]);
             }
-            output_.sendMsg(msg);
+            output_->sendMsg(msg);
         }
     }
 
 private:
     mec::Preferences prefs_;
-    MidiOutput output_;
+    std::unique_ptr<IMidiOutput> output_;
 };
 
 
 class CallbackQueue : public mec::ICallback {
 public:
-    CallbackQueue(unsigned pt) : pollTime_(pt){
+    CallbackQueue(unsigned pt) : queue_(MAX_QUEUE_SIZE), pollTime_(pt){
     }
 
     void subscribe(ICallback* pCB) {
         callbacks_.push_back(pCB);
     }
 
+    void addOutput(IMidiOutput* pOutput) {
+        outputs_.push_back(pOutput);
+    }
+
+    void addProcessor(mec::Midi_Processor* pProcessor) {
+        processors_.push_back(pProcessor);
+    }
+
 
     void touchOn(int touchId, float note, float x, float y, float z) override {
         mec::MecMsg msg;
@@ -274,7 +300,7 @@ public:
         msg.data_.touch_.x_ = x;
         msg.data_.touch_.y_ = y;
         msg.data_.touch_.z_ = z;
-        if(!queue_.addToQueue(msg)) LOG_0("unable to add touchOn to queue id:" << touchId);
+        if(!enqueue(msg)) LOG_0("unable to add touchOn to queue id:" << touchId);
     }
 
     void touchContinue(int touchId, float note, float x, float y, float z) override {
@@ -285,7 +311,7 @@ public:
         msg.data_.touch_.x_ = x;
         msg.data_.touch_.y_ = y;
         msg.data_.touch_.z_ = z;
-        if(!queue_.addToQueue(msg)) LOG_0("unable to add touchContinue to queue id:" << touchId);
+        if(!enqueue(msg)) LOG_0("unable to add touchContinue to queue id:" << touchId);
     }
 
     void touchOff(int touchId, float note, float x, float y, float z) override {
@@ -296,7 +322,7 @@ public:
         msg.data_.touch_.x_ = x;
         msg.data_.touch_.y_ = y;
         msg.data_.touch_.z_ = z;
-        if(!queue_.addToQueue(msg)) LOG_0("unable to add touchOff to queue id:" << touchId);
+        if(!enqueue(msg)) LOG_0("unable to add touchOff to queue id:" << touchId);
     }
 
     void control(int ctrlId, float v) override {
@@ -304,7 +330,7 @@ public:
         msg.type_ = mec::MecMsg::CONTROL;
         msg.data_.control_.controlId_ = ctrlId;
         msg.data_.control_.value_ = v;
-        if(!queue_.addToQueue(msg)) LOG_0("unable to add control to queue control:" << ctrlId);
+        if(!enqueue(msg)) LOG_0("unable to add control to queue control:" << ctrlId);
     }
 
     void mec_control(int cmd, void* other) override {
@@ -312,23 +338,51 @@ public:
         msg.type_ = mec::MecMsg::MEC_CONTROL;
         msg.data_.mec_control_.cmd_ = static_cast<mec::MecMsg::mec_cmd>(cmd);
 //        msg.data_.mec_control_.other_=other;
-        if(!queue_.addToQueue(msg)) LOG_0("unable to add mec_control to queue cmd:" << cmd);
+        if(!enqueue(msg)) LOG_0("unable to add mec_control to queue cmd:" << cmd);
 
     }
 
 
     void process() {
-        mec::MecMsg msg;
-        while(queue_.nextMsg(msg)) {
+        TimedMsg msg;
+        while(queue_.try_dequeue(msg)) {
+            // so scheduled outputs time from arrival, absorbing the delay until this thread polled
+            for(auto pOutput : outputs_) {
+                pOutput->eventTime(msg.time_);
+            }
             for(auto pCb : callbacks_) {
-                queue_.send(msg,*pCb);
+                mec::MsgQueue::send(msg.msg_,*pCb);
             }
         }
+        // deferred output is not from a queued event, so is timed from now
+        for(auto pOutput : outputs_) {
+            pOutput->eventTime(std::chrono::steady_clock::time_point());
+        }
+        for(auto pProcessor : processors_) {
+            pProcessor->poll();
+        }
+        for(auto pOutput : outputs_) {
+            pOutput->flush();
+        }
         if(pollTime_>0) usleep(pollTime_);
     }
 private:
-    mec::MsgQueue queue_;
+    static const unsigned MAX_QUEUE_SIZE = 128;
+
+    // stamped on arrival, see IMidiOutput::eventTime
+    struct TimedMsg {
+        mec::MecMsg msg_;
+        std::chrono::steady_clock::time_point time_;
+    };
+
+    bool enqueue(const mec::MecMsg &msg) {
+        return queue_.try_enqueue(TimedMsg{msg, std::chrono::steady_clock::now()});
+    }
+
+    moodycamel::ReaderWriterQueue<TimedMsg> queue_;
     std::vector<ICallback*> callbacks_;
+    std::vector<IMidiOutput*> outputs_;
+    std::vector<mec::Midi_Processor*> processors_;
     unsigned pollTime_;
 
 };
@@ -375,6 +429,9 @@ void *mecapi_proc(void *arg) {
         mecApi->subscribe(pCallbackQueue);
     }
 
+    // outputs flushed once per cycle, on the thread that sends to them
+    std::vector<IMidiOutput*> outputs;
+    std::vector<mec::Midi_Processor*> processors; // polled for deferred output
     if (outprefs.exists("midi")) {
         mec::Preferences cbprefs(outprefs.getSubTree("midi"));
         if(cbprefs.getBool("mpe",true)) {
@@ -382,8 +439,10 @@ void *mecapi_proc(void *arg) {
             if (pCb->isValid()) {
                 if(pCallbackQueue) {
                     pCallbackQueue->subscribe(pCb);
+                    pCallbackQueue->addOutput(pCb->output());
                 } else {
                     mecApi->subscribe(pCb);
+                    outputs.push_back(pCb->output());
                 }
             } else {
                 delete pCb;
@@ -393,8 +452,12 @@ void *mecapi_proc(void *arg) {
             if (pCb->isValid()) {
                 if(pCallbackQueue) {
                     pCallbackQueue->subscribe(pCb);
+                    pCallbackQueue->addProcessor(pCb);
+                    pCallbackQueue->addOutput(pCb->output());
                 } else {
                     mecApi->subscribe(pCb);
+                    processors.push_back(pCb);
+                    outputs.push_back(pCb->output());
                 }
             } else {
                 delete pCb;
@@ -455,6 +518,12 @@ void *mecapi_proc(void *arg) {
         mecAppLock lock;
         while (keepRunning) {
             mecApi->process();
+            for (auto pProcessor : processors) {
+                pProcessor->poll();
+            }
+            for (auto pOutput : outputs) {
+                pOutput->flush();
+            }
             mec_waitFor(lock,locktime);
         }
     }
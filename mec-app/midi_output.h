@@ -1,20 +1,38 @@
 #ifndef MEC_MIDI_OUTPUT_H
 #define MEC_MIDI_OUTPUT_H
 
+#include <chrono>
 #include <memory>
 #include <RtMidi.h>
 
 
-class MidiOutput {
+class IMidiOutput {
+public:
+    virtual ~IMidiOutput() {};
+
+    virtual bool create(const std::string &portname, bool virt = false) = 0;
+    virtual bool isOpen() = 0;
+    virtual bool sendMsg(std::vector<unsigned char> &msg) = 0;
+
+    // called once per processing cycle, after all messages have been sent
+    virtual void flush() {};
+
+    // when the event for the following messages arrived, e.g. was queued by a device, a default
+    // (zero) time point means now. outputs that schedule delivery can keep a constant latency from it
+    virtual void eventTime(std::chrono::steady_clock::time_point) {};
+};
+
+
+class MidiOutput : public IMidiOutput {
 public:
     MidiOutput();
     virtual ~MidiOutput();
 
-    bool create(const std::string &portname, bool virt = false);
+    bool create(const std::string &portname, bool virt = false) override;
 
-    bool isOpen() { return (output_ && (virtualOpen_ || output_->isPortOpen())); }
+    bool isOpen() override { return (output_ && (virtualOpen_ || output_->isPortOpen())); }
 
-    bool sendMsg(std::vector<unsigned char> &msg);
+    bool sendMsg(std::vector<unsigned char> &msg) override;
 private:
     std::unique_ptr<RtMidiOut> output_;
     bool virtualOpen_;
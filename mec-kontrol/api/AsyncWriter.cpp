@@ -0,0 +1,168 @@
+#include "AsyncWriter.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+
+#ifndef _WIN32
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+#include <mec_log.h>
+
+namespace Kontrol {
+
+AsyncWriter::AsyncWriter() :
+        busy_(false),
+        running_(false),
+        jobsWritten_(0),
+        jobsMerged_(0) {
+}
+
+AsyncWriter::~AsyncWriter() {
+    stop();
+}
+
+void *async_writer_thread_func(void *pWriter) {
+    AsyncWriter *pThis = static_cast<AsyncWriter *>(pWriter);
+    pThis->writeRun();
+    return nullptr;
+}
+
+// mutex_ must be held
+void AsyncWriter::start() {
+    if (running_) return;
+    if (writer_thread_.joinable()) writer_thread_.join();
+    running_ = true;
+#ifdef __COBALT__
+    pthread_t ph = writer_thread_.native_handle();
+    pthread_create(&ph, 0, async_writer_thread_func, this);
+#else
+    writer_thread_ = std::thread(async_writer_thread_func, this);
+#endif
+}
+
+void AsyncWriter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) return;
+        running_ = false;
+    }
+    wake_.notify_one();
+    // writer drains pending jobs before exiting
+    if (writer_thread_.joinable()) writer_thread_.join();
+}
+
+void AsyncWriter::submit(const std::string &key, Job job, Completion done) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto p = pending_.find(key);
+        if (p != pending_.end()) {
+            // not written yet, so just write the latest, but everyone waiting is told
+            Completion prev = p->second.done_;
+            if (prev && done) {
+                p->second = Pending{job, [prev, done](bool success) {
+                    prev(success);
+                    done(success);
+                }};
+            } else {
+                p->second = Pending{job, done ? done : prev};
+            }
+            jobsMerged_++;
+        } else {
+            pending_[key] = Pending{job, done};
+            order_.push_back(key);
+        }
+        start();
+    }
+    wake_.notify_one();
+}
+
+void AsyncWriter::flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this]() { return (order_.empty() && !busy_) || !running_; });
+}
+
+void AsyncWriter::writeRun() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        wake_.wait(lock, [this]() { return !order_.empty() || !running_; });
+        if (order_.empty()) break; // stopped, and nothing left to write
+
+        std::string key = order_.front();
+        order_.pop_front();
+        Pending p = pending_[key];
+        pending_.erase(key);
+        busy_ = true;
+        lock.unlock();
+
+        bool success = p.job_ ? p.job_() : false;
+        if (!success) LOG_0("AsyncWriter failed to write : " << key);
+        jobsWritten_++;
+        if (p.done_) p.done_(success);
+
+        lock.lock();
+        busy_ = false;
+        if (order_.empty()) idle_.notify_all();
+    }
+    idle_.notify_all();
+}
+
+#ifndef _WIN32
+
+// the temp file is synced before the rename, so after a power loss the file is either old or new,
+// and the directory after it, so the rename itself is durable
+bool AsyncWriter::writeFile(const std::string &filename, const std::string &data) {
+    std::string tmpfile = filename + ".tmp";
+    int fd = ::open(tmpfile.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) return false;
+    bool ok = true;
+    const char *p = data.data();
+    size_t left = data.size();
+    while (ok && left > 0) {
+        ssize_t n = ::write(fd, p, left);
+        if (n < 0) {
+            ok = errno == EINTR;
+            continue;
+        }
+        p += n;
+        left -= (size_t) n;
+    }
+    ok = ok && fsync(fd) == 0;
+    ok = ::close(fd) == 0 && ok;
+    if (!ok || rename(tmpfile.c_str(), filename.c_str()) != 0) {
+        remove(tmpfile.c_str());
+        return false;
+    }
+
+    size_t slash = filename.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : filename.substr(0, slash));
+    int dfd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd >= 0) {
+        if (fsync(dfd) != 0) LOG_1("AsyncWriter : unable to sync directory " << dir);
+        ::close(dfd);
+    }
+    return true;
+}
+
+#else
+
+bool AsyncWriter::writeFile(const std::string &filename, const std::string &data) {
+    std::string tmpfile = filename + ".tmp";
+    {
+        std::ofstream outfile(tmpfile.c_str(), std::ios::binary | std::ios::trunc);
+        if (!outfile.good()) return false;
+        outfile.write(data.data(), data.size());
+        if (!outfile.good()) {
+            outfile.close();
+            remove(tmpfile.c_str());
+            return false;
+        }
+    }
+    return rename(tmpfile.c_str(), filename.c_str()) == 0;
+}
+
+#endif
+
+} //namespace
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace Kontrol {
+
+// writes files on a background thread, so callers (e.g. pd) never block on slow storage.
+// jobs are keyed by file, a job replaces one still pending for the same key,
+// so repeated saves in quick succession are written once, the completions of both are called.
+class AsyncWriter {
+public:
+    // serialise and write, called on the writer thread, should only use data it has captured
+    typedef std::function<bool()> Job;
+    // called on the writer thread once written
+    typedef std::function<void(bool success)> Completion;
+
+    AsyncWriter();
+    // anything pending is written before returning
+    ~AsyncWriter();
+
+    void submit(const std::string &key, Job job, Completion done = nullptr);
+    // wait until everything submitted has been written
+    void flush();
+    void stop();
+    void writeRun();
+
+    unsigned long jobsWritten() const { return jobsWritten_; }
+
+    unsigned long jobsMerged() const { return jobsMerged_; }
+
+    // written to a temporary file then renamed, so readers never see a partial file
+    static bool writeFile(const std::string &filename, const std::string &data);
+
+private:
+    struct Pending {
+        Job job_;
+        Completion done_;
+    };
+
+    void start();
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    std::unordered_map<std::string, Pending> pending_;
+    std::deque<std::string> order_;
+    bool busy_;
+    bool running_;
+    std::atomic<unsigned long> jobsWritten_;
+    std::atomic<unsigned long> jobsMerged_;
+    std::thread writer_thread_;
+};
+
+} //namespace
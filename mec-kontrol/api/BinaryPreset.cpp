@@ -0,0 +1,266 @@
+#include "BinaryPreset.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#   include <sys/mman.h>
+#   include <unistd.h>
+#endif
+
+#include <mec_log.h>
+
+namespace Kontrol {
+
+const uint32_t BinaryPreset::MAGIC;
+const uint32_t BinaryPreset::VERSION;
+
+BinaryPreset::~BinaryPreset() {
+    if (data_ == nullptr) return;
+#ifndef _WIN32
+    if (mapped_) {
+        munmap((void *) data_, size_);
+        return;
+    }
+#endif
+    delete[] data_;
+}
+
+std::shared_ptr<BinaryPreset> BinaryPreset::open(const std::string &filename) {
+    std::shared_ptr<BinaryPreset> preset(new BinaryPreset());
+#ifndef _WIN32
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(Header)) {
+        ::close(fd);
+        return nullptr;
+    }
+    void *p = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) return nullptr;
+    preset->data_ = static_cast<const char *>(p);
+    preset->size_ = (size_t) st.st_size;
+    preset->mapped_ = true;
+#else
+    std::ifstream infile(filename.c_str(), std::ios::binary | std::ios::ate);
+    if (!infile.good()) return nullptr;
+    size_t size = (size_t) infile.tellg();
+    if (size < sizeof(Header)) return nullptr;
+    char *data = new char[size];
+    infile.seekg(0);
+    if (!infile.read(data, size)) {
+        delete[] data;
+        return nullptr;
+    }
+    preset->data_ = data;
+    preset->size_ = size;
+#endif
+    if (!preset->validate()) {
+        LOG_0("BinaryPreset::open invalid preset file : " << filename);
+        return nullptr;
+    }
+    return preset;
+}
+
+bool BinaryPreset::validate() {
+    header_ = reinterpret_cast<const Header *>(data_);
+    if (header_->magic_ != MAGIC || header_->version_ != VERSION || header_->size_ != size_) return false;
+
+    uint64_t offset = sizeof(Header);
+    strings_ = reinterpret_cast<const StringRecord *>(data_ + offset);
+    offset += (uint64_t) header_->numStrings_ * sizeof(StringRecord);
+    modules_ = reinterpret_cast<const ModuleRecord *>(data_ + std::min<uint64_t>(offset, size_));
+    offset += (uint64_t) header_->numModules_ * sizeof(ModuleRecord);
+    values_ = reinterpret_cast<const ValueRecord *>(data_ + std::min<uint64_t>(offset, size_));
+    offset += (uint64_t) header_->numValues_ * sizeof(ValueRecord);
+    mappings_ = reinterpret_cast<const MappingRecord *>(data_ + std::min<uint64_t>(offset, size_));
+    offset += (uint64_t) header_->numMappings_ * sizeof(MappingRecord);
+    stringData_ = data_ + std::min<uint64_t>(offset, size_);
+    offset += header_->stringDataSize_;
+    if (offset != size_) return false;
+
+    // check everything once, so accessors need no checks
+    for (unsigned i = 0; i < header_->numStrings_; i++) {
+        const StringRecord &s = strings_[i];
+        if ((uint64_t) s.offset_ + s.length_ >= header_->stringDataSize_) return false;
+        if (stringData_[s.offset_ + s.length_] != 0) return false;
+    }
+    for (unsigned m = 0; m < header_->numModules_; m++) {
+        const ModuleRecord &mr = modules_[m];
+        if (mr.id_ >= header_->numStrings_ || mr.type_ >= header_->numStrings_) return false;
+        if ((uint64_t) mr.firstValue_ + mr.numValues_ > header_->numValues_) return false;
+        if ((uint64_t) mr.firstMapping_ + mr.numMappings_ > header_->numMappings_) return false;
+    }
+    for (unsigned v = 0; v < header_->numValues_; v++) {
+        const ValueRecord &vr = values_[v];
+        if (vr.paramId_ >= header_->numStrings_) return false;
+        if (vr.type_ == V_STRING && vr.stringValue_ >= header_->numStrings_) return false;
+        if (vr.type_ != V_STRING && vr.type_ != V_FLOAT) return false;
+    }
+    for (unsigned i = 0; i < header_->numMappings_; i++) {
+        const MappingRecord &mr = mappings_[i];
+        if (mr.paramId_ >= header_->numStrings_) return false;
+        if (mr.type_ != M_MIDI_CC && mr.type_ != M_MODULATION) return false;
+    }
+    return true;
+}
+
+std::shared_ptr<RackPreset> BinaryPreset::rackPreset() const {
+    auto preset = std::make_shared<RackPreset>();
+    for (unsigned m = 0; m < numModules(); m++) {
+        const ModuleRecord &mr = module(m);
+        std::vector<ModulePresetValue> presetValues;
+        presetValues.reserve(mr.numValues_);
+        for (unsigned v = mr.firstValue_; v < mr.firstValue_ + mr.numValues_; v++) {
+            const ValueRecord &vr = value(v);
+            if (vr.type_ == V_STRING) {
+                presetValues.push_back(ModulePresetValue(string(vr.paramId_), ParamValue(string(vr.stringValue_))));
+            } else {
+                presetValues.push_back(ModulePresetValue(string(vr.paramId_), ParamValue(vr.floatValue_)));
+            }
+        }
+        MidiMap midimap;
+        ModulationMap modmap;
+        for (unsigned i = mr.firstMapping_; i < mr.firstMapping_ + mr.numMappings_; i++) {
+            const MappingRecord &mapr = mapping(i);
+            if (mapr.type_ == M_MIDI_CC) {
+                midimap[mapr.key_].push_back(string(mapr.paramId_));
+            } else {
+                modmap[mapr.key_].push_back(string(mapr.paramId_));
+            }
+        }
+        (*preset)[string(mr.id_)] = ModulePreset(string(mr.type_), presetValues, midimap, modmap);
+    }
+    return preset;
+}
+
+namespace {
+
+class StringTable {
+public:
+    uint32_t intern(const std::string &s) {
+        auto i = index_.find(s);
+        if (i != index_.end()) return i->second;
+        uint32_t idx = (uint32_t) records_.size();
+        records_.push_back(BinaryPreset::StringRecord{(uint32_t) data_.size(), (uint32_t) s.size()});
+        data_.insert(data_.end(), s.begin(), s.end());
+        data_.push_back(0);
+        index_[s] = idx;
+        return idx;
+    }
+
+    std::vector<BinaryPreset::StringRecord> records_;
+    std::vector<char> data_;
+
+private:
+    std::unordered_map<std::string, uint32_t> index_;
+};
+
+template<typename M>
+void addMappings(uint32_t type, const M &map, StringTable &strings, std::vector<BinaryPreset::MappingRecord> &mappings) {
+    // sorted by key, so output is stable
+    std::vector<unsigned> keys;
+    for (const auto &m : map) keys.push_back(m.first);
+    std::sort(keys.begin(), keys.end());
+    for (auto key : keys) {
+        for (const auto &paramId : map.at(key)) {
+            mappings.push_back(BinaryPreset::MappingRecord{type, key, strings.intern(paramId)});
+        }
+    }
+}
+
+}
+
+bool BinaryPreset::source(const std::string &filename, Source &source) {
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) return false;
+    source.size_ = (uint64_t) st.st_size;
+#ifdef __linux__
+    // whole seconds would miss a json edited within a second of the binary being written
+    source.modified_ = (int64_t) st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#else
+    source.modified_ = (int64_t) st.st_mtime * 1000000000LL;
+#endif
+    return true;
+}
+
+bool BinaryPreset::write(const std::string &filename, const RackPreset &preset, const Source &source) {
+    StringTable strings;
+    std::vector<ModuleRecord> modules;
+    std::vector<ValueRecord> values;
+    std::vector<MappingRecord> mappings;
+
+    std::vector<EntityId> moduleIds;
+    for (const auto &mp : preset) moduleIds.push_back(mp.first);
+    std::sort(moduleIds.begin(), moduleIds.end());
+
+    for (const auto &moduleId : moduleIds) {
+        const ModulePreset &modulePreset = preset.at(moduleId);
+        ModuleRecord mr;
+        mr.id_ = strings.intern(moduleId);
+        mr.type_ = strings.intern(modulePreset.moduleType());
+        mr.firstValue_ = (uint32_t) values.size();
+        for (auto v : modulePreset.values()) {
+            ValueRecord vr;
+            vr.paramId_ = strings.intern(v.paramId());
+            if (v.value().type() == ParamValue::T_String) {
+                vr.type_ = V_STRING;
+                vr.floatValue_ = 0.0f;
+                vr.stringValue_ = strings.intern(v.value().stringValue());
+            } else {
+                vr.type_ = V_FLOAT;
+                vr.floatValue_ = v.value().floatValue();
+                vr.stringValue_ = 0;
+            }
+            values.push_back(vr);
+        }
+        mr.numValues_ = (uint32_t) values.size() - mr.firstValue_;
+        mr.firstMapping_ = (uint32_t) mappings.size();
+        addMappings(M_MIDI_CC, modulePreset.midiMap(), strings, mappings);
+        addMappings(M_MODULATION, modulePreset.modulationMap(), strings, mappings);
+        mr.numMappings_ = (uint32_t) mappings.size() - mr.firstMapping_;
+        modules.push_back(mr);
+    }
+
+    // keep records 4 byte aligned
+    while (strings.data_.size() % 4) strings.data_.push_back(0);
+
+    Header header;
+    header.magic_ = MAGIC;
+    header.version_ = VERSION;
+    header.numStrings_ = (uint32_t) strings.records_.size();
+    header.numModules_ = (uint32_t) modules.size();
+    header.numValues_ = (uint32_t) values.size();
+    header.numMappings_ = (uint32_t) mappings.size();
+    header.stringDataSize_ = (uint32_t) strings.data_.size();
+    header.sourceSize_ = source.size_;
+    header.sourceModified_ = source.modified_;
+    header.size_ = (uint32_t) (sizeof(Header)
+                               + strings.records_.size() * sizeof(StringRecord)
+                               + modules.size() * sizeof(ModuleRecord)
+                               + values.size() * sizeof(ValueRecord)
+                               + mappings.size() * sizeof(MappingRecord)
+                               + strings.data_.size());
+
+    std::string data;
+    data.reserve(header.size_);
+    data.append((const char *) &header, sizeof(Header));
+    data.append((const char *) strings.records_.data(), strings.records_.size() * sizeof(StringRecord));
+    data.append((const char *) modules.data(), modules.size() * sizeof(ModuleRecord));
+    data.append((const char *) values.data(), values.size() * sizeof(ValueRecord));
+    data.append((const char *) mappings.data(), mappings.size() * sizeof(MappingRecord));
+    data.append(strings.data_.data(), strings.data_.size());
+
+    // readers may have the old file mapped, so replace rather than overwrite
+    return AsyncWriter::writeFile(filename, data);
+}
+
+} //namespace
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "Rack.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace Kontrol {
+
+// compact binary encoding of a rack preset, generated from (and convertible back to) params.json.
+// ids are interned in a string table, values and midi/modulation mappings are fixed size records,
+// so a mapped file is used in place, without parsing.
+//
+// layout (native byte order, offsets from start of file)
+//   Header
+//   StringRecord[numStrings]    offset/length into string data, strings are null terminated
+//   ModuleRecord[numModules]
+//   ValueRecord[numValues]      grouped by module
+//   MappingRecord[numMappings]  grouped by module, in list order per cc/bus
+//   string data
+class BinaryPreset {
+public:
+    static const uint32_t MAGIC = 0x4b505242; // KPRB
+    static const uint32_t VERSION = 2;
+
+    enum ValueType {
+        V_FLOAT,
+        V_STRING
+    };
+
+    enum MappingType {
+        M_MIDI_CC,
+        M_MODULATION
+    };
+
+    struct Header {
+        uint32_t magic_;
+        uint32_t version_;
+        uint32_t size_;
+        uint32_t numStrings_;
+        uint32_t numModules_;
+        uint32_t numValues_;
+        uint32_t numMappings_;
+        uint32_t stringDataSize_;
+        uint64_t sourceSize_;
+        int64_t sourceModified_;
+    };
+
+    // the params.json a binary was generated from, it is only used while that is unchanged
+    struct Source {
+        uint64_t size_;
+        int64_t modified_; // nanoseconds where available
+    };
+
+    struct StringRecord {
+        uint32_t offset_;
+        uint32_t length_;
+    };
+
+    struct ModuleRecord {
+        uint32_t id_;
+        uint32_t type_;
+        uint32_t firstValue_;
+        uint32_t numValues_;
+        uint32_t firstMapping_;
+        uint32_t numMappings_;
+    };
+
+    struct ValueRecord {
+        uint32_t paramId_;
+        uint32_t type_;
+        float floatValue_;
+        uint32_t stringValue_;
+    };
+
+    struct MappingRecord {
+        uint32_t type_;
+        uint32_t key_; // midi cc or modulation bus
+        uint32_t paramId_;
+    };
+
+    ~BinaryPreset();
+
+    // maps file, nullptr if missing or not a valid preset
+    static std::shared_ptr<BinaryPreset> open(const std::string &filename);
+    // encode preset, written to a temporary file and renamed
+    static bool write(const std::string &filename, const RackPreset &preset, const Source &source);
+    // size and modification time of a source file, false if missing
+    static bool source(const std::string &filename, Source &source);
+
+    bool generatedFrom(const Source &source) const {
+        return header_->sourceSize_ == source.size_ && header_->sourceModified_ == source.modified_;
+    }
+
+    unsigned numModules() const { return header_->numModules_; }
+
+    const ModuleRecord &module(unsigned i) const { return modules_[i]; }
+
+    const ValueRecord &value(unsigned i) const { return values_[i]; }
+
+    const MappingRecord &mapping(unsigned i) const { return mappings_[i]; }
+
+    const char *string(uint32_t idx) const { return stringData_ + strings_[idx].offset_; }
+
+    // decode, e.g. for conversion back to json
+    std::shared_ptr<RackPreset> rackPreset() const;
+
+private:
+    BinaryPreset() : data_(nullptr), size_(0), mapped_(false) { ; }
+
+    bool validate();
+
+    const char *data_;
+    size_t size_;
+    bool mapped_;
+    const Header *header_;
+    const StringRecord *strings_;
+    const ModuleRecord *modules_;
+    const ValueRecord *values_;
+    const MappingRecord *mappings_;
+    const char *stringData_;
+};
+
+} //namespace
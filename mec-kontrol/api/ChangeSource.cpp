@@ -11,8 +11,8 @@ const ChangeSource CS_MODULATION = ChangeSource(ChangeSource::SrcType::MODULATIO
 bool operator==(const ChangeSource &a, const ChangeSource &b) {
     if (a.type_ == b.type_) {
         // we only use id_ for remote sources
-        return a.type_ != ChangeSource::SrcType::REMOTE
-               || a.id_ == b.id_;
+        if (a.type_ != ChangeSource::SrcType::REMOTE || a.id_ == b.id_) return true;
+        return a.id_ && b.id_ && *a.id_ == *b.id_;
     }
     return false;
 }
@@ -22,8 +22,8 @@ bool operator!=(const ChangeSource &a, const ChangeSource &b) {
 }
 
 
-ChangeSource::ChangeSource(SrcType t, const SrcId& id) : type_(t), id_(id) {
-    ;
+ChangeSource::ChangeSource(SrcType t, const SrcId& id) : type_(t) {
+    if (!id.empty()) id_ = std::make_shared<const SrcId>(id);
 }
 
 
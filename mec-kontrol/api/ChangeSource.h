@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <memory>
 
 namespace Kontrol {
 
@@ -25,7 +26,8 @@ public:
 
 private:
     SrcType type_;
-    SrcId   id_;
+    // shared, so sources can be passed by value without allocating
+    std::shared_ptr<const SrcId> id_;
 };
 
 bool operator==(const ChangeSource& a,const ChangeSource& b);
@@ -0,0 +1,440 @@
+#include "DeferredCallback.h"
+
+#include <mec_log.h>
+
+#include <cassert>
+#include <vector>
+
+namespace Kontrol {
+
+DeferredCallback::DeferredCallback(const std::shared_ptr<KontrolCallback> &target, unsigned queueSize) :
+        target_(target),
+        queue_(queueSize),
+        queueSize_(queueSize),
+        pendingChanges_(0),
+        resync_(false),
+        eventsQueued_(0),
+        changesMerged_(0),
+        changesDropped_(0),
+        running_(false) {
+}
+
+DeferredCallback::~DeferredCallback() {
+    // the dispatch thread runs against this, so must not be the one destroying it
+    assert(dispatch_thread_.get_id() != std::this_thread::get_id());
+    stop();
+    if (dispatch_thread_.joinable()) dispatch_thread_.join();
+}
+
+void *deferred_callback_dispatch_thread_func(void *pCallback) {
+    DeferredCallback *pThis = static_cast<DeferredCallback *>(pCallback);
+    pThis->dispatchRun();
+    return nullptr;
+}
+
+bool DeferredCallback::start() {
+    if (running_) return true;
+    assert(dispatch_thread_.get_id() != std::this_thread::get_id());
+    // stopped during dispatch, so not yet joined
+    if (dispatch_thread_.joinable()) dispatch_thread_.join();
+    running_ = true;
+#ifdef __COBALT__
+    pthread_t ph = dispatch_thread_.native_handle();
+    pthread_create(&ph, 0, deferred_callback_dispatch_thread_func, this);
+#else
+    dispatch_thread_ = std::thread(deferred_callback_dispatch_thread_func, this);
+#endif
+    return true;
+}
+
+void DeferredCallback::stop() {
+    if (running_) {
+        running_ = false;
+        // if stopped by the listener itself, during dispatch, the thread exits once the callback returns,
+        // and is joined by start or the destructor
+        if (dispatch_thread_.joinable() && dispatch_thread_.get_id() != std::this_thread::get_id()) {
+            dispatch_thread_.join();
+        }
+        target_->stop();
+    }
+}
+
+void DeferredCallback::post(Event &e) {
+    eventsQueued_++;
+    if (e.type_ == E_CHANGED) {
+        // bounded, if the listener falls behind drop changes and resync values when it catches up
+        if (pendingChanges_ >= queueSize_ || !queue_.try_enqueue(std::move(e))) {
+            changesDropped_++;
+            resync_ = true;
+            return;
+        }
+        pendingChanges_++;
+        return;
+    }
+    // metadata is never dropped, queue will grow if needed
+    queue_.enqueue(std::move(e));
+}
+
+void DeferredCallback::postParam(EventType t, ChangeSource src, const Rack &rack, const Module &module,
+                                 const Parameter &param, unsigned num) {
+    Event e(t, src);
+    e.rackId_ = rack.id();
+    e.moduleId_ = module.id();
+    e.id_ = param.id();
+    e.num_ = num;
+    post(e);
+}
+
+void DeferredCallback::dispatchRun() {
+    std::vector<Event> events(MAX_BATCH);
+    auto model = KontrolModel::model();
+
+    // consecutive changes to a rack are delivered as one changedParams
+    ChangeSource batchSrc = CS_LOCAL;
+    std::shared_ptr<Rack> batchRack;
+    std::vector<ChangedParam> batch;
+    std::vector<std::shared_ptr<Module>> batchModules;
+    std::vector<std::shared_ptr<Parameter>> batchParams;
+    auto flushBatch = [&]() {
+        if (!batch.empty()) target_->changedParams(batchSrc, *batchRack, batch);
+        batch.clear();
+        batchModules.clear();
+        batchParams.clear();
+        batchRack.reset();
+    };
+
+    while (running_) {
+        size_t n = queue_.wait_dequeue_bulk_timed(events.begin(), MAX_BATCH,
+                                                  (std::int64_t) POLL_TIMEOUT_MS * 1000);
+        for (size_t i = 0; i < n && running_; i++) {
+            Event &e = events[i];
+            if (e.type_ == E_CHANGED) {
+                pendingChanges_--;
+                if (superseded(events, i, n)) {
+                    changesMerged_++;
+                    e.changed_ = ParamValue();
+                    continue;
+                }
+                std::shared_ptr<Rack> rack;
+                std::shared_ptr<Module> module;
+                auto param = model->getParam(e.handle_, rack, module);
+                if (param == nullptr) continue;
+                if (batchRack != rack || batchSrc != e.src_) {
+                    flushBatch();
+                    batchRack = rack;
+                    batchSrc = e.src_;
+                }
+                batch.push_back(ChangedParam{module.get(), param.get(), e.changed_});
+                batchModules.push_back(module);
+                batchParams.push_back(param);
+                e.changed_ = ParamValue();
+            } else {
+                // keep order relative to metadata
+                flushBatch();
+                dispatch(e);
+                e.rack_.reset();
+            }
+        }
+        flushBatch();
+
+        if (resync_.exchange(false)) resync();
+    }
+}
+
+bool DeferredCallback::superseded(const std::vector<Event> &events, size_t i, size_t n) {
+    const Event &e = events[i];
+    for (size_t j = i + 1; j < n; j++) {
+        const Event &later = events[j];
+        if (later.type_ != E_CHANGED) return false;
+        if (later.handle_ == e.handle_ && later.src_ == e.src_) return true;
+    }
+    return false;
+}
+
+// values are read lock free, as the model is changed on another thread
+void DeferredCallback::resync() {
+    auto model = KontrolModel::model();
+    std::vector<ChangedParam> changed;
+    for (const auto &rack : model->getRacks()) {
+        changed.clear();
+        auto modules = model->getModules(rack);
+        // changed holds raw pointers, these keep the params alive until the listener returns,
+        // as the owner may replace them meanwhile
+        std::vector<std::shared_ptr<Parameter>> params;
+        for (const auto &module : modules) {
+            for (const auto &param : model->getParams(module)) {
+                changed.push_back(ChangedParam{module.get(), param.get(), ParamValue(param->currentFloat())});
+                params.push_back(param);
+            }
+        }
+        if (!changed.empty()) target_->changedParams(CS_LOCAL, *rack, changed);
+    }
+}
+
+void DeferredCallback::dispatch(const Event &e) {
+    auto model = KontrolModel::model();
+    std::shared_ptr<Rack> rack = e.rack_ ? e.rack_ : model->getRack(e.rackId_);
+    std::shared_ptr<Module> module = rack != nullptr ? model->getModule(rack, e.moduleId_) : nullptr;
+
+    switch (e.type_) {
+        case E_RACK : {
+            if (rack) target_->rack(e.src_, *rack);
+            break;
+        }
+        case E_MODULE : {
+            if (module) target_->module(e.src_, *rack, *module);
+            break;
+        }
+        case E_PAGE : {
+            auto page = model->getPage(module, e.id_);
+            if (page) target_->page(e.src_, *rack, *module, *page);
+            break;
+        }
+        case E_PARAM :
+        case E_ASSIGN_MIDI_CC :
+        case E_UNASSIGN_MIDI_CC :
+        case E_ASSIGN_MODULATION :
+        case E_UNASSIGN_MODULATION : {
+            auto param = model->getParam(module, e.id_);
+            if (param == nullptr) break;
+            switch (e.type_) {
+                case E_PARAM :
+                    target_->param(e.src_, *rack, *module, *param);
+                    break;
+                case E_ASSIGN_MIDI_CC :
+                    target_->assignMidiCC(e.src_, *rack, *module, *param, e.num_);
+                    break;
+                case E_UNASSIGN_MIDI_CC :
+                    target_->unassignMidiCC(e.src_, *rack, *module, *param, e.num_);
+                    break;
+                case E_ASSIGN_MODULATION :
+                    target_->assignModulation(e.src_, *rack, *module, *param, e.num_);
+                    break;
+                case E_UNASSIGN_MODULATION :
+                default:
+                    target_->unassignModulation(e.src_, *rack, *module, *param, e.num_);
+                    break;
+            }
+            break;
+        }
+        case E_RESOURCE : {
+            if (rack) target_->resource(e.src_, *rack, e.id_, e.value_);
+            break;
+        }
+        case E_RESOURCES : {
+            if (rack) target_->resources(e.src_, *rack, e.id_, e.values_);
+            break;
+        }
+        case E_DELETE_RACK : {
+            if (rack) target_->deleteRack(e.src_, *rack);
+            break;
+        }
+        case E_ACTIVE_MODULE : {
+            if (module) target_->activeModule(e.src_, *rack, *module);
+            break;
+        }
+        case E_LOAD_MODULE : {
+            if (rack) target_->loadModule(e.src_, *rack, e.moduleId_, e.value_);
+            break;
+        }
+        case E_PING : {
+            target_->ping(e.src_, e.id_, e.num_, e.keepAlive_, e.version_, e.lastSeen_);
+            break;
+        }
+        case E_PUBLISH_START : {
+            target_->publishStart(e.src_, e.num_);
+            break;
+        }
+        case E_PUBLISH_RACK_FINISHED : {
+            if (rack) target_->publishRackFinished(e.src_, *rack);
+            break;
+        }
+        case E_SAVE_PRESET : {
+            if (rack) target_->savePreset(e.src_, *rack, e.id_);
+            break;
+        }
+        case E_LOAD_PRESET : {
+            if (rack) target_->loadPreset(e.src_, *rack, e.id_);
+            break;
+        }
+        case E_SAVE_SETTINGS : {
+            if (rack) target_->saveSettings(e.src_, *rack);
+            break;
+        }
+        case E_MIDI_LEARN : {
+            target_->midiLearn(e.src_, e.num_ != 0);
+            break;
+        }
+        case E_MODULATION_LEARN : {
+            target_->modulationLearn(e.src_, e.num_ != 0);
+            break;
+        }
+        case E_CHANGED :
+        default:
+            break;
+    }
+}
+
+// KontrolCallback
+void DeferredCallback::rack(ChangeSource src, const Rack &rack) {
+    Event e(E_RACK, src);
+    e.rackId_ = rack.id();
+    post(e);
+}
+
+void DeferredCallback::module(ChangeSource src, const Rack &rack, const Module &module) {
+    Event e(E_MODULE, src);
+    e.rackId_ = rack.id();
+    e.moduleId_ = module.id();
+    post(e);
+}
+
+void DeferredCallback::page(ChangeSource src, const Rack &rack, const Module &module, const Page &page) {
+    Event e(E_PAGE, src);
+    e.rackId_ = rack.id();
+    e.moduleId_ = module.id();
+    e.id_ = page.id();
+    post(e);
+}
+
+void DeferredCallback::param(ChangeSource src, const Rack &rack, const Module &module, const Parameter &param) {
+    postParam(E_PARAM, src, rack, module, param, 0);
+}
+
+// called on the changing thread, so only the handle and value are posted
+void DeferredCallback::changed(ChangeSource src, const Rack &rack, const Module &module, const Parameter &param) {
+    Event e(E_CHANGED, src);
+    e.handle_ = KontrolModel::model()->getParamHandle(rack, module, param);
+    if (!e.handle_.valid()) return;
+    e.changed_ = param.current();
+    post(e);
+}
+
+void DeferredCallback::changedParams(ChangeSource src, const Rack &rack, const std::vector<ChangedParam> &params) {
+    auto model = KontrolModel::model();
+    for (const auto &c : params) {
+        Event e(E_CHANGED, src);
+        e.handle_ = model->getParamHandle(rack, *c.module_, *c.param_);
+        if (!e.handle_.valid()) continue;
+        e.changed_ = c.value_;
+        post(e);
+    }
+}
+
+void DeferredCallback::resource(ChangeSource src, const Rack &rack, const std::string &resType,
+                                const std::string &resValue) {
+    Event e(E_RESOURCE, src);
+    e.rackId_ = rack.id();
+    e.id_ = resType;
+    e.value_ = resValue;
+    post(e);
+}
+
+void DeferredCallback::resources(ChangeSource src, const Rack &rack, const std::string &resType,
+                                 const std::vector<std::string> &res) {
+    Event e(E_RESOURCES, src);
+    e.rackId_ = rack.id();
+    e.id_ = resType;
+    e.values_ = res;
+    post(e);
+}
+
+void DeferredCallback::deleteRack(ChangeSource src, const Rack &rack) {
+    Event e(E_DELETE_RACK, src);
+    e.rackId_ = rack.id();
+    e.rack_ = KontrolModel::model()->getRack(rack.id());
+    post(e);
+}
+
+void DeferredCallback::activeModule(ChangeSource src, const Rack &rack, const Module &module) {
+    Event e(E_ACTIVE_MODULE, src);
+    e.rackId_ = rack.id();
+    e.moduleId_ = module.id();
+    post(e);
+}
+
+void DeferredCallback::loadModule(ChangeSource src, const Rack &rack, const EntityId &moduleId,
+                                  const std::string &moduleType) {
+    Event e(E_LOAD_MODULE, src);
+    e.rackId_ = rack.id();
+    e.moduleId_ = moduleId;
+    e.value_ = moduleType;
+    post(e);
+}
+
+void DeferredCallback::ping(ChangeSource src, const std::string &host, unsigned port, unsigned keepAlive,
+                            uint64_t version, uint64_t lastSeen) {
+    Event e(E_PING, src);
+    e.id_ = host;
+    e.num_ = port;
+    e.keepAlive_ = keepAlive;
+    e.version_ = version;
+    e.lastSeen_ = lastSeen;
+    post(e);
+}
+
+void DeferredCallback::assignMidiCC(ChangeSource src, const Rack &rack, const Module &module,
+                                    const Parameter &param, unsigned midiCC) {
+    postParam(E_ASSIGN_MIDI_CC, src, rack, module, param, midiCC);
+}
+
+void DeferredCallback::unassignMidiCC(ChangeSource src, const Rack &rack, const Module &module,
+                                      const Parameter &param, unsigned midiCC) {
+    postParam(E_UNASSIGN_MIDI_CC, src, rack, module, param, midiCC);
+}
+
+void DeferredCallback::assignModulation(ChangeSource src, const Rack &rack, const Module &module,
+                                        const Parameter &param, unsigned bus) {
+    postParam(E_ASSIGN_MODULATION, src, rack, module, param, bus);
+}
+
+void DeferredCallback::unassignModulation(ChangeSource src, const Rack &rack, const Module &module,
+                                          const Parameter &param, unsigned bus) {
+    postParam(E_UNASSIGN_MODULATION, src, rack, module, param, bus);
+}
+
+void DeferredCallback::publishStart(ChangeSource src, unsigned numRacks) {
+    Event e(E_PUBLISH_START, src);
+    e.num_ = numRacks;
+    post(e);
+}
+
+void DeferredCallback::publishRackFinished(ChangeSource src, const Rack &rack) {
+    Event e(E_PUBLISH_RACK_FINISHED, src);
+    e.rackId_ = rack.id();
+    post(e);
+}
+
+void DeferredCallback::savePreset(ChangeSource src, const Rack &rack, std::string preset) {
+    Event e(E_SAVE_PRESET, src);
+    e.rackId_ = rack.id();
+    e.id_ = preset;
+    post(e);
+}
+
+void DeferredCallback::loadPreset(ChangeSource src, const Rack &rack, std::string preset) {
+    Event e(E_LOAD_PRESET, src);
+    e.rackId_ = rack.id();
+    e.id_ = preset;
+    post(e);
+}
+
+void DeferredCallback::saveSettings(ChangeSource src, const Rack &rack) {
+    Event e(E_SAVE_SETTINGS, src);
+    e.rackId_ = rack.id();
+    post(e);
+}
+
+void DeferredCallback::midiLearn(ChangeSource src, bool b) {
+    Event e(E_MIDI_LEARN, src);
+    e.num_ = b;
+    post(e);
+}
+
+void DeferredCallback::modulationLearn(ChangeSource src, bool b) {
+    Event e(E_MODULATION_LEARN, src);
+    e.num_ = b;
+    post(e);
+}
+
+} //namespace
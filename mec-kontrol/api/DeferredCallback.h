@@ -0,0 +1,134 @@
+#pragma once
+
+#include "KontrolModel.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <blockingconcurrentqueue.h>
+
+namespace Kontrol {
+
+// wraps a listener, so it is called on its own thread rather than the thread changing the model.
+// events are posted to a lock-free queue, changed events are bounded and coalesced per param and source
+// (latest value wins) and delivered per rack as changedParams, with the value posted, see ChangedParam.
+// changes are posted by handle, other entities are looked up again by id when dispatched,
+// so the listener sees the current model.
+// see KontrolModel::addDeferredCallback
+class DeferredCallback : public KontrolCallback {
+public:
+    static const unsigned DEFAULT_QUEUE_SIZE = 512;
+
+    DeferredCallback(const std::shared_ptr<KontrolCallback> &target, unsigned queueSize = DEFAULT_QUEUE_SIZE);
+    ~DeferredCallback();
+
+    bool start();
+    void stop() override;
+    void dispatchRun();
+
+    std::shared_ptr<KontrolCallback> target() { return target_; }
+
+    unsigned long eventsQueued() { return eventsQueued_; }
+
+    unsigned long changesMerged() { return changesMerged_; }
+
+    unsigned long changesDropped() { return changesDropped_; }
+
+    // KontrolCallback
+    void rack(ChangeSource, const Rack &) override;
+    void module(ChangeSource, const Rack &, const Module &) override;
+    void page(ChangeSource, const Rack &, const Module &, const Page &) override;
+    void param(ChangeSource, const Rack &, const Module &, const Parameter &) override;
+    void changed(ChangeSource, const Rack &, const Module &, const Parameter &) override;
+    void changedParams(ChangeSource, const Rack &, const std::vector<ChangedParam> &) override;
+    void resource(ChangeSource, const Rack &, const std::string &, const std::string &) override;
+    void resources(ChangeSource, const Rack &, const std::string &, const std::vector<std::string> &) override;
+    void deleteRack(ChangeSource, const Rack &) override;
+    void activeModule(ChangeSource, const Rack &, const Module &) override;
+    void loadModule(ChangeSource, const Rack &, const EntityId &, const std::string &) override;
+    void ping(ChangeSource src, const std::string &host, unsigned port, unsigned keepAlive,
+              uint64_t version, uint64_t lastSeen) override;
+    void assignMidiCC(ChangeSource, const Rack &, const Module &, const Parameter &, unsigned midiCC) override;
+    void unassignMidiCC(ChangeSource, const Rack &, const Module &, const Parameter &, unsigned midiCC) override;
+    void assignModulation(ChangeSource, const Rack &, const Module &, const Parameter &, unsigned bus) override;
+    void unassignModulation(ChangeSource, const Rack &, const Module &, const Parameter &, unsigned bus) override;
+    void publishStart(ChangeSource, unsigned numRacks) override;
+    void publishRackFinished(ChangeSource, const Rack &) override;
+    void savePreset(ChangeSource, const Rack &, std::string preset) override;
+    void loadPreset(ChangeSource, const Rack &, std::string preset) override;
+    void saveSettings(ChangeSource, const Rack &) override;
+    void midiLearn(ChangeSource src, bool b) override;
+    void modulationLearn(ChangeSource src, bool b) override;
+
+private:
+    static const unsigned MAX_BATCH = 64;
+    static const unsigned POLL_TIMEOUT_MS = 100;
+
+    enum EventType {
+        E_RACK,
+        E_MODULE,
+        E_PAGE,
+        E_PARAM,
+        E_CHANGED,
+        E_RESOURCE,
+        E_RESOURCES,
+        E_DELETE_RACK,
+        E_ACTIVE_MODULE,
+        E_LOAD_MODULE,
+        E_PING,
+        E_ASSIGN_MIDI_CC,
+        E_UNASSIGN_MIDI_CC,
+        E_ASSIGN_MODULATION,
+        E_UNASSIGN_MODULATION,
+        E_PUBLISH_START,
+        E_PUBLISH_RACK_FINISHED,
+        E_SAVE_PRESET,
+        E_LOAD_PRESET,
+        E_SAVE_SETTINGS,
+        E_MIDI_LEARN,
+        E_MODULATION_LEARN
+    };
+
+    struct Event {
+        Event() : type_(E_CHANGED), src_(CS_LOCAL), handle_(ParamHandle::invalid()),
+                  num_(0), keepAlive_(0), version_(0), lastSeen_(0) { ; }
+
+        Event(EventType t, ChangeSource src) : type_(t), src_(src), handle_(ParamHandle::invalid()),
+                                               num_(0), keepAlive_(0), version_(0), lastSeen_(0) { ; }
+
+        EventType type_;
+        ChangeSource src_;
+        EntityId rackId_;
+        EntityId moduleId_;
+        EntityId id_; // page, param, resource type, preset or host, depending on type
+        ParamHandle handle_; // changed only, with its value
+        ParamValue changed_;
+        std::string value_;
+        std::vector<std::string> values_; // resources
+        unsigned num_;
+        unsigned keepAlive_;
+        uint64_t version_;
+        uint64_t lastSeen_;
+        std::shared_ptr<Rack> rack_; // deleted racks are no longer in the model when dispatched
+    };
+
+    void post(Event &e);
+    void postParam(EventType t, ChangeSource src, const Rack &, const Module &, const Parameter &, unsigned num);
+    void dispatch(const Event &e);
+    // a later change in the batch, before any other event, to the same param from the same source
+    static bool superseded(const std::vector<Event> &events, size_t i, size_t n);
+    void resync();
+
+    std::shared_ptr<KontrolCallback> target_;
+    moodycamel::BlockingConcurrentQueue<Event> queue_;
+    unsigned queueSize_;
+    std::atomic<unsigned> pendingChanges_;
+    std::atomic<bool> resync_;
+    std::atomic<unsigned long> eventsQueued_;
+    std::atomic<unsigned long> changesMerged_;
+    std::atomic<unsigned long> changesDropped_;
+    std::atomic<bool> running_;
+    std::thread dispatch_thread_;
+};
+
+} //namespace
@@ -1,6 +1,23 @@
 #include "Entity.h"
 
+#include <atomic>
+#include <chrono>
+
 namespace Kontrol {
 
+static std::atomic<uint64_t> &versionCounter() {
+    static std::atomic<uint64_t> counter(
+            (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count());
+    return counter;
+}
+
+uint64_t Entity::nextVersion() {
+    return ++versionCounter();
+}
+
+uint64_t Entity::currentVersion() {
+    return versionCounter().load();
+}
 
-} //namespace
\ No newline at end of file
+} //namespace
@@ -4,6 +4,8 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <cstdint>
+#include <atomic>
 
 namespace mec {
 class Preferences;
@@ -29,10 +31,40 @@ namespace Kontrol {
 
 typedef std::string EntityId;
 
+// compact reference to a parameter, resolved once from its rack/module/param ids
+// so hot paths can change params without string lookups.
+// generation is the module's param layout generation, stale handles are rejected
+struct ParamHandle {
+    static constexpr uint16_t INVALID_IDX = 0xFFFF;
+
+    uint16_t rack_;
+    uint16_t module_;
+    uint16_t param_;
+    uint16_t generation_;
+
+    static ParamHandle invalid() {
+        ParamHandle h;
+        h.rack_ = h.module_ = h.param_ = INVALID_IDX;
+        h.generation_ = 0;
+        return h;
+    }
+
+    bool valid() const { return rack_ != INVALID_IDX && module_ != INVALID_IDX && param_ != INVALID_IDX; }
+
+    bool operator==(const ParamHandle &h) const {
+        return rack_ == h.rack_ && module_ == h.module_ && param_ == h.param_ && generation_ == h.generation_;
+    }
+
+    // unique per handle, for use as a map key
+    uint64_t key() const {
+        return ((uint64_t) rack_ << 48) | ((uint64_t) module_ << 32) | ((uint64_t) param_ << 16) | generation_;
+    }
+};
+
 class Entity {
 public:
     Entity(const EntityId& id, const std::string& displayName)
-        : id_(id), displayName_(displayName) {
+        : id_(id), displayName_(displayName), version_(nextVersion()) {
         ;
     }
 
@@ -40,12 +72,21 @@ public:
 
     virtual const std::string& displayName() const { return displayName_;};
     virtual bool valid() { return !id_.empty();}
+
+    // version of last change to this entity, used to sync peers incrementally, read from any thread
+    uint64_t version() const { return version_;}
+    void touch() { version_ = nextVersion();}
+
+    // monotonically increasing for the process, seeded from the clock so a restart does not reuse versions
+    static uint64_t nextVersion();
+    static uint64_t currentVersion();
 protected:
-    Entity() {;}
+    Entity() : version_(nextVersion()) {;}
     virtual ~Entity() {;}
 
     EntityId id_;
     std::string displayName_;
+    std::atomic<uint64_t> version_;
 };
 
 class Page : public Entity {
@@ -0,0 +1,367 @@
+#include "FsIndex.h"
+#include "AsyncWriter.h"
+#include "ModuleCatalogue.h"
+
+#ifndef _WIN32
+
+#   include <dirent.h>
+
+#else
+#   include "dirent_win.h"
+#endif
+
+#ifdef __linux__
+
+#   include <sys/inotify.h>
+#   include <poll.h>
+#   include <unistd.h>
+
+#endif
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <cJSON.h>
+#include <mec_log.h>
+
+namespace Kontrol {
+
+static const char *PRESET_PARAMS = "params.json";
+
+FsIndex::FsIndex() :
+        rescans_(0),
+        notifyFd_(-1),
+        running_(false) {
+}
+
+FsIndex::~FsIndex() {
+    stop();
+}
+
+bool FsIndex::load(const std::string &file) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    file_ = file;
+
+    std::ifstream infile(file.c_str());
+    if (!infile.good()) return false;
+    std::stringstream text;
+    text << infile.rdbuf();
+
+    cJSON *root = cJSON_Parse(text.str().c_str());
+    if (root == nullptr) {
+        LOG_0("FsIndex : unable to parse index " << file);
+        return false;
+    }
+
+    bool ret = false;
+    cJSON *version = cJSON_GetObjectItem(root, "version");
+    cJSON *roots = cJSON_GetObjectItem(root, "roots");
+    if (version != nullptr && version->valueint == VERSION && roots != nullptr) {
+        for (cJSON *r = roots->child; r != nullptr; r = r->next) {
+            cJSON *type = cJSON_GetObjectItem(r, "type");
+            cJSON *kind = cJSON_GetObjectItem(r, "kind");
+            cJSON *dir = cJSON_GetObjectItem(r, "dir");
+            cJSON *dirs = cJSON_GetObjectItem(r, "dirs");
+            cJSON *entries = cJSON_GetObjectItem(r, "entries");
+            if (type == nullptr || kind == nullptr || dir == nullptr || dirs == nullptr || entries == nullptr) {
+                continue;
+            }
+
+            Root entry;
+            entry.resType_ = type->valuestring;
+            entry.kind_ = (Kind) kind->valueint;
+            entry.dir_ = dir->valuestring;
+            // modification times are strings, as they do not fit a double
+            for (cJSON *d = dirs->child; d != nullptr; d = d->next) {
+                entry.dirs_[d->string] = strtoll(d->valuestring, nullptr, 10);
+            }
+            for (cJSON *e = entries->child; e != nullptr; e = e->next) {
+                entry.entries_.push_back(e->valuestring);
+            }
+            roots_[rootKey(entry.resType_, entry.dir_)] = entry;
+        }
+        ret = true;
+    }
+    cJSON_Delete(root);
+    return ret;
+}
+
+bool FsIndex::save() {
+    std::string file;
+    cJSON *root = cJSON_CreateObject();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        file = file_;
+        cJSON_AddNumberToObject(root, "version", VERSION);
+        cJSON *roots = cJSON_CreateArray();
+        cJSON_AddItemToObject(root, "roots", roots);
+        for (const auto &r : roots_) {
+            const Root &entry = r.second;
+            cJSON *rjson = cJSON_CreateObject();
+            cJSON_AddItemToArray(roots, rjson);
+            cJSON_AddStringToObject(rjson, "type", entry.resType_.c_str());
+            cJSON_AddNumberToObject(rjson, "kind", entry.kind_);
+            cJSON_AddStringToObject(rjson, "dir", entry.dir_.c_str());
+            cJSON *dirs = cJSON_CreateObject();
+            cJSON_AddItemToObject(rjson, "dirs", dirs);
+            for (const auto &d : entry.dirs_) {
+                cJSON_AddStringToObject(dirs, d.first.c_str(), std::to_string(d.second).c_str());
+            }
+            cJSON *entries = cJSON_CreateArray();
+            cJSON_AddItemToObject(rjson, "entries", entries);
+            for (const auto &e : entry.entries_) {
+                cJSON_AddItemToArray(entries, cJSON_CreateString(e.c_str()));
+            }
+        }
+    }
+
+    bool ret = false;
+    if (!file.empty()) {
+        char *text = cJSON_Print(root);
+        ret = AsyncWriter::writeFile(file, std::string(text) + "\n");
+        free(text);
+    }
+    cJSON_Delete(root);
+    return ret;
+}
+
+std::vector<std::string> FsIndex::add(const std::string &resType, Kind kind, const std::string &dir) {
+    std::vector<std::string> entries;
+    std::string key = rootKey(resType, dir);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = roots_.find(key);
+        if (it != roots_.end() && it->second.kind_ == kind && current(it->second)) {
+            addWatches(key);
+            return it->second.entries_;
+        }
+
+        rescans_++;
+        Root &entry = roots_[key];
+        entry.resType_ = resType;
+        entry.kind_ = kind;
+        entry.dir_ = dir;
+        entry.dirs_.clear();
+        entry.entries_ = scan(kind, dir, &entry.dirs_);
+        entries = entry.entries_;
+        addWatches(key);
+    }
+    save();
+    return entries;
+}
+
+std::vector<std::string> FsIndex::scan(Kind kind, const std::string &dir, std::map<std::string, int64_t> *dirs) {
+    std::vector<std::string> found;
+    if (dirs != nullptr) (*dirs)[""] = modifiedTime(dir);
+    scanDir(kind, dir, "", found, dirs);
+    return found;
+}
+
+void FsIndex::scanDir(Kind kind, const std::string &baseDir, const std::string &subDir,
+                      std::vector<std::string> &found, std::map<std::string, int64_t> *dirs) {
+    struct stat st;
+    struct dirent **namelist;
+    std::string dir = baseDir;
+    if (subDir.length() > 0) dir = baseDir + "/" + subDir;
+    const char *marker = kind == K_PRESETS ? PRESET_PARAMS : ModuleCatalogue::MODULE_PATCH;
+
+    int n = scandir(dir.c_str(), &namelist, NULL, alphasort);
+    if (n > 0) {
+        for (int i = 0; i < n; i++) {
+            bool isDir = namelist[i]->d_type == DT_DIR;
+            // not all filesystems fill in the type
+            if (namelist[i]->d_type == DT_UNKNOWN) {
+                std::string path = dir + "/" + namelist[i]->d_name;
+                isDir = stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+            }
+            if (isDir &&
+                strcmp(namelist[i]->d_name, "..") != 0
+                && strcmp(namelist[i]->d_name, ".") != 0) {
+
+                std::string name = std::string(namelist[i]->d_name);
+                if (subDir.length() > 0) name = subDir + "/" + name;
+
+                // also recorded for directories without a marker yet, as it may be written later
+                if (dirs != nullptr) (*dirs)[name] = modifiedTime(baseDir + "/" + name);
+
+                std::string file = baseDir + "/" + name + "/" + marker;
+                if (stat(file.c_str(), &st) == 0) {
+                    found.push_back(name);
+                } else if (kind == K_MODULES) {
+                    scanDir(kind, baseDir, name, found, dirs);
+                }
+            }
+            free(namelist[i]);
+        }
+        free(namelist);
+    }
+}
+
+int64_t FsIndex::modifiedTime(const std::string &path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return -1;
+#ifdef __linux__
+    return (int64_t) st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#else
+    return (int64_t) st.st_mtime * 1000000000LL;
+#endif
+}
+
+// adding or removing an entry modifies the directory containing it, so only directories need checking
+bool FsIndex::current(const Root &root) {
+    for (const auto &d : root.dirs_) {
+        std::string path = d.first.empty() ? root.dir_ : root.dir_ + "/" + d.first;
+        if (modifiedTime(path) != d.second) return false;
+    }
+    return !root.dirs_.empty();
+}
+
+void FsIndex::rescan(const std::string &key) {
+    std::string resType;
+    std::vector<std::string> added, removed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = roots_.find(key);
+        if (it == roots_.end()) return;
+        Root &entry = it->second;
+
+        rescans_++;
+        std::map<std::string, int64_t> dirs;
+        std::vector<std::string> entries = scan(entry.kind_, entry.dir_, &dirs);
+
+        std::set<std::string> before(entry.entries_.begin(), entry.entries_.end());
+        std::set<std::string> after(entries.begin(), entries.end());
+        for (const auto &e : entries) {
+            if (before.find(e) == before.end()) added.push_back(e);
+        }
+        for (const auto &e : entry.entries_) {
+            if (after.find(e) == after.end()) removed.push_back(e);
+        }
+
+        resType = entry.resType_;
+        entry.dirs_ = dirs;
+        entry.entries_ = entries;
+        addWatches(key);
+    }
+
+    if (added.empty() && removed.empty()) return;
+
+    if (listener_) {
+        for (const auto &e : removed) listener_(resType, e, false);
+        for (const auto &e : added) listener_(resType, e, true);
+    }
+    save();
+}
+
+// called with mutex_ held, directories already watched return their existing descriptor
+void FsIndex::addWatches(const std::string &key) {
+#ifdef __linux__
+    if (notifyFd_ < 0) return;
+    const Root &entry = roots_[key];
+    for (const auto &d : entry.dirs_) {
+        std::string path = d.first.empty() ? entry.dir_ : entry.dir_ + "/" + d.first;
+        int wd = inotify_add_watch(notifyFd_, path.c_str(),
+                                   IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR);
+        if (wd >= 0) watches_[wd] = key;
+    }
+#endif
+}
+
+void *fs_index_thread_func(void *pIndex) {
+    FsIndex *pThis = static_cast<FsIndex *>(pIndex);
+    pThis->watchRun();
+    return nullptr;
+}
+
+bool FsIndex::watch(Listener listener) {
+#ifdef __linux__
+    std::lock_guard<std::mutex> tlock(threadMutex_);
+    if (running_) return true;
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        LOG_0("FsIndex : unable to watch directories, inotify unavailable");
+        return false;
+    }
+    listener_ = listener;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        notifyFd_ = fd;
+        for (const auto &r : roots_) {
+            addWatches(r.first);
+        }
+    }
+
+    running_ = true;
+#ifdef __COBALT__
+    pthread_t ph = watch_thread_.native_handle();
+    pthread_create(&ph, 0, fs_index_thread_func, this);
+#else
+    watch_thread_ = std::thread(fs_index_thread_func, this);
+#endif
+    return true;
+#else
+    return false;
+#endif
+}
+
+void FsIndex::stop() {
+    std::lock_guard<std::mutex> tlock(threadMutex_);
+    if (running_) {
+        running_ = false;
+        if (watch_thread_.joinable()) watch_thread_.join();
+    }
+#ifdef __linux__
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (notifyFd_ >= 0) {
+        close(notifyFd_);
+        notifyFd_ = -1;
+    }
+    watches_.clear();
+#endif
+}
+
+void FsIndex::watchRun() {
+#ifdef __linux__
+    alignas(struct inotify_event) char buf[4096];
+    std::set<std::string> dirty;
+    struct pollfd pfd;
+    pfd.fd = notifyFd_;
+    pfd.events = POLLIN;
+
+    while (running_) {
+        int timeout = dirty.empty() ? POLL_TIMEOUT_MS : SETTLE_MS;
+        int n = poll(&pfd, 1, timeout);
+        if (n <= 0) {
+            // quiet, rescan what changed
+            for (const auto &key : dirty) rescan(key);
+            dirty.clear();
+            continue;
+        }
+
+        ssize_t len;
+        while ((len = read(notifyFd_, buf, sizeof(buf))) > 0) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (char *p = buf; p < buf + len;) {
+                struct inotify_event *event = (struct inotify_event *) p;
+                auto w = watches_.find(event->wd);
+                if (w != watches_.end()) {
+                    if (event->mask & IN_IGNORED) {
+                        watches_.erase(w);
+                    } else {
+                        dirty.insert(w->second);
+                    }
+                }
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+    }
+#endif
+}
+
+} //namespace
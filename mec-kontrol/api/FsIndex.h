@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace Kontrol {
+
+// persistent index of resources found on disk (presets, module types), recording the modification
+// times of the directories they were found in, so startup only rescans directories that have changed.
+// on linux, indexed directories are watched with inotify while running, and rescanned as they change.
+class FsIndex {
+public:
+    enum Kind {
+        K_PRESETS, // directories containing params.json
+        K_MODULES  // directories containing module.pd, may be nested in category directories
+    };
+
+    // called on the watch thread, for each resource added or removed
+    typedef std::function<void(const std::string &resType, const std::string &res, bool added)> Listener;
+
+    FsIndex();
+    ~FsIndex();
+
+    // load a saved index, which is then saved back to the same file. false if missing or invalid
+    bool load(const std::string &file);
+    bool save();
+
+    // resources of resType under dir, rescanned only if it has changed since indexed
+    std::vector<std::string> add(const std::string &resType, Kind kind, const std::string &dir);
+
+    // scan without indexing, dirs receives the modification time of each directory visited
+    static std::vector<std::string> scan(Kind kind, const std::string &dir,
+                                         std::map<std::string, int64_t> *dirs = nullptr);
+
+    // modification time of path in nanoseconds where available, -1 if missing
+    static int64_t modifiedTime(const std::string &path);
+
+    // watch indexed directories (and those indexed later) for changes, false if not supported
+    bool watch(Listener listener);
+    void stop();
+    void watchRun();
+
+    unsigned long rescans() const { return rescans_; }
+
+private:
+    static const unsigned POLL_TIMEOUT_MS = 100;
+    static const unsigned SETTLE_MS = 50; // changes come in bursts (e.g. preset saves), rescan once quiet
+    static const int VERSION = 1;
+
+    struct Root {
+        std::string resType_;
+        Kind kind_;
+        std::string dir_;
+        std::map<std::string, int64_t> dirs_; // relative path ("" = dir_) -> modification time
+        std::vector<std::string> entries_;
+    };
+
+    static std::string rootKey(const std::string &resType, const std::string &dir) { return resType + ":" + dir; }
+
+    static void scanDir(Kind kind, const std::string &baseDir, const std::string &subDir,
+                        std::vector<std::string> &found, std::map<std::string, int64_t> *dirs);
+    static bool current(const Root &root);
+    void rescan(const std::string &key);
+    void addWatches(const std::string &key);
+
+    std::mutex mutex_;
+    std::string file_;
+    std::unordered_map<std::string, Root> roots_;
+    std::atomic<unsigned long> rescans_;
+
+    Listener listener_;
+    int notifyFd_;
+    std::unordered_map<int, std::string> watches_; // watch descriptor -> root key
+    std::mutex threadMutex_;
+    std::atomic<bool> running_;
+    std::thread watch_thread_;
+};
+
+} //namespace
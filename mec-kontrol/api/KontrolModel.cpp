@@ -1,5 +1,7 @@
 #include "KontrolModel.h"
+#include "DeferredCallback.h"
 #include <mec_prefs.h>
+#include <mec_log.h>
 
 namespace Kontrol {
 
@@ -16,23 +18,26 @@ std::shared_ptr<KontrolModel> KontrolModel::model() {
 //     model_.reset();
 // }
 
-KontrolModel::KontrolModel() {
+KontrolModel::KontrolModel() :
+        commands_(COMMAND_QUEUE_SIZE),
+        dequeued_(COMMAND_BULK_SIZE),
+        lastSlew_(std::chrono::steady_clock::now()) {
 }
 
 void KontrolModel::publishMetaData() const {
-    for (const auto &i : listeners_) {
+    auto listeners = listeners_.get();
+    for (const auto &i : *listeners) {
         (i.second)->publishStart(CS_LOCAL, 1);
     }
-    publishMetaData(localRack_);
+    publishMetaData(getLocalRack());
 }
 
 void KontrolModel::publishMetaData(const std::shared_ptr<Rack> &rack) const {
     std::vector<std::shared_ptr<Module>> modules = getModules(rack);
     publishRack(CS_LOCAL, *rack);
     for (const auto &resType:rack->getResourceTypes()) {
-        for (const auto &res : rack->getResources(resType)) {
-            publishResource(CS_LOCAL, *rack, resType, res);
-        }
+        const auto &res = rack->getResources(resType);
+        publishResources(CS_LOCAL, *rack, resType, std::vector<std::string>(res.begin(), res.end()));
     }
 
     publishPreset(rack);
@@ -40,7 +45,8 @@ void KontrolModel::publishMetaData(const std::shared_ptr<Rack> &rack) const {
     for (const auto &p : modules) {
         if (p != nullptr) publishMetaData(rack, p);
     }
-    for (const auto &i : listeners_) {
+    auto listeners = listeners_.get();
+    for (const auto &i : *listeners) {
         (i.second)->publishRackFinished(CS_LOCAL, *rack);
     }
 }
@@ -62,7 +68,8 @@ void KontrolModel::publishMetaData(const std::shared_ptr<Rack> &rack, const std:
 }
 
 void KontrolModel::publishPreset(const std::shared_ptr<Rack> &rack) const {
-    for (const auto &i : listeners_) {
+    auto listeners = listeners_.get();
+    for (const auto &i : *listeners) {
         (i.second)->loadPreset(CS_LOCAL, *rack, rack->currentPreset());
     }
 }
@@ -72,21 +79,20 @@ std::shared_ptr<Rack> KontrolModel::createLocalRack(unsigned port) {
     std::string host = "127.0.0.1";
     auto rackId = Rack::createId(host, port);
 
-    localRack_ = createRack(CS_LOCAL, rackId, host, port);
-    return localRack_;
+    auto rack = createRack(CS_LOCAL, rackId, host, port);
+    localRack_.store(rack);
+    return rack;
 }
 
 //access
 std::shared_ptr<Rack> KontrolModel::getLocalRack() const {
-    return localRack_;
+    return localRack_.load();
 }
 
 std::shared_ptr<Rack> KontrolModel::getRack(const EntityId &rackId) const {
-    try {
-        return racks_.at(rackId);
-    } catch (const std::out_of_range &) {
-        return nullptr;
-    }
+    auto t = racks_.get();
+    auto rack = t->racks_.find(rackId);
+    return rack != t->racks_.end() ? rack->second : nullptr;
 }
 
 std::shared_ptr<Module> KontrolModel::getModule(const std::shared_ptr<Rack> &rack, const EntityId &moduleId) const {
@@ -106,8 +112,9 @@ std::shared_ptr<Parameter> KontrolModel::getParam(const std::shared_ptr<Module>
 }
 
 std::vector<std::shared_ptr<Rack>> KontrolModel::getRacks() const {
+    auto t = racks_.get();
     std::vector<std::shared_ptr<Rack>> ret;
-    for (const auto &p : racks_) {
+    for (const auto &p : t->racks_) {
         if (p.second != nullptr) ret.push_back(p.second);
     }
     return ret;
@@ -139,21 +146,161 @@ std::vector<std::shared_ptr<Parameter>> KontrolModel::getParams(const std::share
 }
 
 
+// single writer
+void KontrolModel::ownerThread(std::thread::id id) {
+    ownerThread_ = id;
+}
+
+bool KontrolModel::isOwnerThread() const {
+    std::thread::id owner = ownerThread_;
+    return owner == std::thread::id() || owner == std::this_thread::get_id();
+}
+
+void KontrolModel::post(Command cmd) const {
+    QueuedCommand c;
+    c.cmd_.reset(new Command(std::move(cmd)));
+    queue(std::move(c));
+    notifyOwner();
+}
+
+// the caller notifies, so a batch wakes the owner once
+void KontrolModel::postChange(ChangeSource src, const ParamHandle &handle, const ParamValue &v, bool batch) const {
+    QueuedCommand c;
+    c.src_ = src;
+    c.handle_ = handle;
+    c.value_ = v;
+    c.batch_ = batch;
+    queue(std::move(c));
+}
+
+void KontrolModel::queue(QueuedCommand &&cmd) const {
+    // space is preallocated, so this only allocates if the owner has fallen far behind
+    if (!commands_.try_enqueue(std::move(cmd))) commands_.enqueue(std::move(cmd));
+}
+
+void KontrolModel::notifyOwner() const {
+    auto notify = commandNotify_.load();
+    if (notify) (*notify)();
+}
+
+void KontrolModel::commandNotify(Command notify) {
+    commandNotify_.store(notify ? std::make_shared<const Command>(std::move(notify)) : nullptr);
+}
+
+unsigned KontrolModel::processCommands() {
+    unsigned n = 0;
+    size_t count;
+    while ((count = commands_.try_dequeue_bulk(dequeued_.begin(), dequeued_.size())) > 0) {
+        for (size_t i = 0; i < count;) {
+            QueuedCommand &c = dequeued_[i];
+            if (c.cmd_) {
+                std::unique_ptr<Command> cmd(std::move(c.cmd_));
+                (*cmd)();
+                i++;
+            } else if (!c.batch_) {
+                changeParam(c.src_, c.handle_, c.value_);
+                i++;
+            } else {
+                size_t j = i + 1;
+                while (j < count && !dequeued_[j].cmd_ && dequeued_[j].batch_
+                       && dequeued_[j].handle_.rack_ == c.handle_.rack_ && dequeued_[j].src_ == c.src_) {
+                    j++;
+                }
+                applyChanges(dequeued_.data() + i, dequeued_.data() + j);
+                i = j;
+            }
+        }
+        n += (unsigned) count;
+    }
+    return n;
+}
+
+// changes queued by changeParams, for one rack and source
+unsigned KontrolModel::applyChanges(const QueuedCommand *begin, const QueuedCommand *end) {
+    std::shared_ptr<Rack> rack;
+    std::shared_ptr<Module> module;
+    applied_.clear();
+    for (const QueuedCommand *c = begin; c != end; c++) {
+        // the owner is the only writer, so modules outlive the notification
+        auto param = getParam(c->handle_, rack, module);
+        if (param == nullptr) continue;
+        if (module->changeParam(c->handle_.param_, c->value_, c->src_ == CS_PRESET)) {
+            applied_.push_back(ChangedParam{module.get(), param.get(), param->current()});
+        }
+    }
+    if (!applied_.empty()) publishChangedParams(begin->src_, *rack, applied_);
+    return (unsigned) applied_.size();
+}
+
+unsigned KontrolModel::processSlew() {
+    static const float MAX_SLEW_STEP_MS = 100.0f;
+    auto now = std::chrono::steady_clock::now();
+    float elapsedMs = std::chrono::duration<float, std::milli>(now - lastSlew_).count();
+    lastSlew_ = now;
+    // e.g. first call after a pause
+    elapsedMs = std::min(elapsedMs, MAX_SLEW_STEP_MS);
+    unsigned n = 0;
+    if (Rack::heldMidi() > 0) {
+        for (const auto &rack : getRacks()) n += rack->processHeldMidi();
+    }
+    // the usual case, nothing to walk
+    if (Module::slewingModules() == 0) return n;
+
+    std::vector<Module::SlewChange> slewed;
+    std::vector<ChangedParam> changed;
+    for (const auto &rack : getRacks()) {
+        std::vector<std::shared_ptr<Module>> modules;
+        slewed.clear();
+        for (const auto &module : rack->getModules()) {
+            if (!module->isSlewing()) continue;
+            unsigned start = slewed.size();
+            module->processSlew(elapsedMs, slewed);
+            for (unsigned i = start; i < slewed.size(); i++) modules.push_back(module);
+        }
+        if (slewed.empty()) continue;
+        n += slewed.size();
+
+        // one notification per source, so remote changes are not echoed back
+        std::vector<bool> sent(slewed.size(), false);
+        for (unsigned i = 0; i < slewed.size(); i++) {
+            if (sent[i]) continue;
+            changed.clear();
+            for (unsigned j = i; j < slewed.size(); j++) {
+                if (!sent[j] && slewed[j].src_ == slewed[i].src_) {
+                    changed.push_back(ChangedParam{modules[j].get(), slewed[j].param_.get(), slewed[j].param_->current()});
+                    sent[j] = true;
+                }
+            }
+            publishChangedParams(slewed[i].src_, *rack, changed);
+        }
+    }
+    return n;
+}
+
+bool KontrolModel::isSlewing() const {
+    return Module::slewingModules() > 0 || Rack::heldMidi() > 0;
+}
+
+
 // listener model
 void KontrolModel::clearCallbacks() {
-    for (const auto &p : listeners_) {
+    auto listeners = listeners_.get();
+    listeners_.set(ListenerMap());
+    for (const auto &p : *listeners) {
         (p.second)->stop();
     }
-
-    listeners_.clear();
 }
 
 void KontrolModel::removeCallback(const std::string &id) {
-    auto p = listeners_.find(id);
-    if (p != listeners_.end()) {
-        (p->second)->stop();
-        listeners_.erase(id);
-    }
+    std::shared_ptr<KontrolCallback> listener;
+    listeners_.update([&](ListenerMap &l) {
+        auto p = l.find(id);
+        if (p != l.end()) {
+            listener = p->second;
+            l.erase(p);
+        }
+    });
+    if (listener) listener->stop();
 }
 
 void KontrolModel::removeCallback(std::shared_ptr<KontrolCallback>) {
@@ -166,9 +313,18 @@ void KontrolModel::removeCallback(std::shared_ptr<KontrolCallback>) {
 }
 
 void KontrolModel::addCallback(const std::string &id, const std::shared_ptr<KontrolCallback> &listener) {
-    auto p = listeners_[id];
-    if (p != nullptr) p->stop();
-    listeners_[id] = listener;
+    std::shared_ptr<KontrolCallback> existing;
+    listeners_.update([&](ListenerMap &l) {
+        existing = l[id];
+        l[id] = listener;
+    });
+    if (existing != nullptr) existing->stop();
+}
+
+void KontrolModel::addDeferredCallback(const std::string &id, const std::shared_ptr<KontrolCallback> &listener) {
+    auto deferred = std::make_shared<DeferredCallback>(listener);
+    deferred->start();
+    addCallback(id, deferred);
 }
 
 std::shared_ptr<Rack> KontrolModel::createRack(
@@ -178,7 +334,17 @@ std::shared_ptr<Rack> KontrolModel::createRack(
         unsigned port) {
     std::string desc = host;
     auto rack = std::make_shared<Rack>(host, port, desc);
-    racks_[rack->id()] = rack;
+    racks_.update([&](RackTable &t) {
+        auto existing = t.racks_.find(rack->id());
+        if (existing != t.racks_.end()) {
+            // replaced, so old handles must not resolve to it
+            for (auto &ir : t.index_) {
+                if (ir == existing->second) ir = nullptr;
+            }
+        }
+        t.racks_[rack->id()] = rack;
+        t.index_.push_back(rack);
+    });
 
     publishRack(src, *rack);
     return rack;
@@ -234,32 +400,67 @@ std::shared_ptr<Parameter> KontrolModel::createParam(
 
     auto param = module->createParam(args);
     if (param != nullptr) {
+        rack->invalidateDispatch();
         publishParam(src, *rack, *module, *param);
     }
     return param;
 }
 
+unsigned KontrolModel::createParams(
+        ChangeSource src,
+        const EntityId &rackId,
+        const EntityId &moduleId,
+        const std::vector<std::vector<ParamValue>> &args
+) const {
+    auto rack = getRack(rackId);
+    auto module = getModule(rack, moduleId);
+    if (module == nullptr) return 0;
+
+    auto params = module->createParams(args);
+    if (!params.empty()) rack->invalidateDispatch();
+    for (const auto &param : params) {
+        publishParam(src, *rack, *module, *param);
+    }
+    return (unsigned) params.size();
+}
+
 
 void KontrolModel::deleteRack(ChangeSource src, const EntityId &rackId)
 {
-    if (localRack_ && localRack_->id() == rackId)
-        localRack_ = nullptr;
+    if (!isOwnerThread()) {
+        post([=]() { deleteRack(src, rackId); });
+        return;
+    }
+    auto local = localRack();
+    if (local && local->id() == rackId)
+        localRack_.store(nullptr);
     auto rack = getRack(rackId);
     if (rack)
     {
-        for (const auto &i : listeners_) {
+        auto listeners = listeners_.get();
+        for (const auto &i : *listeners) {
             (i.second)->deleteRack(src, *rack);
         }
     }
-    racks_.erase(rackId);
+    racks_.update([&](RackTable &t) {
+        for (auto &ir : t.index_) {
+            if (ir == rack) ir = nullptr;
+        }
+        t.racks_.erase(rackId);
+    });
 }
 
 
 void KontrolModel::activeModule(ChangeSource src, const EntityId &rackId ,const EntityId &moduleId) {
+    if (!isOwnerThread()) {
+        post([=]() { activeModule(src, rackId, moduleId); });
+        return;
+    }
     auto rack = getRack(rackId);
     auto module = getModule(rack, moduleId);
     if (module != nullptr) {
-        for (const auto &i : listeners_) {
+        auto listeners = listeners_.get();
+        for (const auto &i : *listeners) {
             (i.second)->activeModule(src, *rack, *module);
         }
     }
@@ -270,10 +471,15 @@ void KontrolModel::createResource(ChangeSource src,
                                   const EntityId &rackId,
                                   const std::string &resType,
                                   const std::string &resValue) const {
+    if (!isOwnerThread()) {
+        post([=]() { createResource(src, rackId, resType, resValue); });
+        return;
+    }
     auto rack = getRack(rackId);
     if (rack == nullptr) return;
     rack->addResource(resType, resValue);
-    for (const auto &i : listeners_) {
+    auto listeners = listeners_.get();
+    for (const auto &i : *listeners) {
         (i.second)->resource(src, *rack, resType, resValue);
     }
 }
@@ -290,14 +496,155 @@ std::shared_ptr<Parameter> KontrolModel::changeParam(
     auto param = getParam(module, paramId);
     if (param == nullptr) return nullptr;
 
+    if (!isOwnerThread()) {
+        // applied by the owner, the returned param does not have the new value yet
+        postChange(src, getParamHandle(*rack, *module, *param), v, false);
+        notifyOwner();
+        return param;
+    }
+
+    // smoothed changes are applied by processSlew
+    if (module->slewTime(param->type()) > 0.0f && module->slewParam(paramId, v, src)) return param;
+
     if (module->changeParam(paramId, v, src == CS_PRESET)) {
         publishChanged(src, *rack, *module, *param);
     }
     return param;
 }
 
+unsigned KontrolModel::changeParams(ChangeSource src, const EntityId &rackId,
+                                    const std::vector<ParamChange> &changes) const {
+    auto rack = getRack(rackId);
+    if (rack == nullptr || changes.empty()) return 0;
+
+    if (!isOwnerThread()) {
+        // resolved here, so only handles and values are queued
+        for (const auto &c : changes) {
+            ParamHandle h = getParamHandle(rackId, c.moduleId_, c.paramId_);
+            if (h.valid()) postChange(src, h, c.value_, true);
+        }
+        notifyOwner();
+        return 0;
+    }
+
+    // modules are kept alive here, so the notification can use raw pointers
+    std::vector<std::shared_ptr<Module>> modules;
+    std::vector<ChangedParam> changed;
+    changed.reserve(changes.size());
+    std::shared_ptr<Module> module;
+    for (const auto &c : changes) {
+        if (module == nullptr || module->id() != c.moduleId_) {
+            module = getModule(rack, c.moduleId_);
+            if (module == nullptr) continue;
+            modules.push_back(module);
+        }
+        auto param = getParam(module, c.paramId_);
+        if (param == nullptr) continue;
+        if (module->changeParam(c.paramId_, c.value_, src == CS_PRESET)) {
+            changed.push_back(ChangedParam{module.get(), param.get(), param->current()});
+        }
+    }
+
+    if (!changed.empty()) publishChangedParams(src, *rack, changed);
+    return (unsigned) changed.size();
+}
+
+ParamHandle KontrolModel::getParamHandle(const EntityId &rackId,
+                                         const EntityId &moduleId,
+                                         const EntityId &paramId) const {
+    ParamHandle h = ParamHandle::invalid();
+    auto rack = getRack(rackId);
+    if (rack == nullptr) return h;
+    auto t = racks_.get();
+    for (unsigned i = 0; i < t->index_.size() && i < ParamHandle::INVALID_IDX; i++) {
+        if (t->index_[i] == rack) {
+            h.rack_ = static_cast<uint16_t>(i);
+            break;
+        }
+    }
+    if (h.rack_ == ParamHandle::INVALID_IDX) return h;
+
+    unsigned midx = rack->moduleIndex(moduleId);
+    auto module = rack->moduleAt(midx);
+    if (module == nullptr || midx >= ParamHandle::INVALID_IDX) return ParamHandle::invalid();
+    unsigned pidx = module->paramIndex(paramId);
+    if (pidx >= ParamHandle::INVALID_IDX) return ParamHandle::invalid();
+
+    h.module_ = static_cast<uint16_t>(midx);
+    h.param_ = static_cast<uint16_t>(pidx);
+    h.generation_ = module->generation();
+    return h;
+}
+
+ParamHandle KontrolModel::getParamHandle(const Rack &rack, const Module &module, const Parameter &param) const {
+    ParamHandle h = ParamHandle::invalid();
+    auto t = racks_.get();
+    for (unsigned i = 0; i < t->index_.size() && i < ParamHandle::INVALID_IDX; i++) {
+        if (t->index_[i].get() == &rack) {
+            h.rack_ = static_cast<uint16_t>(i);
+            break;
+        }
+    }
+    if (h.rack_ == ParamHandle::INVALID_IDX) return h;
+
+    unsigned midx = rack.moduleIndex(&module);
+    unsigned pidx = module.paramIndex(&param);
+    if (midx >= ParamHandle::INVALID_IDX || pidx >= ParamHandle::INVALID_IDX) return ParamHandle::invalid();
+
+    h.module_ = static_cast<uint16_t>(midx);
+    h.param_ = static_cast<uint16_t>(pidx);
+    h.generation_ = module.generation();
+    return h;
+}
+
+std::shared_ptr<Parameter> KontrolModel::getParam(const ParamHandle &h) const {
+    std::shared_ptr<Rack> rack;
+    std::shared_ptr<Module> module;
+    return getParam(h, rack, module);
+}
+
+std::shared_ptr<Parameter> KontrolModel::getParam(const ParamHandle &h,
+                                                  std::shared_ptr<Rack> &rack, std::shared_ptr<Module> &module) const {
+    auto t = racks_.get();
+    if (h.rack_ >= t->index_.size()) return nullptr;
+    rack = t->index_[h.rack_];
+    if (rack == nullptr) return nullptr;
+    module = rack->moduleAt(h.module_);
+    if (module == nullptr || module->generation() != h.generation_) return nullptr;
+    return module->paramAt(h.param_);
+}
+
+std::shared_ptr<Parameter> KontrolModel::changeParam(ChangeSource src, const ParamHandle &h, ParamValue v) const {
+    auto t = racks_.get();
+    if (h.rack_ >= t->index_.size()) return nullptr;
+    const auto &rack = t->index_[h.rack_];
+    if (rack == nullptr) return nullptr;
+    auto module = rack->moduleAt(h.module_);
+    if (module == nullptr || module->generation() != h.generation_) return nullptr;
+    auto param = module->paramAt(h.param_);
+    if (param == nullptr) return nullptr;
+
+    if (!isOwnerThread()) {
+        // applied by the owner, the returned param does not have the new value yet
+        postChange(src, h, v, false);
+        notifyOwner();
+        return param;
+    }
+
+    if (module->slewTime(param->type()) > 0.0f && module->slewParam(h.param_, v, src)) return param;
+
+    if (module->changeParam(h.param_, v, src == CS_PRESET)) {
+        publishChanged(src, *rack, *module, *param);
+    }
+    return param;
+}
+
 void KontrolModel::assignMidiCC(ChangeSource src, const EntityId &rackId, const EntityId &moduleId,
                                 const EntityId &paramId, unsigned midiCC) {
+    if (!isOwnerThread()) {
+        post([=]() { assignMidiCC(src, rackId, moduleId, paramId, midiCC); });
+        return;
+    }
     if (src.type()==ChangeSource::REMOTE  && localRack() && rackId == localRack()->id()) {
         localRack()->addMidiCCMapping(midiCC, moduleId, paramId);
     }
@@ -307,19 +654,23 @@ void KontrolModel::assignMidiCC(ChangeSource src, const EntityId &rackId, const
     auto param = getParam(module, paramId);
     if (param == nullptr) return;
 
-    for (const auto &i : listeners_) {
+    auto listeners = listeners_.get();
+
+    for (const auto &i : *listeners) {
         (i.second)->assignMidiCC(src, *rack, *module, *param, midiCC);
     }
 }
 
 void KontrolModel::publishStart(ChangeSource src, unsigned numRacks) {
-    for (const auto &i : listeners_) {
+    auto listeners = listeners_.get();
+    for (const auto &i : *listeners) {
         (i.second)->publishStart(src, numRacks);
     }
 }
 
 void KontrolModel::publishRackFinished(ChangeSource src, const EntityId &rackId) {
-    for (const auto &i : listeners_) {
+    auto listeners = listeners_.get();
+    for (const auto &i : *listeners) {
         auto rack = getRack(rackId);
         if (rack == nullptr)
             return;
@@ -329,6 +680,10 @@ void KontrolModel::publishRackFinished(ChangeSource src, const EntityId &rackId)
 
 void KontrolModel::unassignMidiCC(ChangeSource src, const EntityId &rackId, const EntityId &moduleId,
                                   const EntityId &paramId, unsigned midiCC) {
+    if (!isOwnerThread()) {
+        post([=]() { unassignMidiCC(src, rackId, moduleId, paramId, midiCC); });
+        return;
+    }
     if (src.type()==ChangeSource::REMOTE  && localRack() && rackId == localRack()->id()) {
         localRack()->removeMidiCCMapping(midiCC, moduleId, paramId);
     }
@@ -337,7 +692,9 @@ void KontrolModel::unassignMidiCC(ChangeSource src, const EntityId &rackId, cons
     auto param = getParam(module, paramId);
     if (param == nullptr) return;
 
-    for (const auto &i : listeners_) {
+    auto listeners = listeners_.get();
+
+    for (const auto &i : *listeners) {
         (i.second)->unassignMidiCC(src, *rack, *module, *param, midiCC);
     }
 }
@@ -348,6 +705,10 @@ void KontrolModel::assignModulation(ChangeSource src,
                       const EntityId &moduleId,
                       const EntityId &paramId,
                       unsigned bus) {
+    if (!isOwnerThread()) {
+        post([=]() { assignModulation(src, rackId, moduleId, paramId, bus); });
+        return;
+    }
     if (src.type()==ChangeSource::REMOTE  && localRack() && rackId == localRack()->id()) {
         //TODO: when adding src dependent modulation, check to see what we should use for remote mod
         localRack()->addModulationMapping("mod", bus, moduleId, paramId);
@@ -358,7 +719,9 @@ void KontrolModel::assignModulation(ChangeSource src,
     auto param = getParam(module, paramId);
     if (param == nullptr) return;
 
-    for (const auto &i : listeners_) {
+    auto listeners = listeners_.get();
+
+    for (const auto &i : *listeners) {
         (i.second)->assignModulation(src, *rack, *module, *param, bus);
     }
 }
@@ -368,6 +731,10 @@ void KontrolModel::unassignModulation(ChangeSource src,
                         const EntityId &moduleId,
                         const EntityId &paramId,
                         unsigned bus) {
+    if (!isOwnerThread()) {
+        post([=]() { unassignModulation(src, rackId, moduleId, paramId, bus); });
+        return;
+    }
     if (src.type()==ChangeSource::REMOTE && localRack() && rackId == localRack()->id()) {
         //TODO: when adding src dependent modulation, check to see what we should use for remote mod
         localRack()->removeModulationMapping("mod", bus, moduleId, paramId);
@@ -378,7 +745,9 @@ void KontrolModel::unassignModulation(ChangeSource src,
     auto param = getParam(module, paramId);
     if (param == nullptr) return;
 
-    for (const auto &i : listeners_) {
+    auto listeners = listeners_.get();
+
+    for (const auto &i : *listeners) {
         (i.second)->unassignModulation(src, *rack, *module, *param, bus);
     }
 }
@@ -386,21 +755,52 @@ void KontrolModel::unassignModulation(ChangeSource src,
 
 
 void KontrolModel::savePreset(ChangeSource src, const EntityId &rackId, std::string preset) {
+    if (!isOwnerThread()) {
+        post([=]() { savePreset(src, rackId, preset); });
+        return;
+    }
     auto rack = getRack(rackId);
     if (rack == nullptr) return;
 
     if (src.type()==ChangeSource::REMOTE && localRack() && rackId == localRack()->id()) {
-        localRack()->savePreset(preset);
-    } else {
-        rack->currentPreset(preset);
+        // listeners are told by presetSaved, once written
+        localRack()->savePreset(preset, src);
+        return;
     }
+    rack->currentPreset(preset);
+
+    auto listeners = listeners_.get();
 
-    for (const auto &i : listeners_) {
+    for (const auto &i : *listeners) {
+        (i.second)->savePreset(src, *rack, preset);
+    }
+}
+
+void KontrolModel::presetSaved(ChangeSource src, const EntityId &rackId, std::string preset, bool success) {
+    if (!isOwnerThread()) {
+        post([=]() { presetSaved(src, rackId, preset, success); });
+        return;
+    }
+    auto rack = getRack(rackId);
+    if (rack == nullptr) return;
+
+    if (!success) {
+        LOG_0("KontrolModel::presetSaved failed to save preset " << preset << " for rack " << rackId);
+        return;
+    }
+
+    auto listeners = listeners_.get();
+
+    for (const auto &i : *listeners) {
         (i.second)->savePreset(src, *rack, preset);
     }
 }
 
 void KontrolModel::loadPreset(ChangeSource src, const EntityId &rackId, std::string preset) {
+    if (!isOwnerThread()) {
+        post([=]() { loadPreset(src, rackId, preset); });
+        return;
+    }
     auto rack = getRack(rackId);
     if (rack == nullptr) return;
     if (src.type()==ChangeSource::REMOTE  && localRack() && rackId == localRack()->id()) {
@@ -409,19 +809,26 @@ void KontrolModel::loadPreset(ChangeSource src, const EntityId &rackId, std::str
         rack->currentPreset(preset);
     }
 
-    for (const auto &i : listeners_) {
+    auto listeners = listeners_.get();
+
+    for (const auto &i : *listeners) {
         (i.second)->loadPreset(src, *rack, preset);
     }
 }
 
 void KontrolModel::saveSettings(ChangeSource src, const EntityId &rackId) {
+    if (!isOwnerThread()) {
+        post([=]() { saveSettings(src, rackId); });
+        return;
+    }
     if (src.type()==ChangeSource::REMOTE  && localRack() && rackId == localRack()->id()) {
         localRack()->saveSettings();
     }
 
     auto rack = getRack(rackId);
     if (rack == nullptr) return;
-    for (const auto &i : listeners_) {
+    auto listeners = listeners_.get();
+    for (const auto &i : *listeners) {
         (i.second)->saveSettings(src, *rack);
     }
 }
@@ -430,9 +837,19 @@ void KontrolModel::ping(
         ChangeSource src,
         const std::string &host,
         unsigned port,
-        unsigned keepAlive) const {
-    for (const auto &i : listeners_) {
-        (i.second)->ping(src, host, port, keepAlive);
+        unsigned keepAlive,
+        uint64_t version,
+        uint64_t lastSeen) const {
+    auto listeners = listeners_.get();
+    for (const auto &i : *listeners) {
+        (i.second)->ping(src, host, port, keepAlive, version, lastSeen);
+    }
+}
+
+void KontrolModel::published(ChangeSource src, uint64_t version) const {
+    auto listeners = listeners_.get();
+    for (const auto &i : *listeners) {
+        (i.second)->published(src, version);
     }
 }
 
@@ -441,40 +858,59 @@ void KontrolModel::loadModule(ChangeSource src,
                               const EntityId &rackId,
                               const EntityId &moduleId,
                               const std::string &moduleType) {
+    if (!isOwnerThread()) {
+        post([=]() { loadModule(src, rackId, moduleId, moduleType); });
+        return;
+    }
     auto rack = getRack(rackId);
     if (rack == nullptr) return;
 
-    for (const auto &i : listeners_) {
+    auto listeners = listeners_.get();
+
+    for (const auto &i : *listeners) {
         (i.second)->loadModule(src, *rack, moduleId, moduleType);
     }
 }
 void KontrolModel::midiLearn(ChangeSource src, bool b) {
-    for (const auto &i : listeners_) {
+    if (!isOwnerThread()) {
+        post([=]() { midiLearn(src, b); });
+        return;
+    }
+    auto listeners = listeners_.get();
+    for (const auto &i : *listeners) {
         (i.second)->midiLearn(src, b);
     }
 }
 
 void KontrolModel::modulationLearn(ChangeSource src, bool b) {
-    for (const auto &i : listeners_) {
+    if (!isOwnerThread()) {
+        post([=]() { modulationLearn(src, b); });
+        return;
+    }
+    auto listeners = listeners_.get();
+    for (const auto &i : *listeners) {
         (i.second)->modulationLearn(src, b);
     }
 }
 
 
 void KontrolModel::publishRack(ChangeSource src, const Rack &rack) const {
-    for (const auto &i : listeners_) {
+    auto listeners = listeners_.get();
+    for (const auto &i : *listeners) {
         (i.second)->rack(src, rack);
     }
 }
 
 void KontrolModel::publishModule(ChangeSource src, const Rack &rack, const Module &module) const {
-    for (const auto &i : listeners_) {
+    auto listeners = listeners_.get();
+    for (const auto &i : *listeners) {
         (i.second)->module(src, rack, module);
     }
 }
 
 void KontrolModel::publishPage(ChangeSource src, const Rack &rack, const Module &module, const Page &page) const {
-    for (const auto &i : listeners_) {
+    auto listeners = listeners_.get();
+    for (const auto &i : *listeners) {
         (i.second)->page(src, rack, module, page);
     }
 
@@ -482,7 +918,8 @@ void KontrolModel::publishPage(ChangeSource src, const Rack &rack, const Module
 
 void KontrolModel::publishParam(ChangeSource src, const Rack &rack, const Module &module,
                                 const Parameter &param) const {
-    for (const auto &i : listeners_) {
+    auto listeners = listeners_.get();
+    for (const auto &i : *listeners) {
         (i.second)->param(src, rack, module, param);
     }
 
@@ -490,26 +927,47 @@ void KontrolModel::publishParam(ChangeSource src, const Rack &rack, const Module
 
 void KontrolModel::publishChanged(ChangeSource src, const Rack &rack, const Module &module,
                                   const Parameter &param) const {
-    for (const auto &i : listeners_) {
+    auto listeners = listeners_.get();
+    for (const auto &i : *listeners) {
         (i.second)->changed(src, rack, module, param);
     }
 }
 
 
+void KontrolModel::publishChangedParams(ChangeSource src, const Rack &rack,
+                                        const std::vector<ChangedParam> &params) const {
+    auto listeners = listeners_.get();
+    for (const auto &i : *listeners) {
+        (i.second)->changedParams(src, rack, params);
+    }
+}
+
+
 void KontrolModel::publishResource(ChangeSource src, const Rack &rack,
                                    const std::string &type, const std::string &res) const {
-    for (const auto &i : listeners_) {
+    auto listeners = listeners_.get();
+    for (const auto &i : *listeners) {
         (i.second)->resource(src, rack, type, res);
     }
 }
 
+void KontrolModel::publishResources(ChangeSource src, const Rack &rack,
+                                    const std::string &type, const std::vector<std::string> &res) const {
+    if (res.empty()) return;
+    auto listeners = listeners_.get();
+    for (const auto &i : *listeners) {
+        (i.second)->resources(src, rack, type, res);
+    }
+}
+
 void KontrolModel::publishMidiMapping(ChangeSource src, const Rack &rack, const Module &module,
                                       const MidiMap &midiMap) const {
     for (const auto &k : midiMap) {
         for (const auto &j : k.second) {
             auto parameter = module.getParam(j);
             if (parameter) {
-                for (const auto &i : listeners_) {
+                auto listeners = listeners_.get();
+                for (const auto &i : *listeners) {
                     (i.second)->assignMidiCC(src, rack, module, *parameter, k.first);
                 }
             }
@@ -522,8 +980,9 @@ bool KontrolModel::loadModuleDefinitions(const EntityId &rackId, const EntityId
     std::string file;
     if(filename.at(0)=='/') file = filename;
     else file=localRack()->mainDir() + "/" + filename;
-    mec::Preferences prefs(file);
-    return loadModuleDefinitions(rackId, moduleId, prefs);
+    auto prefs = moduleCatalogue_.definitions(file);
+    if (prefs == nullptr) return false;
+    return loadModuleDefinitions(rackId, moduleId, *prefs);
 }
 
 bool KontrolModel::loadModuleDefinitions(const EntityId &rackId, const EntityId &moduleId,
@@ -3,11 +3,18 @@
 #include <unordered_map>
 #include <string>
 #include <memory>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <concurrentqueue.h>
 
 #include "Entity.h"
 #include "Rack.h"
 #include "Module.h"
 #include "Parameter.h"
+#include "Snapshot.h"
+#include "ModuleCatalogue.h"
 
 namespace Kontrol {
 
@@ -24,14 +31,25 @@ public:
     virtual void page(ChangeSource, const Rack &, const Module &, const Page &) = 0;
     virtual void param(ChangeSource, const Rack &, const Module &, const Parameter &) = 0;
     virtual void changed(ChangeSource, const Rack &, const Module &, const Parameter &) = 0;
+    // params changed together (e.g. preset load), so can be handled as a whole, default notifies each
+    virtual void changedParams(ChangeSource src, const Rack &rack, const std::vector<ChangedParam> &params) {
+        for (const auto &c : params) changed(src, rack, *c.module_, *c.param_);
+    }
     virtual void resource(ChangeSource, const Rack &, const std::string &, const std::string &) = 0;
+    // resources of a type published together (e.g. rack metadata), default notifies each
+    virtual void resources(ChangeSource src, const Rack &rack, const std::string &resType,
+                           const std::vector<std::string> &res) {
+        for (const auto &r : res) resource(src, rack, resType, r);
+    }
 
     virtual void deleteRack(ChangeSource, const Rack &) = 0;
 
     virtual void activeModule(ChangeSource, const Rack &, const Module &) { ; }
     virtual void loadModule(ChangeSource, const Rack &, const EntityId &, const std::string &) { ; }
 
-    virtual void ping(ChangeSource src, const std::string &host, unsigned port, unsigned keepAlive) { ; }
+    // version is the pinging peers model version, lastSeen the version of ours it last applied, see published
+    virtual void ping(ChangeSource src, const std::string &host, unsigned port, unsigned keepAlive,
+                      uint64_t /*version*/, uint64_t /*lastSeen*/) { ; }
 
     virtual void assignMidiCC(ChangeSource, const Rack &, const Module &, const Parameter &, unsigned midiCC) { ; }
     virtual void unassignMidiCC(ChangeSource, const Rack &, const Module &, const Parameter &, unsigned midiCC) { ; }
@@ -45,6 +63,9 @@ public:
     // Sent after completing each rack. The client should expect to receive the number of racks provided via the publishStart message.
     virtual void publishRackFinished(ChangeSource, const Rack &) { ; }
 
+    // a publish from src was received completely, so its racks are current up to version
+    virtual void published(ChangeSource, uint64_t /*version*/) { ; }
+
     virtual void savePreset(ChangeSource, const Rack &, std::string preset) { ; }
 
     virtual void loadPreset(ChangeSource, const Rack &, std::string preset) { ; }
@@ -66,11 +87,32 @@ public:
 
     void publishMetaData() const;
 
+    // single writer, once an owner thread is set, mutations made on other threads are queued
+    // and applied when the owner calls processCommands. reads are safe from any thread,
+    // racks, modules and params are immutable snapshots, replaced when the structure changes.
+    // param changes are queued as handle and value, so do not allocate, other mutations as a Command
+    typedef std::function<void()> Command;
+    void ownerThread(std::thread::id id);
+    bool isOwnerThread() const;
+    void post(Command cmd) const;
+    unsigned processCommands();
+    // called on the posting thread after a command is queued, so an idle owner can be woken
+    void commandNotify(Command notify);
+    // advance smoothed params (see Module::slewParam), called by the owner at control rate,
+    // listeners get one changedParams per rack each call.
+    // also sends 14 bit midi msbs whose lsb is overdue, see Rack::changeMidiCC
+    unsigned processSlew();
+    // true if any params are being smoothed or msbs held, so processSlew is due
+    bool isSlewing() const;
+
     // observer functionality
     void clearCallbacks();
     void removeCallback(const std::string &id);
     void removeCallback(std::shared_ptr<KontrolCallback>);
     void addCallback(const std::string &id, const std::shared_ptr<KontrolCallback> &listener);
+    // listener is called on its own thread, so slow listeners (e.g. displays) do not stall the changing thread,
+    // realtime listeners should use addCallback. see DeferredCallback
+    void addDeferredCallback(const std::string &id, const std::shared_ptr<KontrolCallback> &listener);
 
     // access
     std::shared_ptr<Rack> getLocalRack() const;
@@ -108,6 +150,14 @@ public:
             const std::vector<ParamValue> &args
     ) const;
 
+    // params of a module created together, returns number created
+    unsigned createParams(
+            ChangeSource src,
+            const EntityId &rackId,
+            const EntityId &moduleId,
+            const std::vector<std::vector<ParamValue>> &args
+    ) const;
+
     std::shared_ptr<Page> createPage(
             ChangeSource src,
             const EntityId &rackId,
@@ -124,6 +174,21 @@ public:
             const EntityId &paramId,
             ParamValue v) const;
 
+    // applies all values, then notifies listeners once with the params that changed
+    // returns number of params changed (0 if queued for the owner thread)
+    unsigned changeParams(ChangeSource src, const EntityId &rackId, const std::vector<ParamChange> &changes) const;
+
+    // handle based access, for hot paths, resolve once then cache the handle
+    // returns an invalid handle (or nullptr) if not found or stale
+    ParamHandle getParamHandle(const EntityId &rackId, const EntityId &moduleId, const EntityId &paramId) const;
+    // by identity, without comparing ids or allocating, e.g. from a listener
+    ParamHandle getParamHandle(const Rack &rack, const Module &module, const Parameter &param) const;
+    std::shared_ptr<Parameter> getParam(const ParamHandle &handle) const;
+    // also resolving the rack and module, e.g. to notify from a handle
+    std::shared_ptr<Parameter> getParam(const ParamHandle &handle,
+                                        std::shared_ptr<Rack> &rack, std::shared_ptr<Module> &module) const;
+    std::shared_ptr<Parameter> changeParam(ChangeSource src, const ParamHandle &handle, ParamValue v) const;
+
     void createResource(ChangeSource src,
                         const EntityId &rackId,
                         const std::string &resType,
@@ -134,7 +199,9 @@ public:
 
     void activeModule(ChangeSource src, const EntityId &rackId ,const EntityId &moduleId);
 
-    void ping(ChangeSource src, const std::string &host, unsigned port, unsigned keepAlive) const;
+    void ping(ChangeSource src, const std::string &host, unsigned port, unsigned keepAlive,
+              uint64_t version = 0, uint64_t lastSeen = 0) const;
+    void published(ChangeSource src, uint64_t version) const;
 
     void assignMidiCC(ChangeSource src,
                       const EntityId &rackId,
@@ -164,6 +231,11 @@ public:
     void savePreset(ChangeSource src,
                     const EntityId &rackId,
                     std::string preset);
+    // called by the owner once a local rack preset save has been written (or failed)
+    void presetSaved(ChangeSource src,
+                     const EntityId &rackId,
+                     std::string preset,
+                     bool success);
     void loadPreset(ChangeSource src,
                     const EntityId &rackId,
                     std::string preset);
@@ -180,31 +252,68 @@ public:
 
     std::shared_ptr<Rack> createLocalRack(unsigned port);
 
-    EntityId localRackId() { if (localRack_) return localRack_->id(); else return ""; }
+    EntityId localRackId() { auto rack = getLocalRack(); if (rack) return rack->id(); else return ""; }
 
-    std::shared_ptr<Rack> localRack() { return localRack_; }
+    std::shared_ptr<Rack> localRack() { return getLocalRack(); }
 
     void publishRack(ChangeSource, const Rack &) const;
     void publishModule(ChangeSource, const Rack &, const Module &) const;
     void publishPage(ChangeSource src, const Rack &, const Module &, const Page &) const;
     void publishParam(ChangeSource src, const Rack &, const Module &, const Parameter &) const;
     void publishChanged(ChangeSource src, const Rack &, const Module &, const Parameter &) const;
+    void publishChangedParams(ChangeSource src, const Rack &, const std::vector<ChangedParam> &) const;
     void publishResource(ChangeSource src, const Rack &, const std::string &, const std::string &) const;
+    void publishResources(ChangeSource src, const Rack &, const std::string &, const std::vector<std::string> &) const;
     void publishMidiMapping(ChangeSource src, const Rack &, const Module &, const MidiMap &midiMap) const;
 
     bool loadSettings(const EntityId &rackId, const std::string &filename);
     bool loadModuleDefinitions(const EntityId &rackId, const EntityId &moduleId, const std::string &filename);
     bool loadModuleDefinitions(const EntityId &rackId, const EntityId &moduleId, const mec::Preferences &prefs);
 
+    // available module types and their cached definitions, used by loadModuleDefinitions
+    ModuleCatalogue &moduleCatalogue() { return moduleCatalogue_; }
+
 private:
     void publishMetaData(const std::shared_ptr<Rack> &rack) const;
     void publishMetaData(const std::shared_ptr<Rack> &rack, const std::shared_ptr<Module> &module) const;
     void publishPreset(const std::shared_ptr<Rack> &rack) const;
 
     KontrolModel();
-    std::shared_ptr<Rack> localRack_;
-    std::unordered_map<EntityId, std::shared_ptr<Rack>> racks_;
-    std::unordered_map<std::string, std::shared_ptr<KontrolCallback> > listeners_; // key = source : host:ip
+
+    struct RackTable {
+        std::unordered_map<EntityId, std::shared_ptr<Rack>> racks_;
+        std::vector<std::shared_ptr<Rack>> index_; // slots are not reused, deleted racks are null
+    };
+
+    typedef std::unordered_map<std::string, std::shared_ptr<KontrolCallback> > ListenerMap; // key = source : host:ip
+
+    // a queued mutation, param changes are held inline, anything else as a Command
+    struct QueuedCommand {
+        QueuedCommand() : src_(CS_LOCAL), handle_(ParamHandle::invalid()), batch_(false) { ; }
+        ChangeSource src_;
+        ParamHandle handle_;
+        ParamValue value_;
+        bool batch_; // from changeParams, consecutive changes to a rack are applied and notified together
+        std::unique_ptr<Command> cmd_;
+    };
+    static const size_t COMMAND_QUEUE_SIZE = 1024;
+    static const size_t COMMAND_BULK_SIZE = 64;
+
+    void queue(QueuedCommand &&cmd) const;
+    void notifyOwner() const;
+    void postChange(ChangeSource src, const ParamHandle &handle, const ParamValue &v, bool batch) const;
+    unsigned applyChanges(const QueuedCommand *begin, const QueuedCommand *end);
+
+    AtomicShared<Rack> localRack_;
+    Snapshot<RackTable> racks_;
+    Snapshot<ListenerMap> listeners_;
+    std::atomic<std::thread::id> ownerThread_;
+    mutable moodycamel::ConcurrentQueue<QueuedCommand> commands_;
+    std::vector<QueuedCommand> dequeued_; // owner only, reused by processCommands
+    std::vector<ChangedParam> applied_;   // owner only, reused by applyChanges
+    AtomicShared<const Command> commandNotify_;
+    ModuleCatalogue moduleCatalogue_;
+    std::chrono::steady_clock::time_point lastSlew_;
 };
 
 } //namespace
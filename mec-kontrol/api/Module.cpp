@@ -1,6 +1,7 @@
 #include "Module.h"
 
 #include  "KontrolModel.h"
+#include <algorithm>
 #include <iostream>
 #include <map>
 #include <fstream>
@@ -12,6 +13,12 @@
 
 namespace Kontrol {
 
+std::atomic<unsigned> Module::slewingModules_(0);
+
+Module::~Module() {
+    if (slew_.active()) slewingModules_--;
+}
+
 
 #if 0
 
@@ -26,25 +33,158 @@ std::string Module::getParamId(const EntityId& pageId, unsigned paramNum) {
 
 
 // Module
+void Module::addParam(ParamTable &t, const std::shared_ptr<Parameter> &p) {
+    auto existing = t.parameters_.find(p->id());
+    if (existing != t.parameters_.end() && existing->second != nullptr) {
+        // redefined, keep its index
+        for (auto &ip : t.paramIndex_) {
+            if (ip == existing->second) {
+                ip = p;
+                break;
+            }
+        }
+    } else {
+        t.paramIndex_.push_back(p);
+    }
+    t.parameters_[p->id()] = p;
+}
+
+void Module::addPage(ParamTable &t, const std::shared_ptr<Page> &p) {
+    if (t.pages_.find(p->id()) == t.pages_.end()) {
+        t.pageIds_.push_back(p->id());
+    }
+    t.pages_[p->id()] = p;
+}
+
 std::shared_ptr<Parameter> Module::createParam(const std::vector<ParamValue> &args) {
     auto p = Parameter::create(args);
     if (p->valid()) {
-        parameters_[p->id()] = p;
+        table_.update([&](ParamTable &t) { addParam(t, p); });
+        touch();
         return p;
     }
     return nullptr;
 }
 
+// the table is copied on each update, so adding params one at a time would be quadratic
+std::vector<std::shared_ptr<Parameter>> Module::createParams(const std::vector<std::vector<ParamValue>> &args) {
+    std::vector<std::shared_ptr<Parameter>> created;
+    created.reserve(args.size());
+    for (const auto &a : args) {
+        auto p = Parameter::create(a);
+        if (p->valid()) created.push_back(p);
+    }
+    if (!created.empty()) {
+        table_.update([&](ParamTable &t) {
+            t.paramIndex_.reserve(t.paramIndex_.size() + created.size());
+            for (const auto &p : created) addParam(t, p);
+        });
+        touch();
+    }
+    return created;
+}
+
 bool Module::changeParam(const EntityId &paramId, const ParamValue &value, bool force) {
-    auto p = parameters_[paramId];
+    auto p = getParam(paramId);
     if (p != nullptr) {
+        // a direct change overrides smoothing
+        if (slew_.active()) {
+            slew_.cancel(paramIndex(paramId));
+            slewChanged(true);
+        }
         if (p->change(value, force)) {
+            p->touch();
             return true;
         }
     }
     return false;
 }
 
+unsigned Module::paramIndex(const EntityId &paramId) const {
+    auto t = table_.get();
+    for (unsigned i = 0; i < t->paramIndex_.size(); i++) {
+        if (t->paramIndex_[i]->id() == paramId) return i;
+    }
+    return ParamHandle::INVALID_IDX;
+}
+
+unsigned Module::paramIndex(const Parameter *param) const {
+    auto t = table_.get();
+    for (unsigned i = 0; i < t->paramIndex_.size(); i++) {
+        if (t->paramIndex_[i].get() == param) return i;
+    }
+    return ParamHandle::INVALID_IDX;
+}
+
+std::shared_ptr<Parameter> Module::paramAt(unsigned idx) const {
+    auto t = table_.get();
+    return idx < t->paramIndex_.size() ? t->paramIndex_[idx] : nullptr;
+}
+
+bool Module::changeParam(unsigned idx, const ParamValue &value, bool force) {
+    auto p = paramAt(idx);
+    if (p == nullptr) return false;
+    if (slew_.active()) {
+        slew_.cancel(idx);
+        slewChanged(true);
+    }
+    if (p->change(value, force)) {
+        p->touch();
+        return true;
+    }
+    return false;
+}
+
+bool Module::slewParam(const EntityId &paramId, const ParamValue &value, ChangeSource src) {
+    auto p = getParam(paramId);
+    if (p == nullptr || !slew_.isSmoothed(p->type())) return false;
+    return slewParam(paramIndex(paramId), value, src);
+}
+
+bool Module::slewParam(unsigned idx, const ParamValue &value, ChangeSource src) {
+    switch (src.type()) {
+        case ChangeSource::MIDI:
+        case ChangeSource::MODULATION:
+        case ChangeSource::REMOTE:
+            break;
+        default:
+            return false;
+    }
+    auto p = paramAt(idx);
+    if (p == nullptr || !slew_.isSmoothed(p->type())) return false;
+    if (value.type() != ParamValue::T_Float || p->current().type() != ParamValue::T_Float) return false;
+    float current = p->currentFloat();
+    if (current == PV_INITVALUE) return false;
+
+    float target = std::min(std::max(value.floatValue(), p->calcMinimum().floatValue()),
+                            p->calcMaximum().floatValue());
+    bool wasActive = slew_.active();
+    slew_.target(idx, p->type(), current, target, src);
+    slewChanged(wasActive);
+    return true;
+}
+
+void Module::processSlew(float elapsedMs, std::vector<SlewChange> &changed) {
+    if (!slew_.active()) return;
+    auto t = table_.get();
+    slew_.process(elapsedMs, [&](unsigned idx, float value, const ChangeSource &src) {
+        if (idx >= t->paramIndex_.size()) return;
+        const auto &p = t->paramIndex_[idx];
+        if (p->change(ParamValue(value), false)) {
+            p->touch();
+            changed.push_back(SlewChange{src, p});
+        }
+    });
+    slewChanged(true);
+}
+
+void Module::slewChanged(bool wasActive) {
+    bool active = slew_.active();
+    if (active == wasActive) return;
+    if (active) slewingModules_++;
+    else slewingModules_--;
+}
+
 inline std::shared_ptr<KontrolModel> Module::model() {
     return KontrolModel::model();
 }
@@ -55,70 +195,89 @@ std::shared_ptr<Page> Module::createPage(
         const std::vector<EntityId> paramIds
 ) {
     // std::cout << "Module::addPage " << id << std::endl;
-    auto page = pages_[pageId];
-    if (page == nullptr) {
-        pageIds_.push_back(pageId);
-    }
-
     auto p = std::make_shared<Page>(pageId, displayName, paramIds);
-    pages_[pageId] = p;
+    table_.update([&](ParamTable &t) { addPage(t, p); });
+    touch();
     return p;
 }
 
 // access functions
 std::shared_ptr<Page> Module::getPage(const EntityId &pageId) {
-    return pages_[pageId];
+    auto t = table_.get();
+    auto page = t->pages_.find(pageId);
+    return page != t->pages_.end() ? page->second : nullptr;
 }
 
 std::shared_ptr<Parameter> Module::getParam(const EntityId &paramId) {
-    return parameters_[paramId];
+    return static_cast<const Module *>(this)->getParam(paramId);
 }
 
 std::shared_ptr<Parameter> Module::getParam(const EntityId & paramId) const
 {
-    auto parameter = parameters_.find(paramId);
-    return parameter != parameters_.end() ? parameter->second : nullptr;
+    auto t = table_.get();
+    auto parameter = t->parameters_.find(paramId);
+    return parameter != t->parameters_.end() ? parameter->second : nullptr;
 }
 
 std::vector<std::shared_ptr<Page>> Module::getPages() {
+    auto t = table_.get();
     std::vector<std::shared_ptr<Page>> ret;
-    for (const auto &p : pageIds_) {
-        auto page = pages_[p];
-        if (page != nullptr) ret.push_back(page);
+    for (const auto &p : t->pageIds_) {
+        auto page = t->pages_.find(p);
+        if (page != t->pages_.end() && page->second != nullptr) ret.push_back(page->second);
     }
     return ret;
 }
 
 std::vector<std::shared_ptr<Parameter>> Module::getParams() {
+    auto t = table_.get();
     std::vector<std::shared_ptr<Parameter>> ret;
-    for (const auto &p : parameters_) {
+    for (const auto &p : t->parameters_) {
         if (p.second != nullptr) ret.push_back(p.second);
     }
     return ret;
 }
 
 std::vector<std::shared_ptr<Parameter>> Module::getParams(const std::shared_ptr<Page> &page) {
+    auto t = table_.get();
     std::vector<std::shared_ptr<Parameter>> ret;
     if (page != nullptr) {
         for (const auto &pid : page->paramIds()) {
-            auto param = parameters_[pid];
-            if (param != nullptr) ret.push_back(param);
+            auto param = t->parameters_.find(pid);
+            if (param != t->parameters_.end() && param->second != nullptr) ret.push_back(param->second);
         }
     }
     return ret;
 }
 
 
-bool Module::loadModuleDefinitions(const mec::Preferences &module) {
+bool Module::loadModuleDefinitions(const mec::Preferences &module, bool &layoutChanged) {
+    layoutChanged = false;
     if (!module.valid()) return false;
 
     displayName_ = module.getString("display");
-    parameters_.clear();
-    pages_.clear();
-    pageIds_.clear();
-    midi_mapping_.clear();
-    modulation_mapping_.clear();
+    midi_mapping_.set(MidiMap());
+    modulation_mapping_.set(ModulationMap());
+
+    // published once complete, so readers never see a partial definition
+    ParamTable t;
+    bool ret = loadParamTable(t, module);
+    auto old = table_.get();
+    layoutChanged = old->paramIndex_.size() != t.paramIndex_.size();
+    for (unsigned i = 0; !layoutChanged && i < t.paramIndex_.size(); i++) {
+        layoutChanged = old->paramIndex_[i]->id() != t.paramIndex_[i]->id();
+    }
+    table_.set(std::move(t));
+    // slews are held by param index, which may now be a different param
+    if (slew_.active()) {
+        slew_.clear();
+        slewChanged(true);
+    }
+    touch();
+    return ret;
+}
 
+bool Module::loadParamTable(ParamTable &t, const mec::Preferences &module) {
     if (module.exists("parameters")) {
         // load parameters
         mec::Preferences::Array params(module.getArray("parameters"));
@@ -149,7 +308,8 @@ bool Module::loadModuleDefinitions(const mec::Preferences &module) {
                         break;
                 }
             }
-            createParam(args);
+            auto p = Parameter::create(args);
+            if (p->valid()) addParam(t, p);
         }
     }
 
@@ -170,7 +330,7 @@ bool Module::loadModuleDefinitions(const mec::Preferences &module) {
             for (unsigned int j = 0; j < paramArray.getSize(); j++) {
                 paramIds.push_back(paramArray.getString(j));
             }
-            createPage(id, displayname, paramIds);
+            addPage(t, std::make_shared<Page>(id, displayname, paramIds));
         }
     }
 
@@ -183,8 +343,9 @@ void Module::dumpParameters() {
     // print by page , this will miss anything not on a page, but gives a clear way of setting things
     LOG_1("Parameter Dump : " << displayName_ << " : " << type_);
     LOG_1("----------------------");
-    for (const std::string &pageId : pageIds_) {
-        auto page = pages_[pageId];
+    auto t = table_.get();
+    for (const std::string &pageId : t->pageIds_) {
+        auto page = getPage(pageId);
         if (page == nullptr) {
             LOG_1("Page not found: " << pageId);
             continue;
@@ -192,7 +353,7 @@ void Module::dumpParameters() {
         LOG_1(page->id());
         LOG_1(page->displayName());
         for (const std::string &paramId : page->paramIds()) {
-            auto param = parameters_[paramId];
+            auto param = getParam(paramId);
             if (param == nullptr) {
                 LOG_1("Parameter not found:" << paramId);
                 continue;
@@ -222,8 +383,9 @@ void Module::dumpCurrentValues() {
     // print by page , this will miss anything not on a page, but gives a clear way of setting things
     LOG_1("Current Values Dump");
     LOG_1("-------------------");
-    for (const std::string &pageId : pageIds_) {
-        auto page = pages_[pageId];
+    auto t = table_.get();
+    for (const std::string &pageId : t->pageIds_) {
+        auto page = getPage(pageId);
         if (page == nullptr) {
             LOG_1("Page not found: " << pageId);
             continue;
@@ -231,7 +393,7 @@ void Module::dumpCurrentValues() {
         LOG_1(page->id());
         LOG_1(page->displayName());
         for (const auto &paramId : page->paramIds()) {
-            auto param = parameters_[paramId];
+            auto param = getParam(paramId);
             if (param == nullptr) {
                 LOG_1("Parameter not found:" << paramId);
                 continue;
@@ -255,57 +417,73 @@ void Module::dumpCurrentValues() {
 
 
 std::vector<EntityId> Module::getParamsForCC(unsigned cc) {
-    return midi_mapping_[cc];
+    auto m = midi_mapping_.get();
+    auto it = m->find(cc);
+    if (it == m->end()) return std::vector<EntityId>();
+    return it->second;
 }
 
-void Module::addMidiCCMapping(unsigned ccnum, const EntityId &paramId) {
-    auto v = midi_mapping_[ccnum];
+bool Module::hasMidiCCMapping(unsigned cc) const {
+    auto m = midi_mapping_.get();
+    auto it = m->find(cc);
+    return it != m->end() && !it->second.empty();
+}
+
+// mappings are copied on change, so are only (re)assigned, e.g. by midi learn or presets
+static bool addMapping(MidiMap &map, unsigned key, const EntityId &paramId) {
+    auto &v = map[key];
     for (auto &it : v) {
         if (it == paramId) {
-            return; // already preset
+            return false; // already preset
         }
     }
-    midi_mapping_[ccnum].push_back(paramId);
+    v.push_back(paramId);
+    return true;
 }
 
-void Module::removeMidiCCMapping(unsigned ccnum, const EntityId &paramId) {
-    auto v = midi_mapping_[ccnum];
+static bool removeMapping(MidiMap &map, unsigned key, const EntityId &paramId) {
+    auto &v = map[key];
     for (auto it = v.begin(); it != v.end(); it++) {
         if (*it == paramId) {
             v.erase(it);
-            midi_mapping_[ccnum] = v;
-            return;
+            return true;
         }
     }
+    return false;
 }
 
-std::vector<EntityId> Module::getParamsForModulation(unsigned bus) {
-    return modulation_mapping_[bus];
+void Module::addMidiCCMapping(unsigned ccnum, const EntityId &paramId) {
+    bool added = false;
+    midi_mapping_.update([&](MidiMap &m) { added = addMapping(m, ccnum, paramId); });
+    if (added) touch();
+}
 
+void Module::removeMidiCCMapping(unsigned ccnum, const EntityId &paramId) {
+    bool removed = false;
+    midi_mapping_.update([&](MidiMap &m) { removed = removeMapping(m, ccnum, paramId); });
+    if (removed) touch();
+}
+
+std::vector<EntityId> Module::getParamsForModulation(unsigned bus) {
+    auto m = modulation_mapping_.get();
+    auto it = m->find(bus);
+    if (it == m->end()) return std::vector<EntityId>();
+    return it->second;
 }
 
 void Module::addModulationMapping(const std::string &src, unsigned bus, const EntityId &paramId) {
     //TODO: modulation mapping will be unique to src, so that they can be combined
-    auto v = modulation_mapping_[bus];
-    for (auto &it : v) {
-        if (it == paramId) {
-            return; // already preset
-        }
-    }
-    modulation_mapping_[bus].push_back(paramId);
+    bool added = false;
+    modulation_mapping_.update([&](ModulationMap &m) { added = addMapping(m, bus, paramId); });
+    if (added) touch();
 }
 
 
 void Module::removeModulationMapping(const std::string &src, unsigned bus, const EntityId &paramId) {
     //TODO: modulation mapping will be unique to src, so that they can be combined
-    auto v = modulation_mapping_[bus];
-    for (auto it = v.begin(); it != v.end(); it++) {
-        if (*it == paramId) {
-            v.erase(it);
-            modulation_mapping_[bus] = v;
-            return;
-        }
-    }
+    bool removed = false;
+    modulation_mapping_.update([&](ModulationMap &m) { removed = removeMapping(m, bus, paramId); });
+    if (removed) touch();
 }
 
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <unordered_map>
 #include <string>
 #include <vector>
@@ -10,6 +11,8 @@
 #include "Parameter.h"
 #include "ChangeSource.h"
 #include "Rack.h"
+#include "ParamSlew.h"
+#include "Snapshot.h"
 
 namespace mec {
 class Preferences;
@@ -25,15 +28,45 @@ public:
     Module(const std::string &id,
            const std::string &displayName,
            const std::string &type)
-            : Entity(id, displayName), type_(type) {
+            : Entity(id, displayName), type_(type), generation_(0) {
         ;
     }
 
+    ~Module();
+
     static std::shared_ptr<KontrolModel> model();
 
     std::shared_ptr<Parameter> createParam(const std::vector<ParamValue> &args);
+    // several at once, with a single table update, e.g. as a remote module is published
+    std::vector<std::shared_ptr<Parameter>> createParams(const std::vector<std::vector<ParamValue>> &args);
     bool changeParam(const EntityId &paramId, const ParamValue &value, bool force);
 
+    // index based access, indexes are stable until definitions are loaded again with
+    // different param ids (the rack then sets a new generation, see ParamHandle)
+    unsigned paramIndex(const EntityId &paramId) const;
+    unsigned paramIndex(const Parameter *param) const;
+    std::shared_ptr<Parameter> paramAt(unsigned idx) const;
+    bool changeParam(unsigned idx, const ParamValue &value, bool force);
+    // set by the rack, when added or when its param indexes change
+    uint16_t generation() const { return generation_; }
+    void generation(uint16_t g) { generation_ = g; }
+
+    // smoothing of midi, modulation and remote changes, see ParamSlew. owner thread only
+    void slewTime(ParameterType type, float ms) { slew_.slewTime(type, ms); }
+    float slewTime(ParameterType type) const { return slew_.slewTime(type); }
+    // true if param will move to value over its slew time, rather than changing now
+    bool slewParam(const EntityId &paramId, const ParamValue &value, ChangeSource src);
+    bool slewParam(unsigned idx, const ParamValue &value, ChangeSource src);
+    bool isSlewing() const { return slew_.active(); }
+    // modules with params being smoothed, in all racks, so the owner can skip processSlew if none
+    static unsigned slewingModules() { return slewingModules_; }
+    struct SlewChange {
+        ChangeSource src_;
+        std::shared_ptr<Parameter> param_;
+    };
+    // advance smoothed params, changed params are appended
+    void processSlew(float elapsedMs, std::vector<SlewChange> &changed);
+
     std::shared_ptr<Page> createPage(
             const EntityId &pageId,
             const std::string &displayName,
@@ -56,31 +89,57 @@ public:
 
     std::string type() const { return type_; };
 
-    bool loadModuleDefinitions(const mec::Preferences &prefs);
+    // every param is replaced, layoutChanged is set if an index now has a different param id
+    bool loadModuleDefinitions(const mec::Preferences &prefs, bool &layoutChanged);
     void dumpParameters();
     void dumpCurrentValues();
 
     std::vector<EntityId> getParamsForCC(unsigned cc);
+    bool hasMidiCCMapping(unsigned cc) const;
     void addMidiCCMapping(unsigned ccnum, const EntityId &paramId);
     void removeMidiCCMapping(unsigned ccnum, const EntityId &paramId);
-    MidiMap getMidiMapping() { return midi_mapping_; }
-    void setMidiMapping(const MidiMap &map) { midi_mapping_ = map; }
+    MidiMap getMidiMapping() { return *midi_mapping_.get(); }
+    void setMidiMapping(const MidiMap &map) {
+        if (*midi_mapping_.get() == map) return;
+        midi_mapping_.set(map);
+        touch();
+    }
 
 
     std::vector<EntityId> getParamsForModulation(unsigned bus);
     void addModulationMapping(const std::string &src, unsigned bus, const EntityId &paramId);
     void removeModulationMapping(const std::string &src, unsigned bus, const EntityId &paramId);
-    MidiMap getModulationMapping() { return modulation_mapping_; }
-    void setModulationMapping(const ModulationMap &map) { modulation_mapping_ = map; }
+    MidiMap getModulationMapping() { return *modulation_mapping_.get(); }
+    void setModulationMapping(const ModulationMap &map) {
+        if (*modulation_mapping_.get() == map) return;
+        modulation_mapping_.set(map);
+        touch();
+    }
 
 private:
     std::string type_;
 
-    std::vector<std::string> pageIds_; // ordered list of page id, for presentation
-    std::unordered_map<std::string, std::shared_ptr<Parameter> > parameters_; // key = paramId
-    std::unordered_map<std::string, std::shared_ptr<Page> > pages_; // key = pageId
-    MidiMap midi_mapping_; // key CC id, value = paramId
-    ModulationMap modulation_mapping_; // key bus id, value = paramId
+    // structure, read from any thread, replaced when params/pages are defined
+    struct ParamTable {
+        std::vector<std::string> pageIds_; // ordered list of page id, for presentation
+        std::unordered_map<std::string, std::shared_ptr<Parameter> > parameters_; // key = paramId
+        std::vector<std::shared_ptr<Parameter>> paramIndex_; // in creation order
+        std::unordered_map<std::string, std::shared_ptr<Page> > pages_; // key = pageId
+    };
+
+    static void addParam(ParamTable &t, const std::shared_ptr<Parameter> &p);
+    static void addPage(ParamTable &t, const std::shared_ptr<Page> &p);
+    static bool loadParamTable(ParamTable &t, const mec::Preferences &prefs);
+    // call after slew_ is changed, keeps slewingModules_ in step
+    void slewChanged(bool wasActive);
+
+    Snapshot<ParamTable> table_;
+    std::atomic<uint16_t> generation_;
+    ParamSlew slew_;
+    static std::atomic<unsigned> slewingModules_;
+    // changed by the owner, read from any thread (e.g. publishing, saving presets)
+    Snapshot<MidiMap> midi_mapping_; // key CC id, value = paramId
+    Snapshot<ModulationMap> modulation_mapping_; // key bus id, value = paramId
 
 };
 
@@ -0,0 +1,183 @@
+#include "ModuleCatalogue.h"
+#include "FsIndex.h"
+
+#ifndef _WIN32
+
+#   include <dirent.h>
+
+#else
+#   include "dirent_win.h"
+#endif
+
+#include <sys/stat.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mec_log.h>
+
+namespace Kontrol {
+
+const char *ModuleCatalogue::MODULE_PATCH = "module.pd";
+const char *ModuleCatalogue::MODULE_DEFINITIONS = "module.json";
+
+ModuleCatalogue::ModuleCatalogue() :
+        hits_(0),
+        misses_(0),
+        running_(false) {
+}
+
+ModuleCatalogue::~ModuleCatalogue() {
+    stop();
+}
+
+void *module_catalogue_thread_func(void *pCatalogue) {
+    ModuleCatalogue *pThis = static_cast<ModuleCatalogue *>(pCatalogue);
+    pThis->backgroundRun();
+    return nullptr;
+}
+
+void ModuleCatalogue::start() {
+    std::lock_guard<std::mutex> lock(threadMutex_);
+    if (running_) return;
+    running_ = true;
+#ifdef __COBALT__
+    pthread_t ph = background_thread_.native_handle();
+    pthread_create(&ph, 0, module_catalogue_thread_func, this);
+#else
+    background_thread_ = std::thread(module_catalogue_thread_func, this);
+#endif
+}
+
+void ModuleCatalogue::stop() {
+    std::lock_guard<std::mutex> lock(threadMutex_);
+    if (running_) {
+        running_ = false;
+        if (background_thread_.joinable()) background_thread_.join();
+    }
+}
+
+void ModuleCatalogue::backgroundRun() {
+    Job job;
+    while (running_) {
+        if (!queue_.wait_dequeue_timed(job, (std::int64_t) POLL_TIMEOUT_MS * 1000)) continue;
+
+        std::string file = job.dir_ + "/" + MODULE_DEFINITIONS;
+        int64_t mtime = -1;
+        if (lookup(file, mtime) == nullptr && mtime >= 0) load(file, mtime);
+        if (job.warm_) warm(job.dir_);
+    }
+}
+
+std::vector<std::string> ModuleCatalogue::scan(const std::vector<std::string> &dirs) {
+    std::vector<std::string> found;
+    for (const auto &dir : dirs) {
+        std::vector<std::string> types = FsIndex::scan(FsIndex::K_MODULES, dir);
+        add(dir, types);
+        found.insert(found.end(), types.begin(), types.end());
+    }
+    return found;
+}
+
+void ModuleCatalogue::add(const std::string &dir, const std::vector<std::string> &types) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto &type : types) {
+            modules_[type] = dir;
+        }
+    }
+
+    for (const auto &type : types) {
+        enqueue(type, false);
+    }
+}
+
+std::string ModuleCatalogue::baseDir(const std::string &type) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = modules_.find(type);
+    return it != modules_.end() ? it->second : std::string();
+}
+
+std::shared_ptr<const mec::Preferences> ModuleCatalogue::definitions(const std::string &file) {
+    int64_t mtime = -1;
+    auto prefs = lookup(file, mtime);
+    if (prefs != nullptr) {
+        hits_++;
+        return prefs;
+    }
+    misses_++;
+    if (mtime < 0) return nullptr;
+    return load(file, mtime);
+}
+
+// cached definitions if still current, mtime is -1 if the file is missing
+// nanosecond times, so a file rewritten within the same second is still reparsed
+std::shared_ptr<const mec::Preferences> ModuleCatalogue::lookup(const std::string &file, int64_t &mtime) {
+    mtime = FsIndex::modifiedTime(file);
+    if (mtime < 0) return nullptr;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = definitions_.find(file);
+    if (it == definitions_.end() || it->second.mtime_ != mtime) return nullptr;
+    return it->second.prefs_;
+}
+
+std::shared_ptr<const mec::Preferences> ModuleCatalogue::load(const std::string &file, int64_t mtime) {
+    auto prefs = std::make_shared<const mec::Preferences>(file);
+    if (!prefs->valid()) {
+        LOG_0("ModuleCatalogue : unable to load definitions " << file);
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Definitions &d = definitions_[file];
+    d.mtime_ = mtime;
+    d.prefs_ = prefs;
+    return prefs;
+}
+
+void ModuleCatalogue::prefetch(const std::string &type) {
+    enqueue(type, true);
+}
+
+void ModuleCatalogue::enqueue(const std::string &type, bool warm) {
+    std::string dir = baseDir(type);
+    if (dir.empty()) return;
+    start();
+    queue_.enqueue(Job{dir + "/" + type, warm});
+}
+
+// read the module's patches (module.pd and its abstractions), so they are in the page cache when opened.
+// other files (e.g. samples) can be large, and are left to be read if the patch needs them
+void ModuleCatalogue::warm(const std::string &dir) {
+    static const char *PATCH_EXT = ".pd";
+    struct stat st;
+    struct dirent **namelist;
+    char buf[WARM_BUFFER_SIZE];
+
+    int n = scandir(dir.c_str(), &namelist, NULL, alphasort);
+    if (n > 0) {
+        for (int i = 0; i < n; i++) {
+            std::string file = dir + "/" + namelist[i]->d_name;
+            size_t len = strlen(namelist[i]->d_name);
+            bool isPatch = len > strlen(PATCH_EXT)
+                           && strcmp(namelist[i]->d_name + len - strlen(PATCH_EXT), PATCH_EXT) == 0;
+            bool isFile = namelist[i]->d_type == DT_REG;
+            // not all filesystems fill in the type
+            if (isPatch && namelist[i]->d_type == DT_UNKNOWN) {
+                isFile = stat(file.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+            }
+            if (isPatch && isFile) {
+                FILE *f = fopen(file.c_str(), "rb");
+                if (f != nullptr) {
+                    while (fread(buf, 1, sizeof(buf), f) == sizeof(buf));
+                    fclose(f);
+                }
+            }
+            free(namelist[i]);
+        }
+        free(namelist);
+    }
+}
+
+} //namespace
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <mec_prefs.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <blockingconcurrentqueue.h>
+
+namespace Kontrol {
+
+// module types found in the module directories, and their parsed definitions (module.json),
+// so loading a module takes them from memory, rather than reading and parsing on the calling thread.
+// definitions are parsed on a background thread as modules are added, patches are only read into the
+// page cache for modules about to be loaded (see prefetch), as most are never opened.
+class ModuleCatalogue {
+public:
+    static const char *MODULE_PATCH;
+    static const char *MODULE_DEFINITIONS;
+
+    ModuleCatalogue();
+    ~ModuleCatalogue();
+
+    // find module types (directories with a module patch, may be nested e.g. category/type) in each dir,
+    // in the order found. if a type is in more than one dir, the last wins (e.g. user modules)
+    std::vector<std::string> scan(const std::vector<std::string> &dirs);
+
+    // add module types already found in dir (e.g. from FsIndex), as scan, definitions parsed in the background
+    void add(const std::string &dir, const std::vector<std::string> &types);
+
+    // dir (as passed to scan) module type was found in, empty if not found
+    std::string baseDir(const std::string &type);
+
+    // parsed definitions, reparsed if the file has been modified since, nullptr if it cannot be read
+    std::shared_ptr<const mec::Preferences> definitions(const std::string &file);
+
+    // read module type's patch files in the background, ahead of it being loaded, e.g. menu neighbours
+    void prefetch(const std::string &type);
+
+    unsigned long hits() const { return hits_; }
+
+    unsigned long misses() const { return misses_; }
+
+    void stop();
+    void backgroundRun();
+
+private:
+    static const unsigned POLL_TIMEOUT_MS = 100;
+    static const unsigned WARM_BUFFER_SIZE = 16384;
+
+    struct Definitions {
+        int64_t mtime_; // see FsIndex::modifiedTime
+        std::shared_ptr<const mec::Preferences> prefs_;
+    };
+
+    struct Job {
+        std::string dir_; // module dir
+        bool warm_; // also read patch files, not just parse definitions
+    };
+
+    void start();
+    void enqueue(const std::string &type, bool warm);
+    std::shared_ptr<const mec::Preferences> lookup(const std::string &file, int64_t &mtime);
+    std::shared_ptr<const mec::Preferences> load(const std::string &file, int64_t mtime);
+    void warm(const std::string &dir);
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::string> modules_; // type -> base dir
+    std::unordered_map<std::string, Definitions> definitions_; // keyed by file
+    std::atomic<unsigned long> hits_;
+    std::atomic<unsigned long> misses_;
+
+    moodycamel::BlockingConcurrentQueue<Job> queue_;
+    std::mutex threadMutex_;
+    std::atomic<bool> running_;
+    std::thread background_thread_;
+};
+
+} //namespace
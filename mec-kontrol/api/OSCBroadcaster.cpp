@@ -3,19 +3,37 @@
 #include <osc/OscOutboundPacketStream.h>
 #include <mec_log.h>
 
+#include <limits>
+
 namespace Kontrol {
 
 
 //const std::string OSCBroadcaster::ADDRESS = "127.0.0.1";
 
 #define POLL_TIMEOUT_MS 1000
+#define CHUNK_OVERHEAD 64
+#define MIN_PACKET_SIZE 256
 
 OSCBroadcaster::OSCBroadcaster(Kontrol::ChangeSource src, unsigned keepAlive, bool master) :
-        master_(master),
         port_(0),
-        changeSource_(src),
         keepAliveTime_(keepAlive),
-        messageQueue_(OscMsg::MAX_N_OSC_MSGS) {
+        appliedVersion_(0),
+        messageQueue_(OscMsg::MAX_N_OSC_MSGS),
+        changeQueue_(OscMsg::MAX_N_OSC_MSGS),
+        changesPosted_(0),
+        changesTaken_(0),
+        changeWake_(false),
+        master_(master),
+        changeSource_(src),
+        maxPacketSize_(MAX_BUNDLE_SIZE),
+        chunkId_(0),
+        changeIntervalMs_(DEFAULT_CHANGE_INTERVAL_MS),
+        changesQueued_(0),
+        changesMerged_(0),
+        bundlesSent_(0),
+        publishRacksLeft_(0),
+        publishSent_(0),
+        burstCount_(0) {
 }
 
 OSCBroadcaster::~OSCBroadcaster() {
@@ -30,17 +48,29 @@ void *osc_broadcaster_write_thread_func(void *pBroadcaster) {
 }
 
 bool OSCBroadcaster::connect(const std::string &host, unsigned port) {
+    return connect(host, port, nullptr);
+}
+
+bool OSCBroadcaster::connect(const std::string &host, unsigned port, const std::shared_ptr<OSCReactor> &reactor) {
     stop();
     try {
         host_ = host;
         port_ = port;
-        socket_ = std::shared_ptr<UdpTransmitSocket>(new UdpTransmitSocket(IpEndpointName(host.c_str(), port_)));
+        endpoint_ = IpEndpointName(host.c_str(), port_);
+        socket_ = std::shared_ptr<UdpTransmitSocket>(new UdpTransmitSocket(endpoint_));
     } catch (const std::runtime_error &e) {
         port_ = 0;
         socket_.reset();
         return false;
     }
     running_ = true;
+    nextChanges_ = std::chrono::steady_clock::now();
+    if (reactor && reactor->isRunning()) {
+        // no writer thread, output is sent by the reactor
+        reactor_ = reactor;
+        reactor_->addBroadcaster(this);
+        return true;
+    }
 #ifdef __COBALT__
     pthread_t ph = writer_thread_.native_handle();
     pthread_create(&ph, 0,osc_broadcaster_write_thread_func,this);
@@ -52,7 +82,11 @@ bool OSCBroadcaster::connect(const std::string &host, unsigned port) {
 
 void OSCBroadcaster::stop() {
     running_ = false;
-    if (socket_) {
+    if (reactor_) {
+        reactor_->removeBroadcaster(this);
+        reactor_.reset();
+        if (socket_) flush();
+    } else if (socket_) {
         writer_thread_.join();
         flush();
     }
@@ -62,19 +96,250 @@ void OSCBroadcaster::stop() {
 
 
 void OSCBroadcaster::writePoll() {
+    nextChanges_ = std::chrono::steady_clock::now();
     while (running_) {
-        OscMsg msg;
-        if (messageQueue_.wait_dequeue_timed(msg, std::chrono::milliseconds(POLL_TIMEOUT_MS))) {
-            socket_->Send(msg.buffer_, (size_t) msg.size_);
+        messageSignal_.wait((std::int64_t) nextTimeout() * 1000);
+        drain(0);
+        sendDueChanges();
+    }
+}
+
+unsigned OSCBroadcaster::service() {
+    unsigned n = drain(MAX_SEND_BURST);
+    sendDueChanges();
+    // more queued, so come back next ms rather than flooding the peer
+    if (n == MAX_SEND_BURST) return 1;
+    return nextTimeout();
+}
+
+unsigned OSCBroadcaster::drain(unsigned maxPackets) {
+    OscMsg msg;
+    unsigned n = 0;
+    while ((maxPackets == 0 || n < maxPackets) && messageQueue_.try_dequeue(msg)) {
+        if (msg.size_ > 0) n++;
+        processMsg(msg);
+    }
+    return n;
+}
+
+unsigned OSCBroadcaster::nextTimeout() {
+    // changes may be queued but not yet drained, they are due with those pending
+    if (pendingChanges_.empty() && !changeWake_) return POLL_TIMEOUT_MS;
+    auto now = std::chrono::steady_clock::now();
+    if (now >= nextChanges_) return 0;
+    return (unsigned) std::chrono::duration_cast<std::chrono::milliseconds>(nextChanges_ - now).count();
+}
+
+void OSCBroadcaster::takeChanges(uint64_t count) {
+    ChangeMsg c;
+    while (changesTaken_ < count && changeQueue_.try_dequeue(c)) {
+        changesTaken_++;
+        queueChange(c.handle_, c.value_);
+    }
+}
+
+void OSCBroadcaster::processMsg(OscMsg &msg) {
+    // changes posted before the message are sent before it
+    takeChanges(msg.changes_);
+    if (!pendingChanges_.empty()) {
+        // keep changes ordered with respect to the message that follows
+        sendChanges();
+        nextChanges_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(changeIntervalMs_);
+    }
+    if (msg.size_ > 0) {
+        sendPacket(msg);
+    } else {
+        sendPublish(msg);
+    }
+}
+
+void OSCBroadcaster::sendPublish(const OscMsg &msg) {
+    osc::OutboundPacketStream ops(bundleBuffer_, MAX_BUNDLE_SIZE);
+    ops << osc::BeginBundleImmediate;
+    if (msg.size_ == OscMsg::PUBLISH_START) {
+        ops << osc::BeginMessage("/Kontrol/publishStart")
+            << (int32_t) msg.numRacks_
+            << (osc::int64) msg.version_
+            << osc::EndMessage;
+    } else {
+        ops << osc::BeginMessage("/Kontrol/publishRackFinished")
+            << msg.buffer_
+            << publishSent_
+            << osc::EndMessage;
+    }
+    ops << osc::EndBundle;
+    transmit(ops.Data(), (unsigned) ops.Size());
+    if (running_) pace();
+
+    if (msg.size_ == OscMsg::PUBLISH_START) {
+        publishRacksLeft_ = msg.numRacks_;
+        publishSent_ = 0;
+    } else {
+        packetSent();
+        if (publishRacksLeft_ > 0) publishRacksLeft_--;
+    }
+}
+
+// counted while publishing, so the peer can tell if it received them all
+void OSCBroadcaster::packetSent() {
+    if (publishRacksLeft_ > 0) publishSent_++;
+}
+
+void OSCBroadcaster::sendDueChanges() {
+    auto now = std::chrono::steady_clock::now();
+    if (now >= nextChanges_) {
+        // cleared before the last drain, so a change queued after it signals again
+        if (changeWake_.exchange(false)) {
+            drain(0);
+            takeChanges(std::numeric_limits<uint64_t>::max());
         }
+        sendChanges();
+        nextChanges_ = now + std::chrono::milliseconds(changeIntervalMs_);
     }
 }
 
+void OSCBroadcaster::transmit(const char *data, unsigned size) {
+    if (reactor_) {
+        reactor_->send(endpoint_, data, size);
+    } else {
+        socket_->Send(data, (size_t) size);
+    }
+}
+
+void OSCBroadcaster::enqueue(OscMsg &msg) {
+    msg.changes_ = changesPosted_;
+    messageQueue_.enqueue(msg);
+    wake();
+}
+
+void OSCBroadcaster::wake() {
+    messageSignal_.signal();
+    if (reactor_) reactor_->wake();
+}
+
+void OSCBroadcaster::pace() {
+    if (reactor_) return; // paced by service
+    if (++burstCount_ < MAX_SEND_BURST) return;
+    burstCount_ = 0;
+    auto next = burstStart_ + std::chrono::milliseconds(1);
+    if (std::chrono::steady_clock::now() < next) {
+        std::this_thread::sleep_until(next);
+    }
+    burstStart_ = std::chrono::steady_clock::now();
+}
+
 void OSCBroadcaster::flush() {
-    OscMsg msg;
-    while (messageQueue_.try_dequeue(msg)) {
-        socket_->Send(msg.buffer_, (size_t) msg.size_);
+    changeWake_ = false;
+    drain(0);
+    takeChanges(std::numeric_limits<uint64_t>::max());
+    sendChanges();
+}
+
+void OSCBroadcaster::maxPacketSize(unsigned size) {
+    if (size > MAX_PACKET_SIZE) size = MAX_PACKET_SIZE;
+    if (size > 0 && size < MIN_PACKET_SIZE) size = MIN_PACKET_SIZE;
+    maxPacketSize_ = size;
+}
+
+void OSCBroadcaster::sendPacket(OscMsg &msg) {
+    unsigned size = (unsigned) msg.size_;
+    if (maxPacketSize_ == 0 || size <= maxPacketSize_) {
+        transmit(msg.data(), size);
+        if (running_) pace();
+    } else {
+        // split into chunks, reassembled by the receiver before processing
+        unsigned chunkSize = maxPacketSize_ - CHUNK_OVERHEAD;
+        chunkId_++;
+        for (unsigned offset = 0; offset < size; offset += chunkSize) {
+            unsigned len = (size - offset < chunkSize ? size - offset : chunkSize);
+            osc::OutboundPacketStream ops(chunkBuffer_, MAX_PACKET_SIZE);
+            ops << osc::BeginMessage("/Kontrol/chunk")
+                << chunkId_
+                << (int32_t) offset
+                << (int32_t) size
+                << osc::Blob(msg.data() + offset, (osc::osc_bundle_element_size_t) len)
+                << osc::EndMessage;
+            transmit(ops.Data(), (unsigned) ops.Size());
+            if (running_) pace();
+        }
+    }
+    packetSent();
+
+    if (msg.data_) {
+        bufferPool_.release(msg.data_, size);
+        msg.data_ = nullptr;
+    }
+}
+
+static inline unsigned oscStringSize(const std::string &s) {
+    return (unsigned) ((s.size() + 4) & ~((size_t) 3));
+}
+
+void OSCBroadcaster::sendChanges() {
+    if (pendingChanges_.empty()) return;
+    sendingChanges_.swap(pendingChanges_);
+    pendingIndex_.clear();
+
+    static const char *address = "/Kontrol/changed";
+    static const unsigned bundleHeaderSize = 16; // #bundle + timetag
+    static const unsigned addressSize = 20; // padded address
+    static const unsigned typeTagSize = 8; // padded ,sssf
+
+    osc::OutboundPacketStream ops(bundleBuffer_, MAX_BUNDLE_SIZE);
+    ops << osc::BeginBundleImmediate;
+    unsigned size = bundleHeaderSize;
+    unsigned count = 0;
+
+    for (const auto &c : sendingChanges_) {
+        const EntityId &rackId = c.rack_->id();
+        const EntityId &moduleId = c.module_->id();
+        const EntityId &paramId = c.param_->id();
+        unsigned msgSize = 4 + addressSize + typeTagSize
+                           + oscStringSize(rackId) + oscStringSize(moduleId) + oscStringSize(paramId)
+                           + (c.value_.type() == ParamValue::T_Float ? 4 : oscStringSize(c.value_.stringValue()));
+
+        if (bundleHeaderSize + msgSize > MAX_BUNDLE_SIZE) {
+            LOG_0("OSCBroadcaster::sendChanges - change too large to send " << paramId);
+            continue;
+        }
+
+        if (size + msgSize > MAX_BUNDLE_SIZE) {
+            ops << osc::EndBundle;
+            transmit(ops.Data(), (unsigned) ops.Size());
+            bundlesSent_++;
+            packetSent();
+            if (running_) pace();
+            ops.Clear();
+            ops << osc::BeginBundleImmediate;
+            size = bundleHeaderSize;
+            count = 0;
+        }
+
+        ops << osc::BeginMessage(address)
+            << rackId.c_str()
+            << moduleId.c_str()
+            << paramId.c_str();
+
+        switch (c.value_.type()) {
+            case ParamValue::T_Float:
+                ops << c.value_.floatValue();
+                break;
+            case ParamValue::T_String:
+            default:
+                ops << c.value_.stringValue().c_str();
+        }
+        ops << osc::EndMessage;
+        size += msgSize;
+        count++;
+    }
+
+    if (count > 0) {
+        ops << osc::EndBundle;
+        transmit(ops.Data(), (unsigned) ops.Size());
+        bundlesSent_++;
+        packetSent();
     }
+    sendingChanges_.clear();
 }
 
 bool OSCBroadcaster::isActive() {
@@ -106,9 +371,18 @@ void OSCBroadcaster::send(const char *data, unsigned size) {
 //        }
 //    }
     OscMsg msg;
-    msg.size_ = (size > OscMsg::MAX_OSC_MESSAGE_SIZE ? OscMsg::MAX_OSC_MESSAGE_SIZE : size);
-    memcpy(msg.buffer_, data, (size_t) msg.size_);
-    messageQueue_.enqueue(msg);
+    msg.size_ = size;
+    if (size <= OscMsg::MAX_OSC_MESSAGE_SIZE) {
+        memcpy(msg.buffer_, data, (size_t) size);
+    } else {
+        msg.data_ = bufferPool_.acquire(size);
+        if (msg.data_ == nullptr) {
+            LOG_0("OSCBroadcaster::send - message too large, dropped " << size);
+            return;
+        }
+        memcpy(msg.data_, data, (size_t) size);
+    }
+    enqueue(msg);
 }
 
 void OSCBroadcaster::sendPing(unsigned port) {
@@ -120,6 +394,8 @@ void OSCBroadcaster::sendPing(unsigned port) {
         << osc::BeginMessage("/Kontrol/ping")
         << (int32_t) port
         << (int32_t) keepAliveTime_
+        << (osc::int64) Entity::currentVersion()
+        << (osc::int64) appliedVersion_
         << osc::EndMessage
         << osc::EndBundle;
 
@@ -131,7 +407,8 @@ bool OSCBroadcaster::broadcastChange(ChangeSource src) {
 }
 
 
-void OSCBroadcaster::ping(ChangeSource src, const std::string &host, unsigned port, unsigned keepAlive) {
+void OSCBroadcaster::ping(ChangeSource src, const std::string &host, unsigned port, unsigned keepAlive,
+                          uint64_t /*version*/, uint64_t lastSeen) {
     if ((port_ == port) && (host_ == host)) {
         changeSource_ = src;
 
@@ -149,41 +426,82 @@ void OSCBroadcaster::ping(ChangeSource src, const std::string &host, unsigned po
             }
         } else {
             if (keepAliveTime_ == 0 || !wasActive) {
+                publishMetaData(lastSeen);
+            }
+        }
+    }
+}
 
-                EntityId rackId = Rack::createId(host_, port_);
-                publishStart(CS_LOCAL, KontrolModel::model()->getRacks().size());
-                for (const auto &r:KontrolModel::model()->getRacks()) {
-                    if (rackId != r->id()) {
-                        std::cerr << " publishing meta data to " << rackId << " for " << r->id() << std::endl;
-                        rack(CS_LOCAL, *r);
-                        for (const auto &m : r->getModules()) {
-                            module(CS_LOCAL, *r, *m);
-                            for (const auto &p :  m->getParams()) {
-                                param(CS_LOCAL, *r, *m, *p);
-                            }
-                            for (const auto &p : m->getPages()) {
-                                if (p != nullptr) {
-                                    page(CS_LOCAL, *r, *m, *p);
-                                }
-                            }
-                            for (const auto &p :  m->getParams()) {
-                                changed(CS_LOCAL, *r, *m, *p);
-                            }
-                            for (const auto &midiMap : m->getMidiMapping()) {
-                                for (const auto &j : midiMap.second) {
-                                    auto parameter = m->getParam(j);
-                                    if (parameter) {
-                                        assignMidiCC(CS_LOCAL, *r, *m, *parameter, midiMap.first);
-                                    }
-                                }
-                            }
-                        }
-                        publishRackFinished(CS_LOCAL, *r);
-                    }
+void OSCBroadcaster::publishMetaData(uint64_t since) {
+    EntityId rackId = Rack::createId(host_, port_);
+    auto racks = KontrolModel::model()->getRacks();
+
+    // a version we have not issued must be from a previous run of this process
+    if (since > Entity::currentVersion()) since = 0;
+
+    unsigned numRacks = 0;
+    unsigned total = 0, stale = 0;
+    for (const auto &r : racks) {
+        if (rackId == r->id()) continue;
+        numRacks++;
+        for (const auto &m : r->getModules()) {
+            auto params = m->getParams();
+            total += 1 + params.size();
+            if (r->version() > since || m->version() > since) {
+                stale += 1 + params.size();
+            } else {
+                for (const auto &p : params) {
+                    if (p->version() > since) stale++;
                 }
             }
         }
     }
+
+    // if most has changed, a snapshot is cheaper than the delta
+    if (stale * 2 > total) since = 0;
+
+    publishStart(CS_LOCAL, numRacks);
+    for (const auto &r : racks) {
+        if (rackId == r->id()) continue;
+
+        bool fullRack = since == 0 || r->version() > since;
+        LOG_1("publishing meta data to " << rackId << " for " << r->id()
+                                          << (fullRack ? " snapshot" : " delta"));
+        if (fullRack) rack(CS_LOCAL, *r);
+        for (const auto &m : r->getModules()) {
+            if (fullRack || m->version() > since) {
+                publishModuleMetaData(*r, m);
+            } else {
+                for (const auto &p : m->getParams()) {
+                    if (p->version() > since) changed(CS_LOCAL, *r, *m, *p);
+                }
+            }
+        }
+        publishRackFinished(CS_LOCAL, *r);
+    }
+}
+
+void OSCBroadcaster::publishModuleMetaData(const Rack &r, const std::shared_ptr<Module> &m) {
+    module(CS_LOCAL, r, *m);
+    for (const auto &p :  m->getParams()) {
+        param(CS_LOCAL, r, *m, *p);
+    }
+    for (const auto &p : m->getPages()) {
+        if (p != nullptr) {
+            page(CS_LOCAL, r, *m, *p);
+        }
+    }
+    for (const auto &p :  m->getParams()) {
+        changed(CS_LOCAL, r, *m, *p);
+    }
+    for (const auto &midiMap : m->getMidiMapping()) {
+        for (const auto &j : midiMap.second) {
+            auto parameter = m->getParam(j);
+            if (parameter) {
+                assignMidiCC(CS_LOCAL, r, *m, *parameter, midiMap.first);
+            }
+        }
+    }
 }
 
 void OSCBroadcaster::assignMidiCC(ChangeSource src, const Rack &rack, const Module &module, const Parameter &p,
@@ -273,15 +591,12 @@ void OSCBroadcaster::publishStart(ChangeSource src, unsigned numRacks)
     if (!isActive())
         return;
 
-    osc::OutboundPacketStream ops(buffer_, OUTPUT_BUFFER_SIZE);
-
-    ops << osc::BeginBundleImmediate
-        << osc::BeginMessage("/Kontrol/publishStart")
-        << (int32_t)numRacks
-        << osc::EndMessage
-        << osc::EndBundle;
-
-    send(ops.Data(), ops.Size());
+    // changes after this version are sent again, unless the peer acknowledges a later publish
+    OscMsg msg;
+    msg.size_ = OscMsg::PUBLISH_START;
+    msg.version_ = Entity::currentVersion();
+    msg.numRacks_ = numRacks;
+    enqueue(msg);
 }
 
 void OSCBroadcaster::publishRackFinished(ChangeSource src, const Rack &rack)
@@ -290,16 +605,18 @@ void OSCBroadcaster::publishRackFinished(ChangeSource src, const Rack &rack)
         return;
     if (!isActive())
         return;
+    if (rack.id().size() >= OscMsg::MAX_OSC_MESSAGE_SIZE)
+        return;
 
-    osc::OutboundPacketStream ops(buffer_, OUTPUT_BUFFER_SIZE);
-
-    ops << osc::BeginBundleImmediate
-        << osc::BeginMessage("/Kontrol/publishRackFinished")
-        << rack.id().c_str()
-        << osc::EndMessage
-        << osc::EndBundle;
+    OscMsg msg;
+    msg.size_ = OscMsg::RACK_FINISHED;
+    memcpy(msg.buffer_, rack.id().c_str(), rack.id().size() + 1);
+    enqueue(msg);
+}
 
-    send(ops.Data(), ops.Size());
+void OSCBroadcaster::published(ChangeSource src, uint64_t version) {
+    // received from the peer we send to, acknowledged in our pings so it only sends later changes
+    if (src == changeSource_) appliedVersion_ = version;
 }
 
 void OSCBroadcaster::savePreset(ChangeSource src, const Rack &rack, std::string preset) {
@@ -469,28 +786,50 @@ void OSCBroadcaster::changed(ChangeSource src, const Rack &rack, const Module &m
     if (!broadcastChange(src)) return;
     if (!isActive()) return;
 
-    osc::OutboundPacketStream ops(buffer_, OUTPUT_BUFFER_SIZE);
-
-    ops << osc::BeginBundleImmediate
-        << osc::BeginMessage("/Kontrol/changed")
-        << rack.id().c_str()
-        << module.id().c_str()
-        << p.id().c_str();
+    postChange(rack, module, p, p.current());
+    // the writer sends immediately if changes are not coalesced
+    if (!changeWake_.exchange(true)) wake();
+}
 
-    switch (p.current().type()) {
-        case ParamValue::T_Float:
-            ops << p.current().floatValue();
-            break;
-        case ParamValue::T_String:
-        default:
-            ops << p.current().stringValue().c_str();
+void OSCBroadcaster::changedParams(ChangeSource src, const Rack &rack, const std::vector<ChangedParam> &params) {
+    if (!broadcastChange(src)) return;
+    if (!isActive()) return;
 
+    // sent together as bundles
+    for (const auto &c : params) {
+        postChange(rack, *c.module_, *c.param_, c.value_);
+    }
+    if (!changeWake_.exchange(true)) wake();
+}
+
+// called on the changing thread, so only the handle and value are queued, ids are resolved by the writer
+void OSCBroadcaster::postChange(const Rack &rack, const Module &module, const Parameter &p, const ParamValue &value) {
+    ChangeMsg c;
+    c.handle_ = KontrolModel::model()->getParamHandle(rack, module, p);
+    if (!c.handle_.valid()) return;
+    c.value_ = value;
+    changeQueue_.enqueue(std::move(c));
+    // after the enqueue, so a message counting it is only taken once the change can be
+    changesPosted_++;
+}
+
+void OSCBroadcaster::queueChange(const ParamHandle &handle, const ParamValue &value) {
+    changesQueued_++;
+    uint64_t key = handle.key();
+    auto i = pendingIndex_.find(key);
+    if (i != pendingIndex_.end()) {
+        // latest value wins
+        pendingChanges_[i->second].value_ = value;
+        changesMerged_++;
+        return;
     }
 
-    ops << osc::EndMessage
-        << osc::EndBundle;
-
-    send(ops.Data(), ops.Size());
+    PendingChange c;
+    c.param_ = KontrolModel::model()->getParam(handle, c.rack_, c.module_);
+    if (c.param_ == nullptr) return; // removed since
+    c.value_ = value;
+    pendingIndex_[key] = (unsigned) pendingChanges_.size();
+    pendingChanges_.push_back(c);
 }
 
 void OSCBroadcaster::resource(ChangeSource src, const Rack &rack, const std::string &type, const std::string &res) {
@@ -512,6 +851,50 @@ void OSCBroadcaster::resource(ChangeSource src, const Rack &rack, const std::str
     send(ops.Data(), ops.Size());
 }
 
+// as many resources as fit a bundle, rather than a packet each
+void OSCBroadcaster::resources(ChangeSource src, const Rack &rack, const std::string &type,
+                               const std::vector<std::string> &res) {
+    if (!broadcastChange(src)) return;
+    if (!isActive()) return;
+
+    static const char *address = "/Kontrol/resource";
+    static const unsigned bundleHeaderSize = 16; // #bundle + timetag
+    static const unsigned addressSize = 20; // padded address
+    static const unsigned typeTagSize = 8; // padded ,sss
+
+    osc::OutboundPacketStream ops(buffer_, OUTPUT_BUFFER_SIZE);
+    ops << osc::BeginBundleImmediate;
+    unsigned size = bundleHeaderSize;
+    unsigned count = 0;
+
+    for (const auto &r : res) {
+        unsigned msgSize = 4 + addressSize + typeTagSize
+                           + oscStringSize(rack.id()) + oscStringSize(type) + oscStringSize(r);
+
+        if (count > 0 && size + msgSize > MAX_BUNDLE_SIZE) {
+            ops << osc::EndBundle;
+            send(ops.Data(), ops.Size());
+            ops.Clear();
+            ops << osc::BeginBundleImmediate;
+            size = bundleHeaderSize;
+            count = 0;
+        }
+
+        ops << osc::BeginMessage(address)
+            << rack.id().c_str()
+            << type.c_str()
+            << r.c_str()
+            << osc::EndMessage;
+        size += msgSize;
+        count++;
+    }
+
+    if (count > 0) {
+        ops << osc::EndBundle;
+        send(ops.Data(), ops.Size());
+    }
+}
+
 void OSCBroadcaster::deleteRack(ChangeSource src, const Rack &rack) {
     if (!broadcastChange(src)) return;
     if (!isActive()) return;
@@ -2,25 +2,39 @@
 
 #include "KontrolModel.h"
 #include "ChangeSource.h"
+#include "OSCBufferPool.h"
+#include "OSCReactor.h"
 
 #include <memory>
 #include <ip/UdpSocket.h>
 #include <chrono>
 #include <thread>
 #include <mutex>
-#include <readerwriterqueue.h>
+#include <atomic>
+#include <blockingconcurrentqueue.h>
 #include <condition_variable>
+#include <unordered_map>
+#include <vector>
 
 namespace Kontrol {
 
 
 class OSCBroadcaster : public KontrolCallback {
 public:
-    static const unsigned int OUTPUT_BUFFER_SIZE = 1024;
+    static const unsigned int OUTPUT_BUFFER_SIZE = OSCBufferPool::MAX_BUFFER_SIZE;
+    // oscpack receivers read at most 4098 bytes per packet
+    static const unsigned int MAX_PACKET_SIZE = 4096;
+    // largest bundle of coalesced changes, sized to fit an ethernet frame
+    static const unsigned int MAX_BUNDLE_SIZE = 1472;
+    static const unsigned int DEFAULT_CHANGE_INTERVAL_MS = 10;
+    // max packets sent per ms, paces large publishes
+    static const unsigned int MAX_SEND_BURST = 16;
 
     OSCBroadcaster(Kontrol::ChangeSource src, unsigned keepAlive, bool master);
     ~OSCBroadcaster();
     bool connect(const std::string &host, unsigned port);
+    // output is sent by the reactor thread if it is running, rather than a writer thread
+    bool connect(const std::string &host, unsigned port, const std::shared_ptr<OSCReactor> &reactor);
     void stop() override;
 
     void sendPing(unsigned port);
@@ -31,10 +45,13 @@ public:
     void page(ChangeSource src, const Rack &rack, const Module &module, const Page &p) override;
     void param(ChangeSource src, const Rack &rack, const Module &module, const Parameter &) override;
     void changed(ChangeSource src, const Rack &rack, const Module &module, const Parameter &p) override;
+    void changedParams(ChangeSource src, const Rack &rack, const std::vector<ChangedParam> &params) override;
     void resource(ChangeSource, const Rack &, const std::string &, const std::string &) override;
+    void resources(ChangeSource, const Rack &, const std::string &, const std::vector<std::string> &) override;
     void deleteRack(ChangeSource, const Rack &) override;
     void activeModule(ChangeSource source, const Rack &rack, const Module &module) override;
-    void ping(ChangeSource src, const std::string &host, unsigned port, unsigned keepAlive) override;
+    void ping(ChangeSource src, const std::string &host, unsigned port, unsigned keepAlive,
+              uint64_t version, uint64_t lastSeen) override;
     void assignMidiCC(ChangeSource, const Rack &, const Module &, const Parameter &, unsigned midiCC) override;
     void unassignMidiCC(ChangeSource, const Rack &, const Module &, const Parameter &, unsigned midiCC) override;
     void savePreset(ChangeSource, const Rack &, std::string preset) override;
@@ -50,16 +67,35 @@ public:
 
     void publishStart(ChangeSource, unsigned numRacks) override;
     void publishRackFinished(ChangeSource, const Rack &) override;
+    void published(ChangeSource, uint64_t version) override;
 
     bool isThisHost(const std::string &host, unsigned port) { return host == host_ && port == port_; }
 
     bool isActive();
     void writePoll();
+    // reactor mode, send queued output without blocking, returns ms until next service is needed
+    unsigned service();
 
     std::string host() { return host_; }
 
     unsigned port() { return port_; }
 
+    // changed values are coalesced (latest wins) and sent every interval ms, 0 = send immediately
+    // changes may be queued from any thread, other messages are built by one thread at a time (the model owner)
+    void changeInterval(unsigned ms) { changeIntervalMs_ = ms; }
+
+    unsigned changeInterval() { return changeIntervalMs_; }
+
+    unsigned long changesQueued() { return changesQueued_; }
+
+    unsigned long changesMerged() { return changesMerged_; }
+
+    unsigned long bundlesSent() { return bundlesSent_; }
+
+    // packets larger than this are sent as /Kontrol/chunk messages, 0 = never chunk
+    void maxPacketSize(unsigned size);
+
+    unsigned maxPacketSize() { return maxPacketSize_; }
 
 protected:
     void send(const char *data, unsigned size);
@@ -67,17 +103,67 @@ protected:
 
 private:
     void flush();
+    void sendChanges();
+    void queueChange(const ParamHandle &handle, const ParamValue &value);
+    // process queued messages in order, returns the number of packets sent
+    unsigned drain(unsigned maxPackets);
+    void sendDueChanges();
+    unsigned nextTimeout();
+    void pace();
+
+    // publish racks to peer, only entities changed since version (0 = everything)
+    void publishMetaData(uint64_t since);
+    void publishModuleMetaData(const Rack &rack, const std::shared_ptr<Module> &module);
 
     struct OscMsg {
         static const int MAX_N_OSC_MSGS = 128;
         static const int MAX_OSC_MESSAGE_SIZE = 512;
+        // built by the writer, which counts the packets sent in between, see OSCReceiver
+        static const int PUBLISH_START = -2;
+        static const int RACK_FINISHED = -3; // rack id in buffer_
+
+        OscMsg() : size_(0), data_(nullptr), buffer_(), changes_(0), version_(0), numRacks_(0) { ; }
+
         int size_;
+        char *data_; // pooled buffer if larger than MAX_OSC_MESSAGE_SIZE
         char buffer_[MAX_OSC_MESSAGE_SIZE];
+        uint64_t changes_; // changes posted before this message, which are sent before it
+        uint64_t version_; // PUBLISH_START only
+        unsigned numRacks_;
+
+        const char *data() const { return data_ ? data_ : buffer_; }
+    };
+
+    // queued separately from messages, so a change does not copy a packet buffer
+    struct ChangeMsg {
+        ParamHandle handle_;
+        ParamValue value_;
+    };
+
+    void sendPacket(OscMsg &msg);
+    void sendPublish(const OscMsg &msg);
+    void packetSent();
+    void processMsg(OscMsg &msg);
+    void enqueue(OscMsg &msg);
+    // take up to count posted changes from changeQueue_ into pendingChanges_
+    void takeChanges(uint64_t count);
+    void postChange(const Rack &rack, const Module &module, const Parameter &p, const ParamValue &value);
+    void wake();
+    void transmit(const char *data, unsigned size);
+
+    // resolved on the writer thread, keeping the entities alive until sent
+    struct PendingChange {
+        std::shared_ptr<Rack> rack_;
+        std::shared_ptr<Module> module_;
+        std::shared_ptr<Parameter> param_;
+        ParamValue value_;
     };
 
     std::string host_;
     unsigned int port_;
     std::shared_ptr<UdpTransmitSocket> socket_;
+    IpEndpointName endpoint_;
+    std::shared_ptr<OSCReactor> reactor_;
     char buffer_[OUTPUT_BUFFER_SIZE];
 #ifdef __COBALT__
     struct timespec lastPing_;
@@ -85,14 +171,40 @@ private:
     std::chrono::steady_clock::time_point lastPing_;
 #endif
     unsigned keepAliveTime_;
-
-    moodycamel::BlockingReaderWriterQueue<OscMsg> messageQueue_;
+    std::atomic<uint64_t> appliedVersion_; // of the peers last complete publish, acknowledged in our pings
+
+    // multiple producers, only signalled for the first change of an interval, see changeWake_
+    moodycamel::ConcurrentQueue<OscMsg> messageQueue_;
+    moodycamel::ConcurrentQueue<ChangeMsg> changeQueue_;
+    std::atomic<uint64_t> changesPosted_; // counted once queued, see OscMsg::changes_
+    uint64_t changesTaken_; // writer thread only
+    moodycamel::details::mpmc_sema::LightweightSemaphore messageSignal_;
+    std::atomic<bool> changeWake_; // set once changes are queued, until the writer sends them
     bool master_;
 
     bool running_;
     std::thread writer_thread_;
 
     ChangeSource changeSource_;
+
+    // pending changes, keyed by handle, in order of first change. writer thread only
+    std::unordered_map<uint64_t, unsigned> pendingIndex_;
+    std::vector<PendingChange> pendingChanges_;
+    std::vector<PendingChange> sendingChanges_;
+    char bundleBuffer_[MAX_BUNDLE_SIZE];
+    OSCBufferPool bufferPool_;
+    unsigned maxPacketSize_;
+    int32_t chunkId_;
+    char chunkBuffer_[MAX_PACKET_SIZE];
+    std::atomic<unsigned> changeIntervalMs_;
+    std::atomic<unsigned long> changesQueued_;
+    std::atomic<unsigned long> changesMerged_;
+    std::atomic<unsigned long> bundlesSent_;
+    unsigned publishRacksLeft_; // writer thread only
+    int32_t publishSent_;
+    std::chrono::steady_clock::time_point nextChanges_;
+    unsigned burstCount_;
+    std::chrono::steady_clock::time_point burstStart_;
 };
 
 } //namespace
@@ -0,0 +1,45 @@
+#include "OSCBufferPool.h"
+
+namespace Kontrol {
+
+static const unsigned classSizes[] = {2048, 8192, OSCBufferPool::MAX_BUFFER_SIZE};
+
+OSCBufferPool::OSCBufferPool() {
+    for (auto &q : freeBuffers_) {
+        q = moodycamel::ReaderWriterQueue<char *>(MAX_FREE_BUFFERS);
+    }
+}
+
+OSCBufferPool::~OSCBufferPool() {
+    for (auto &q : freeBuffers_) {
+        char *buffer;
+        while (q.try_dequeue(buffer)) {
+            delete[] buffer;
+        }
+    }
+}
+
+unsigned OSCBufferPool::sizeClass(unsigned size) {
+    unsigned c = 0;
+    while (c < N_SIZE_CLASSES - 1 && size > classSizes[c]) c++;
+    return c;
+}
+
+char *OSCBufferPool::acquire(unsigned size) {
+    if (size > MAX_BUFFER_SIZE) return nullptr;
+    unsigned c = sizeClass(size);
+    char *buffer;
+    if (freeBuffers_[c].try_dequeue(buffer)) return buffer;
+    return new char[classSizes[c]];
+}
+
+void OSCBufferPool::release(char *buffer, unsigned size) {
+    if (buffer == nullptr) return;
+    unsigned c = sizeClass(size);
+    // keep a bounded number, a burst of large messages should not pin memory
+    if (!freeBuffers_[c].try_enqueue(buffer)) {
+        delete[] buffer;
+    }
+}
+
+} //namespace
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <readerwriterqueue.h>
+
+namespace Kontrol {
+
+// recycles buffers for osc packets too large for an inline queue slot.
+// single producer (acquire) and single consumer (release), as the message queues they are used with,
+// so after warm up large packets are queued without allocating
+class OSCBufferPool {
+public:
+    static const unsigned MAX_BUFFER_SIZE = 65536;
+
+    OSCBufferPool();
+    ~OSCBufferPool();
+
+    // returns nullptr if size exceeds MAX_BUFFER_SIZE
+    char *acquire(unsigned size);
+    // size must be the size passed to acquire
+    void release(char *buffer, unsigned size);
+
+private:
+    static const unsigned N_SIZE_CLASSES = 3;
+    static const unsigned MAX_FREE_BUFFERS = 16;
+    static unsigned sizeClass(unsigned size);
+
+    moodycamel::ReaderWriterQueue<char *> freeBuffers_[N_SIZE_CLASSES];
+};
+
+} //namespace
@@ -0,0 +1,307 @@
+#include "OSCReactor.h"
+#include "OSCBroadcaster.h"
+
+#include <mec_log.h>
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef __linux__
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#endif
+
+namespace Kontrol {
+
+#ifdef __linux__
+
+struct OSCReactor::Batch {
+    struct mmsghdr msgs_[BATCH_SIZE];
+    struct iovec iovecs_[BATCH_SIZE];
+    struct sockaddr_in addrs_[BATCH_SIZE];
+    char buffers_[BATCH_SIZE][MAX_PACKET_SIZE];
+
+    Batch() {
+        memset(msgs_, 0, sizeof(msgs_));
+        for (unsigned i = 0; i < BATCH_SIZE; i++) {
+            iovecs_[i].iov_base = buffers_[i];
+            iovecs_[i].iov_len = MAX_PACKET_SIZE;
+            msgs_[i].msg_hdr.msg_iov = &iovecs_[i];
+            msgs_[i].msg_hdr.msg_iovlen = 1;
+            msgs_[i].msg_hdr.msg_name = &addrs_[i];
+            msgs_[i].msg_hdr.msg_namelen = sizeof(addrs_[i]);
+        }
+    }
+};
+
+
+OSCReactor::OSCReactor() :
+        running_(false),
+        wakePending_(false),
+        epollFd_(-1),
+        wakeFd_(-1),
+        sendFd_(-1),
+        sendCount_(0) {
+}
+
+OSCReactor::~OSCReactor() {
+    stop();
+}
+
+void *osc_reactor_thread_func(void *pReactor) {
+    auto *pThis = static_cast<OSCReactor *>(pReactor);
+    pThis->run();
+    return nullptr;
+}
+
+bool OSCReactor::start() {
+    if (running_) return true;
+
+    epollFd_ = epoll_create1(0);
+    wakeFd_ = eventfd(0, EFD_NONBLOCK);
+    sendFd_ = socket(AF_INET, SOCK_DGRAM, 0);
+    if (epollFd_ < 0 || wakeFd_ < 0 || sendFd_ < 0) {
+        LOG_0("OSCReactor::start - failed to create descriptors");
+        stop();
+        return false;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = wakeFd_;
+    epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &ev);
+
+    recvBatch_.reset(new Batch());
+    sendBatch_.reset(new Batch());
+    sendCount_ = 0;
+
+    running_ = true;
+    thread_ = std::thread(osc_reactor_thread_func, this);
+    return true;
+}
+
+void OSCReactor::stop() {
+    if (running_) {
+        running_ = false;
+        wake();
+        thread_.join();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &l : listeners_) {
+        close(l.fd_);
+    }
+    listeners_.clear();
+    broadcasters_.clear();
+    if (sendFd_ >= 0) close(sendFd_);
+    if (wakeFd_ >= 0) close(wakeFd_);
+    if (epollFd_ >= 0) close(epollFd_);
+    sendFd_ = wakeFd_ = epollFd_ = -1;
+}
+
+bool OSCReactor::addListener(unsigned port, PacketListener *listener) {
+    if (!running_) return false;
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) return false;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((uint16_t) port);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        LOG_0("OSCReactor::addListener - unable to bind port " << port);
+        close(fd);
+        return false;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        close(fd);
+        return false;
+    }
+    listeners_.push_back(Listener{fd, port, listener});
+    return true;
+}
+
+void OSCReactor::removeListener(PacketListener *listener) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = listeners_.begin(); it != listeners_.end();) {
+        if (it->listener_ == listener) {
+            epoll_ctl(epollFd_, EPOLL_CTL_DEL, it->fd_, nullptr);
+            close(it->fd_);
+            it = listeners_.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
+
+void OSCReactor::addBroadcaster(OSCBroadcaster *broadcaster) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        broadcasters_.push_back(broadcaster);
+    }
+    wake();
+}
+
+void OSCReactor::removeBroadcaster(OSCBroadcaster *broadcaster) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    broadcasters_.erase(std::remove(broadcasters_.begin(), broadcasters_.end(), broadcaster), broadcasters_.end());
+}
+
+void OSCReactor::wake() {
+    // only signal once per cycle, the reactor clears this before servicing
+    if (wakeFd_ >= 0 && !wakePending_.exchange(true)) {
+        uint64_t v = 1;
+        if (write(wakeFd_, &v, sizeof(v)) < 0) {
+            ; // counter saturated, reactor will wake anyway
+        }
+    }
+}
+
+void OSCReactor::send(const IpEndpointName &dest, const char *data, unsigned size) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl((uint32_t) dest.address);
+    addr.sin_port = htons((uint16_t) dest.port);
+
+    if (size > MAX_PACKET_SIZE) {
+        // too large to batch, only if chunking is disabled
+        flushSends();
+        sendto(sendFd_, data, size, 0, (struct sockaddr *) &addr, sizeof(addr));
+        return;
+    }
+
+    if (sendCount_ == BATCH_SIZE) flushSends();
+    unsigned i = sendCount_++;
+    memcpy(sendBatch_->buffers_[i], data, size);
+    sendBatch_->iovecs_[i].iov_len = size;
+    sendBatch_->addrs_[i] = addr;
+    sendBatch_->msgs_[i].msg_hdr.msg_namelen = sizeof(addr);
+}
+
+void OSCReactor::flushSends() {
+    unsigned sent = 0;
+    while (sent < sendCount_) {
+        int n = sendmmsg(sendFd_, sendBatch_->msgs_ + sent, sendCount_ - sent, 0);
+        if (n <= 0) break; // udp, drop remainder
+        sent += (unsigned) n;
+    }
+    sendCount_ = 0;
+}
+
+void OSCReactor::receive(const Listener &l) {
+    int n;
+    do {
+        for (unsigned i = 0; i < BATCH_SIZE; i++) {
+            recvBatch_->iovecs_[i].iov_len = MAX_PACKET_SIZE;
+            recvBatch_->msgs_[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        }
+        n = recvmmsg(l.fd_, recvBatch_->msgs_, BATCH_SIZE, MSG_DONTWAIT, nullptr);
+        for (int i = 0; i < n; i++) {
+            const struct sockaddr_in &addr = recvBatch_->addrs_[i];
+            IpEndpointName origin(ntohl(addr.sin_addr.s_addr), ntohs(addr.sin_port));
+            l.listener_->ProcessPacket(recvBatch_->buffers_[i], (int) recvBatch_->msgs_[i].msg_len, origin);
+        }
+    } while (n == (int) BATCH_SIZE);
+}
+
+void OSCReactor::run() {
+    static const int MAX_EVENTS = 16;
+    struct epoll_event events[MAX_EVENTS];
+    int timeout = 0;
+
+    while (running_) {
+        int n = epoll_wait(epollFd_, events, MAX_EVENTS, timeout);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.fd == wakeFd_) {
+                uint64_t v;
+                if (read(wakeFd_, &v, sizeof(v)) < 0) { ; }
+                continue;
+            }
+            for (const auto &l : listeners_) {
+                if (l.fd_ == events[i].data.fd) {
+                    receive(l);
+                    break;
+                }
+            }
+        }
+
+        // clear before servicing, so output queued during service wakes us again
+        wakePending_ = false;
+        unsigned next = POLL_TIMEOUT_MS;
+        for (auto b : broadcasters_) {
+            next = std::min(next, b->service());
+        }
+        flushSends();
+        timeout = (int) next;
+    }
+}
+
+#else
+
+struct OSCReactor::Batch {
+};
+
+OSCReactor::OSCReactor() :
+        running_(false),
+        wakePending_(false),
+        epollFd_(-1),
+        wakeFd_(-1),
+        sendFd_(-1),
+        sendCount_(0) {
+}
+
+OSCReactor::~OSCReactor() {
+}
+
+bool OSCReactor::start() {
+    LOG_0("OSCReactor::start - not supported on this platform");
+    return false;
+}
+
+void OSCReactor::stop() {
+}
+
+bool OSCReactor::addListener(unsigned, PacketListener *) {
+    return false;
+}
+
+void OSCReactor::removeListener(PacketListener *) {
+}
+
+void OSCReactor::addBroadcaster(OSCBroadcaster *) {
+}
+
+void OSCReactor::removeBroadcaster(OSCBroadcaster *) {
+}
+
+void OSCReactor::wake() {
+}
+
+void OSCReactor::send(const IpEndpointName &, const char *, unsigned) {
+}
+
+void OSCReactor::run() {
+}
+
+#endif
+
+} //namespace
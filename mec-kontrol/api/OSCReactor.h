@@ -0,0 +1,78 @@
+#pragma once
+
+#include <ip/IpEndpointName.h>
+#include <ip/PacketListener.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Kontrol {
+
+class OSCBroadcaster;
+
+// optional shared network thread for kontrol osc endpoints, linux only (start fails elsewhere).
+// one epoll loop receives for all listening ports (recvmmsg) and sends the queued output
+// of all attached broadcasters (sendmmsg), rather than a thread per socket
+class OSCReactor {
+public:
+    static const unsigned BATCH_SIZE = 16;
+    static const unsigned MAX_PACKET_SIZE = 4096;
+    static const unsigned POLL_TIMEOUT_MS = 1000;
+
+    OSCReactor();
+    ~OSCReactor();
+
+    bool start();
+    void stop();
+
+    bool isRunning() const { return running_; }
+
+    // packets received on port are passed to listener, on the reactor thread
+    bool addListener(unsigned port, PacketListener *listener);
+    void removeListener(PacketListener *listener);
+
+    // broadcaster output is serviced on the reactor thread, see OSCBroadcaster::service
+    void addBroadcaster(OSCBroadcaster *broadcaster);
+    void removeBroadcaster(OSCBroadcaster *broadcaster);
+
+    // wake reactor thread, called when output is queued
+    void wake();
+
+    // only valid on the reactor thread, sent in a batch at the end of the cycle
+    void send(const IpEndpointName &dest, const char *data, unsigned size);
+
+    void run();
+
+private:
+    struct Listener {
+        int fd_;
+        unsigned port_;
+        PacketListener *listener_;
+    };
+
+    struct Batch;
+
+    void receive(const Listener &listener);
+    void flushSends();
+
+    std::atomic<bool> running_;
+    std::atomic<bool> wakePending_;
+    int epollFd_;
+    int wakeFd_;
+    int sendFd_;
+
+    std::mutex mutex_; // held while servicing, so endpoints can be removed safely
+    std::vector<Listener> listeners_;
+    std::vector<OSCBroadcaster *> broadcasters_;
+
+    std::unique_ptr<Batch> recvBatch_;
+    std::unique_ptr<Batch> sendBatch_;
+    unsigned sendCount_;
+
+    std::thread thread_;
+};
+
+} //namespace
@@ -10,7 +10,8 @@ namespace Kontrol {
 
 class KontrolPacketListener : public PacketListener {
 public:
-    KontrolPacketListener(moodycamel::ReaderWriterQueue<OSCReceiver::OscMsg>& queue) : queue_(queue) {
+    KontrolPacketListener(moodycamel::ReaderWriterQueue<OSCReceiver::OscMsg> &queue, OSCBufferPool &pool)
+            : queue_(queue), pool_(pool) {
     }
 
     virtual void ProcessPacket(const char *data, int size,
@@ -25,186 +26,366 @@ public:
 //        }
         OSCReceiver::OscMsg msg;
         msg.origin_ = remoteEndpoint;
-        msg.size_ = (size > OSCReceiver::OscMsg::MAX_OSC_MESSAGE_SIZE ? OSCReceiver::OscMsg::MAX_OSC_MESSAGE_SIZE
-                                                                      : size);
-        memcpy(msg.buffer_, data, (size_t) msg.size_);
+        msg.size_ = size;
+        msg.data_ = nullptr;
+        if (size <= OSCReceiver::OscMsg::MAX_OSC_MESSAGE_SIZE) {
+            memcpy(msg.buffer_, data, (size_t) size);
+        } else {
+            msg.data_ = pool_.acquire((unsigned) size);
+            if (msg.data_ == nullptr) {
+                LOG_0("KontrolPacketListener : packet too large, dropped " << size);
+                return;
+            }
+            memcpy(msg.data_, data, (size_t) size);
+        }
         queue_.enqueue(msg);
+        auto notify = notify_.load();
+        if (notify) (*notify)();
     }
 
+    void notify(const std::shared_ptr<std::function<void()>> &notify) { notify_.store(notify); }
+
 private:
-    moodycamel::ReaderWriterQueue<OSCReceiver::OscMsg>& queue_;
+    moodycamel::ReaderWriterQueue<OSCReceiver::OscMsg> &queue_;
+    OSCBufferPool &pool_;
+    AtomicShared<std::function<void()>> notify_;
+};
+
+
+enum KontrolMsgType {
+    KM_UNKNOWN,
+    KM_CHUNK,
+    KM_CHANGED,
+    KM_PARAM,
+    KM_PAGE,
+    KM_MODULE,
+    KM_RACK,
+    KM_PING,
+    KM_ACTIVEMODULE,
+    KM_RESOURCE,
+    KM_DELETERACK,
+    KM_ASSIGNMIDICC,
+    KM_UNASSIGNMIDICC,
+    KM_ASSIGNMODULATION,
+    KM_UNASSIGNMODULATION,
+    KM_PUBLISHSTART,
+    KM_PUBLISHRACKFINISHED,
+    KM_SAVEPRESET,
+    KM_LOADPRESET,
+    KM_SAVESETTINGS,
+    KM_LOADMODULE,
+    KM_MIDILEARN,
+    KM_MODULATIONLEARN
+};
+
+struct KontrolMsgDef {
+    const char *address_;
+    KontrolMsgType type_;
+};
+
+static const KontrolMsgDef kontrolMessages[] = {
+        {"/Kontrol/chunk",               KM_CHUNK},
+        {"/Kontrol/changed",             KM_CHANGED},
+        {"/Kontrol/param",               KM_PARAM},
+        {"/Kontrol/page",                KM_PAGE},
+        {"/Kontrol/module",              KM_MODULE},
+        {"/Kontrol/rack",                KM_RACK},
+        {"/Kontrol/ping",                KM_PING},
+        {"/Kontrol/activeModule",        KM_ACTIVEMODULE},
+        {"/Kontrol/resource",            KM_RESOURCE},
+        {"/Kontrol/deleteRack",          KM_DELETERACK},
+        {"/Kontrol/assignMidiCC",        KM_ASSIGNMIDICC},
+        {"/Kontrol/unassignMidiCC",      KM_UNASSIGNMIDICC},
+        {"/Kontrol/assignModulation",    KM_ASSIGNMODULATION},
+        {"/Kontrol/unassignModulation",  KM_UNASSIGNMODULATION},
+        {"/Kontrol/publishStart",        KM_PUBLISHSTART},
+        {"/Kontrol/publishRackFinished", KM_PUBLISHRACKFINISHED},
+        {"/Kontrol/savePreset",          KM_SAVEPRESET},
+        {"/Kontrol/loadPreset",          KM_LOADPRESET},
+        {"/Kontrol/saveSettings",        KM_SAVESETTINGS},
+        {"/Kontrol/loadModule",          KM_LOADMODULE},
+        {"/Kontrol/midiLearn",           KM_MIDILEARN},
+        {"/Kontrol/modulationLearn",     KM_MODULATIONLEARN}
 };
 
+// fnv-1a
+static inline uint32_t hashString(const char *s, uint32_t h = 2166136261u) {
+    while (*s) {
+        h ^= (unsigned char) *s++;
+        h *= 16777619u;
+    }
+    return h;
+}
 
 class KontrolOSCListener : public osc::OscPacketListener {
 public:
-    KontrolOSCListener(OSCReceiver &recv) : receiver_(recv) { ; }
+    KontrolOSCListener(OSCReceiver &recv) : receiver_(recv), paramsSrc_(CS_LOCAL) {
+        for (auto &e : addressTable_) e = nullptr;
+        for (const auto &msg : kontrolMessages) {
+            uint32_t h = hashString(msg.address_);
+            unsigned i = h & (ADDRESS_TABLE_SIZE - 1);
+            while (addressTable_[i] != nullptr) i = (i + 1) & (ADDRESS_TABLE_SIZE - 1);
+            addressTable_[i] = &msg;
+        }
+    }
 
 
     virtual void ProcessMessage(const osc::ReceivedMessage &m,
                                 const IpEndpointName &remoteEndpoint) {
         try {
-            char host[IpEndpointName::ADDRESS_STRING_LENGTH];
-            remoteEndpoint.AddressAsString(host);
-            ChangeSource changedSrc = ChangeSource::createRemoteSource(host, remoteEndpoint.port);
+            receiver_.messageCount_++;
+            Source &source = findSource(remoteEndpoint);
+            const ChangeSource &changedSrc = source.src_;
             // std::err << "received osc message: " << m.AddressPattern() << std::endl;
-            if (std::strcmp(m.AddressPattern(), "/Kontrol/changed") == 0) {
-                osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
-                const char *rackId = (arg++)->AsString();
-                const char *moduleId = (arg++)->AsString();
-                const char *paramId = (arg++)->AsString();
-                if (arg != m.ArgumentsEnd()) {
-                    if (arg->IsString()) {
-                        receiver_.changeParam(changedSrc, rackId, moduleId, paramId,
-                                              ParamValue(std::string(arg->AsString())));
-
-                    } else if (arg->IsFloat()) {
-//                        std::cerr << "changed " << paramId << " : " << arg->AsFloat() << std::endl;
-                        receiver_.changeParam(changedSrc, rackId, moduleId, paramId, ParamValue(arg->AsFloat()));
+            KontrolMsgType type = messageType(m.AddressPattern());
+            if (type != KM_PARAM) flushParams();
+            switch (type) {
+                case KM_CHUNK: {
+                    osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
+                    int id = (arg++)->AsInt32();
+                    unsigned offset = (unsigned) (arg++)->AsInt32();
+                    unsigned total = (unsigned) (arg++)->AsInt32();
+                    const void *data;
+                    osc::osc_bundle_element_size_t size;
+                    (arg++)->AsBlob(data, size);
+                    receiver_.processChunk(remoteEndpoint, id, offset, total, data, (unsigned) size);
+                    break;
+                }
+                case KM_CHANGED: {
+                    osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
+                    const char *rackId = (arg++)->AsString();
+                    const char *moduleId = (arg++)->AsString();
+                    const char *paramId = (arg++)->AsString();
+                    if (arg != m.ArgumentsEnd()) {
+                        if (arg->IsString()) {
+                            receiver_.changeParam(changedSrc, rackId, moduleId, paramId,
+                                                  ParamValue(std::string(arg->AsString())));
+
+                        } else if (arg->IsFloat()) {
+//                            std::cerr << "changed " << paramId << " : " << arg->AsFloat() << std::endl;
+                            changedFloat(changedSrc, rackId, moduleId, paramId, arg->AsFloat());
+                        }
                     }
+                    break;
                 }
+                case KM_PARAM: {
+                    std::vector<ParamValue> params;
+                    osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
+                    const char *rackId = (arg++)->AsString();
+                    const char *moduleId = (arg++)->AsString();
+                    while (arg != m.ArgumentsEnd()) {
+                        if (arg->IsString()) {
+                            params.push_back(ParamValue(std::string(arg->AsString())));
+
+                        } else if (arg->IsFloat()) {
+                            params.push_back(ParamValue(arg->AsFloat()));
+                        }
+                        arg++;
+                    }
 
-            } else if (std::strcmp(m.AddressPattern(), "/Kontrol/param") == 0) {
-                std::vector<ParamValue> params;
-                osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
-                const char *rackId = (arg++)->AsString();
-                const char *moduleId = (arg++)->AsString();
-                while (arg != m.ArgumentsEnd()) {
-                    if (arg->IsString()) {
-                        params.push_back(ParamValue(std::string(arg->AsString())));
-
-                    } else if (arg->IsFloat()) {
-                        params.push_back(ParamValue(arg->AsFloat()));
+                    if (!params_.empty() && (paramsSrc_ != changedSrc || paramsRackId_ != rackId
+                                             || paramsModuleId_ != moduleId)) {
+                        flushParams();
                     }
-                    arg++;
+                    if (params_.empty()) {
+                        paramsSrc_ = changedSrc;
+                        paramsRackId_ = rackId;
+                        paramsModuleId_ = moduleId;
+                    }
+                    params_.push_back(std::move(params));
+                    break;
                 }
+                case KM_PAGE: {
+                    osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
+                    // std::cerr << "received page p1"<< std::endl;
+                    const char *rackId = (arg++)->AsString();
+                    const char *moduleId = (arg++)->AsString();
+                    const char *pageId = (arg++)->AsString();
 
-                receiver_.createParam(changedSrc, rackId, moduleId, params);
-            } else if (std::strcmp(m.AddressPattern(), "/Kontrol/page") == 0) {
-                osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
-                // std::cerr << "received page p1"<< std::endl;
-                const char *rackId = (arg++)->AsString();
-                const char *moduleId = (arg++)->AsString();
-                const char *pageId = (arg++)->AsString();
+                    const char *displayName = (arg++)->AsString();
 
-                const char *displayName = (arg++)->AsString();
+                    std::vector<EntityId> paramIds;
+                    while (arg != m.ArgumentsEnd()) {
+                        paramIds.push_back((arg++)->AsString());
+                    }
 
-                std::vector<EntityId> paramIds;
-                while (arg != m.ArgumentsEnd()) {
-                    paramIds.push_back((arg++)->AsString());
+                    // std::cout << "received page " << id << std::endl;
+                    receiver_.createPage(changedSrc, rackId, moduleId, pageId, displayName, paramIds);
+                    break;
                 }
+                case KM_MODULE: {
+                    osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
+                    const char *rackId = (arg++)->AsString();
+                    const char *moduleId = (arg++)->AsString();
+                    const char *displayName = (arg++)->AsString();
+                    const char *type = (arg++)->AsString();
 
-                // std::cout << "received page " << id << std::endl;
-                receiver_.createPage(changedSrc, rackId, moduleId, pageId, displayName, paramIds);
-            } else if (std::strcmp(m.AddressPattern(), "/Kontrol/module") == 0) {
-                osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
-                const char *rackId = (arg++)->AsString();
-                const char *moduleId = (arg++)->AsString();
-                const char *displayName = (arg++)->AsString();
-                const char *type = (arg++)->AsString();
-
-//                 std::cout << "received module " << moduleId << std::endl;
-                receiver_.createModule(changedSrc, rackId, moduleId, displayName, type);
-            } else if (std::strcmp(m.AddressPattern(), "/Kontrol/rack") == 0) {
-                osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
-                const char *rackId = (arg++)->AsString();
-                const char *host = (arg++)->AsString();
-                unsigned port = (unsigned) (arg++)->AsInt32();
-
-                // std::cout << "received rack " << rackId << std::endl;
-                receiver_.createRack(changedSrc, rackId, host, port);
-            } else if (std::strcmp(m.AddressPattern(), "/Kontrol/ping") == 0) {
-                osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
-                unsigned port = (unsigned) (arg++)->AsInt32();
-                unsigned keepAlive = 0;
-                if (arg != m.ArgumentsEnd()) {
-                    keepAlive = (unsigned) (arg++)->AsInt32();
+//                     std::cout << "received module " << moduleId << std::endl;
+                    receiver_.createModule(changedSrc, rackId, moduleId, displayName, type);
+                    break;
                 }
-                receiver_.ping(changedSrc, std::string(host), port, keepAlive);
-            } else if (std::strcmp(m.AddressPattern(), "/Kontrol/activeModule") == 0) {
+                case KM_RACK: {
+                    osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
+                    const char *rackId = (arg++)->AsString();
+                    const char *host = (arg++)->AsString();
+                    unsigned port = (unsigned) (arg++)->AsInt32();
+
+                    // std::cout << "received rack " << rackId << std::endl;
+                    receiver_.createRack(changedSrc, rackId, host, port);
+                    break;
+                }
+                case KM_PING: {
+                    osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
+                    unsigned port = (unsigned) (arg++)->AsInt32();
+                    unsigned keepAlive = 0;
+                    uint64_t version = 0, lastSeen = 0;
+                    if (arg != m.ArgumentsEnd()) {
+                        keepAlive = (unsigned) (arg++)->AsInt32();
+                    }
+                    // optional, older peers do not send versions
+                    if (arg != m.ArgumentsEnd() && arg->IsInt64()) {
+                        version = (uint64_t) (arg++)->AsInt64();
+                    }
+                    if (arg != m.ArgumentsEnd() && arg->IsInt64()) {
+                        lastSeen = (uint64_t) (arg++)->AsInt64();
+                    }
+                    char host[IpEndpointName::ADDRESS_STRING_LENGTH];
+                    remoteEndpoint.AddressAsString(host);
+                    receiver_.ping(changedSrc, std::string(host), port, keepAlive, version, lastSeen);
+                    break;
+                }
+                case KM_ACTIVEMODULE: {
                     osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
                     const char *rackId = (arg++)->AsString();
                     const char *moduleId = (arg++)->AsString();
 
                     receiver_.activeModule(changedSrc, rackId, moduleId);
-            } else if (std::strcmp(m.AddressPattern(), "/Kontrol/resource") == 0) {
-                osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
-//                 std::cout << "received resource p1"<< std::endl;
-                const char *rackId = (arg++)->AsString();
-                const char *resType = (arg++)->AsString();
-                const char *resValue = (arg++)->AsString();
-
-//                 std::cout << "received resource " << rackId <<  " : " << resType << " : " << resValue << std::endl;
-                receiver_.createResource(changedSrc, rackId, resType, resValue);
-            } else if (std::strcmp(m.AddressPattern(), "/Kontrol/deleteRack") == 0) {
-                osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
-                const char *rackId = (arg++)->AsString();
-
-                receiver_.deleteRack(changedSrc, rackId);
-            } else if (std::strcmp(m.AddressPattern(), "/Kontrol/assignMidiCC") == 0) {
-                osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
-                const char *rackId = (arg++)->AsString();
-                const char *moduleId = (arg++)->AsString();
-                const char *paramId = (arg++)->AsString();
-                unsigned midiCC = (unsigned) (arg++)->AsInt32();
-                receiver_.assignMidiCC(changedSrc, rackId, moduleId, paramId, midiCC);
-            } else if (std::strcmp(m.AddressPattern(), "/Kontrol/unassignMidiCC") == 0) {
-                osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
-                const char *rackId = (arg++)->AsString();
-                const char *moduleId = (arg++)->AsString();
-                const char *paramId = (arg++)->AsString();
-                unsigned midiCC = (unsigned) (arg++)->AsInt32();
-                receiver_.unassignMidiCC(changedSrc, rackId, moduleId, paramId, midiCC);
-            } else if (std::strcmp(m.AddressPattern(), "/Kontrol/assignModulation") == 0) {
-                osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
-                const char *rackId = (arg++)->AsString();
-                const char *moduleId = (arg++)->AsString();
-                const char *paramId = (arg++)->AsString();
-                unsigned bus = (unsigned) (arg++)->AsInt32();
-                receiver_.assignModulation(changedSrc, rackId, moduleId, paramId, bus);
-            } else if (std::strcmp(m.AddressPattern(), "/Kontrol/unassignModulation") == 0) {
-                osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
-                const char *rackId = (arg++)->AsString();
-                const char *moduleId = (arg++)->AsString();
-                const char *paramId = (arg++)->AsString();
-                unsigned bus = (unsigned) (arg++)->AsInt32();
-                receiver_.unassignModulation(changedSrc, rackId, moduleId, paramId, bus);
-            } else if (std::strcmp(m.AddressPattern(), "/Kontrol/publishStart") == 0) {
-                osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
-                auto numRacks = (unsigned)arg->AsInt32();
-                receiver_.publishStart(changedSrc, numRacks);
-            } else if (std::strcmp(m.AddressPattern(), "/Kontrol/publishRackFinished") == 0) {
-                osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
-                const char *rackId = arg->AsString();
-                receiver_.publishRackFinished(changedSrc, rackId);
-            } else if (std::strcmp(m.AddressPattern(), "/Kontrol/savePreset") == 0) {
-                osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
-                const char *rackId = (arg++)->AsString();
-                const char *preset = (arg++)->AsString();
-                receiver_.savePreset(changedSrc, rackId, preset);
-            } else if (std::strcmp(m.AddressPattern(), "/Kontrol/loadPreset") == 0) {
-                osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
-                const char *rackId = (arg++)->AsString();
-                const char *preset = (arg++)->AsString();
-                receiver_.loadPreset(changedSrc, rackId, preset);
-            } else if (std::strcmp(m.AddressPattern(), "/Kontrol/saveSettings") == 0) {
-                osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
-                const char *rackId = (arg++)->AsString();
-                receiver_.saveSettings(changedSrc, rackId);
-            } else if (std::strcmp(m.AddressPattern(), "/Kontrol/loadModule") == 0) {
-                osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
-                const char *rackId = (arg++)->AsString();
-                const char *modId = (arg++)->AsString();
-                const char *modType = (arg++)->AsString();
-                receiver_.loadModule(changedSrc, rackId, modId, modType);
-            } else if (std::strcmp(m.AddressPattern(), "/Kontrol/midiLearn") == 0) {
-                osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
-                bool b = (arg++)->AsBool();
-                receiver_.midiLearn(changedSrc, b);
-            } else if (std::strcmp(m.AddressPattern(), "/Kontrol/modulationLearn") == 0) {
-                osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
-                bool b = (arg++)->AsBool();
-                receiver_.modulationLearn(changedSrc, b);
+                    break;
+                }
+                case KM_RESOURCE: {
+                    osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
+//                     std::cout << "received resource p1"<< std::endl;
+                    const char *rackId = (arg++)->AsString();
+                    const char *resType = (arg++)->AsString();
+                    const char *resValue = (arg++)->AsString();
+
+//                     std::cout << "received resource " << rackId <<  " : " << resType << " : " << resValue << std::endl;
+                    receiver_.createResource(changedSrc, rackId, resType, resValue);
+                    break;
+                }
+                case KM_DELETERACK: {
+                    osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
+                    const char *rackId = (arg++)->AsString();
+
+                    receiver_.deleteRack(changedSrc, rackId);
+                    break;
+                }
+                case KM_ASSIGNMIDICC: {
+                    osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
+                    const char *rackId = (arg++)->AsString();
+                    const char *moduleId = (arg++)->AsString();
+                    const char *paramId = (arg++)->AsString();
+                    unsigned midiCC = (unsigned) (arg++)->AsInt32();
+                    receiver_.assignMidiCC(changedSrc, rackId, moduleId, paramId, midiCC);
+                    break;
+                }
+                case KM_UNASSIGNMIDICC: {
+                    osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
+                    const char *rackId = (arg++)->AsString();
+                    const char *moduleId = (arg++)->AsString();
+                    const char *paramId = (arg++)->AsString();
+                    unsigned midiCC = (unsigned) (arg++)->AsInt32();
+                    receiver_.unassignMidiCC(changedSrc, rackId, moduleId, paramId, midiCC);
+                    break;
+                }
+                case KM_ASSIGNMODULATION: {
+                    osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
+                    const char *rackId = (arg++)->AsString();
+                    const char *moduleId = (arg++)->AsString();
+                    const char *paramId = (arg++)->AsString();
+                    unsigned bus = (unsigned) (arg++)->AsInt32();
+                    receiver_.assignModulation(changedSrc, rackId, moduleId, paramId, bus);
+                    break;
+                }
+                case KM_UNASSIGNMODULATION: {
+                    osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
+                    const char *rackId = (arg++)->AsString();
+                    const char *moduleId = (arg++)->AsString();
+                    const char *paramId = (arg++)->AsString();
+                    unsigned bus = (unsigned) (arg++)->AsInt32();
+                    receiver_.unassignModulation(changedSrc, rackId, moduleId, paramId, bus);
+                    break;
+                }
+                case KM_PUBLISHSTART: {
+                    osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
+                    auto numRacks = (unsigned) (arg++)->AsInt32();
+                    // optional, older peers do not version publishes, so are never acknowledged
+                    source.publishVersion_ = 0;
+                    if (arg != m.ArgumentsEnd() && arg->IsInt64()) {
+                        source.publishVersion_ = (uint64_t) (arg++)->AsInt64();
+                    }
+                    source.racksLeft_ = numRacks;
+                    source.received_ = -1; // this packet is counted once processed
+                    receiver_.publishStart(changedSrc, numRacks);
+                    break;
+                }
+                case KM_PUBLISHRACKFINISHED: {
+                    osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
+                    const char *rackId = (arg++)->AsString();
+                    // packets sent since publish start, if any were lost the publish is incomplete
+                    int sent = -1;
+                    if (arg != m.ArgumentsEnd() && arg->IsInt32()) {
+                        sent = (arg++)->AsInt32();
+                    }
+                    if (sent != source.received_) source.publishVersion_ = 0;
+                    receiver_.publishRackFinished(changedSrc, rackId);
+                    if (source.racksLeft_ > 0 && --source.racksLeft_ == 0 && source.publishVersion_ > 0) {
+                        receiver_.published(changedSrc, source.publishVersion_);
+                    }
+                    break;
+                }
+                case KM_SAVEPRESET: {
+                    osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
+                    const char *rackId = (arg++)->AsString();
+                    const char *preset = (arg++)->AsString();
+                    receiver_.savePreset(changedSrc, rackId, preset);
+                    break;
+                }
+                case KM_LOADPRESET: {
+                    osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
+                    const char *rackId = (arg++)->AsString();
+                    const char *preset = (arg++)->AsString();
+                    receiver_.loadPreset(changedSrc, rackId, preset);
+                    break;
+                }
+                case KM_SAVESETTINGS: {
+                    osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
+                    const char *rackId = (arg++)->AsString();
+                    receiver_.saveSettings(changedSrc, rackId);
+                    break;
+                }
+                case KM_LOADMODULE: {
+                    osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
+                    const char *rackId = (arg++)->AsString();
+                    const char *modId = (arg++)->AsString();
+                    const char *modType = (arg++)->AsString();
+                    receiver_.loadModule(changedSrc, rackId, modId, modType);
+                    break;
+                }
+                case KM_MIDILEARN: {
+                    osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
+                    bool b = (arg++)->AsBool();
+                    receiver_.midiLearn(changedSrc, b);
+                    break;
+                }
+                case KM_MODULATIONLEARN: {
+                    osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin();
+                    bool b = (arg++)->AsBool();
+                    receiver_.modulationLearn(changedSrc, b);
+                    break;
+                }
+                default:
+                    break;
             }
         } catch (osc::Exception &e) {
             // std::err << "error while parsing message: "
@@ -212,13 +393,98 @@ public:
         }
     }
 
+    // params of a module arrive one per message, and are created together once another message
+    // arrives or the queue is drained, so the module is updated once rather than for each param
+    void flushParams() {
+        if (params_.empty()) return;
+        receiver_.createParams(paramsSrc_, paramsRackId_, paramsModuleId_, params_);
+        params_.clear();
+    }
+
 private:
+    static const unsigned ADDRESS_TABLE_SIZE = 64; // power of 2, > 2 * number of messages
+    static const unsigned CHANGED_CACHE_SIZE = 256; // power of 2
+
+    KontrolMsgType messageType(const char *address) const {
+        unsigned i = hashString(address) & (ADDRESS_TABLE_SIZE - 1);
+        while (addressTable_[i] != nullptr) {
+            if (std::strcmp(addressTable_[i]->address_, address) == 0) return addressTable_[i]->type_;
+            i = (i + 1) & (ADDRESS_TABLE_SIZE - 1);
+        }
+        return KM_UNKNOWN;
+    }
+
+    // packets from a source are counted during its publish, to check none were lost
+    virtual void ProcessBundle(const osc::ReceivedBundle &b, const IpEndpointName &remoteEndpoint) {
+        osc::OscPacketListener::ProcessBundle(b, remoteEndpoint);
+        Source &source = findSource(remoteEndpoint);
+        if (source.racksLeft_ > 0) source.received_++;
+    }
+
+    struct Source {
+        Source(const IpEndpointName &endpoint, const ChangeSource &src) :
+                endpoint_(endpoint), src_(src), publishVersion_(0), racksLeft_(0), received_(0) { ; }
+
+        IpEndpointName endpoint_;
+        ChangeSource src_;
+        uint64_t publishVersion_; // of the publish in progress, 0 once a packet is lost
+        unsigned racksLeft_;
+        int received_;
+    };
+
+    Source &findSource(const IpEndpointName &endpoint) {
+        for (auto &s : sources_) {
+            if (s.endpoint_ == endpoint) return s;
+        }
+        char host[IpEndpointName::ADDRESS_STRING_LENGTH];
+        endpoint.AddressAsString(host);
+        sources_.push_back(Source(endpoint, ChangeSource::createRemoteSource(host, endpoint.port)));
+        return sources_.back();
+    }
+
+    // float changes are resolved to a param handle once, then applied without string lookups or allocation
+    void changedFloat(const ChangeSource &src, const char *rackId, const char *moduleId, const char *paramId,
+                      float value) {
+        uint32_t h = hashString(paramId, hashString(moduleId, hashString(rackId)));
+        ChangedCacheEntry &e = changedCache_[h & (CHANGED_CACHE_SIZE - 1)];
+        if (e.hash_ != h || e.paramId_ != paramId || e.moduleId_ != moduleId || e.rackId_ != rackId) {
+            e.hash_ = h;
+            e.rackId_ = rackId;
+            e.moduleId_ = moduleId;
+            e.paramId_ = paramId;
+            e.handle_ = receiver_.paramHandle(e.rackId_, e.moduleId_, e.paramId_);
+        }
+        if (e.handle_.valid() && receiver_.changeParam(src, e.handle_, ParamValue(value))) return;
+
+        // stale handle, param or module may have been recreated
+        e.handle_ = receiver_.paramHandle(e.rackId_, e.moduleId_, e.paramId_);
+        if (e.handle_.valid()) receiver_.changeParam(src, e.handle_, ParamValue(value));
+    }
+
+    struct ChangedCacheEntry {
+        ChangedCacheEntry() : hash_(0), handle_(ParamHandle::invalid()) { ; }
+
+        uint32_t hash_;
+        EntityId rackId_;
+        EntityId moduleId_;
+        EntityId paramId_;
+        ParamHandle handle_;
+    };
+
     OSCReceiver &receiver_;
+    const KontrolMsgDef *addressTable_[ADDRESS_TABLE_SIZE];
+    std::vector<Source> sources_;
+    ChangedCacheEntry changedCache_[CHANGED_CACHE_SIZE];
+    ChangeSource paramsSrc_;
+    EntityId paramsRackId_;
+    EntityId paramsModuleId_;
+    std::vector<std::vector<ParamValue>> params_;
 };
 
 OSCReceiver::OSCReceiver(const std::shared_ptr<KontrolModel> &param)
-        : model_(param), port_(0), messageQueue_(OscMsg::MAX_N_OSC_MSGS) {
-    packetListener_ = std::make_shared<KontrolPacketListener>(messageQueue_);
+        : model_(param), port_(0), messageQueue_(OscMsg::MAX_N_OSC_MSGS),
+          processingChunked_(false), messageCount_(0) {
+    packetListener_ = std::make_shared<KontrolPacketListener>(messageQueue_, bufferPool_);
     oscListener_ = std::make_shared<KontrolOSCListener>(*this);
 }
 
@@ -233,8 +499,20 @@ void *osc_receiver_read_thread_func(void *pReceiver) {
 }
 
 bool OSCReceiver::listen(unsigned port) {
+    return listen(port, nullptr);
+}
+
+bool OSCReceiver::listen(unsigned port, const std::shared_ptr<OSCReactor> &reactor) {
     stop();
     port_ = port;
+    if (reactor && reactor->isRunning()) {
+        if (!reactor->addListener(port_, packetListener_.get())) {
+            port_ = 0;
+            return false;
+        }
+        reactor_ = reactor;
+        return true;
+    }
     try {
         socket_ = std::make_shared<UdpListeningReceiveSocket>(
                 IpEndpointName(IpEndpointName::ANY_ADDRESS, port_),
@@ -248,20 +526,99 @@ bool OSCReceiver::listen(unsigned port) {
 }
 
 void OSCReceiver::stop() {
-    if (socket_) {
+    if (reactor_) {
+        reactor_->removeListener(packetListener_.get());
+        reactor_.reset();
+    } else if (socket_) {
         socket_->AsynchronousBreak();
         receive_thread_.join();
+    }
+    {
         OscMsg msg;
-        while(messageQueue_.try_dequeue(msg));
+        while (messageQueue_.try_dequeue(msg)) {
+            releaseMsg(msg);
+        }
+        chunkedPackets_.clear();
     }
     port_ = 0;
     socket_.reset();
 }
 
+void OSCReceiver::readyNotify(std::function<void()> notify) {
+    auto listener = std::static_pointer_cast<KontrolPacketListener>(packetListener_);
+    listener->notify(notify ? std::make_shared<std::function<void()>>(std::move(notify)) : nullptr);
+}
+
 void OSCReceiver::poll() {
     OscMsg msg;
     while (messageQueue_.try_dequeue(msg)) {
-        oscListener_->ProcessPacket(msg.buffer_, msg.size_, msg.origin_);
+        oscListener_->ProcessPacket(msg.data(), msg.size_, msg.origin_);
+        releaseMsg(msg);
+    }
+    oscListener_->flushParams();
+}
+
+void OSCReceiver::releaseMsg(OscMsg &msg) {
+    if (msg.data_) {
+        bufferPool_.release(msg.data_, (unsigned) msg.size_);
+        msg.data_ = nullptr;
+    }
+}
+
+void OSCReceiver::processChunk(const IpEndpointName &origin, int id, unsigned offset, unsigned total,
+                               const void *data, unsigned size) {
+    if (total > OSCBufferPool::MAX_BUFFER_SIZE || size == 0 || offset + size > total) return;
+    if (processingChunked_) {
+        // chunks are never nested by the sender, so this is malformed (or hostile)
+        LOG_1("OSCReceiver::processChunk : ignoring chunk within a reassembled packet");
+        return;
+    }
+
+    ChunkedPacket *packet = nullptr;
+    for (auto &p : chunkedPackets_) {
+        if (p.origin_ == origin) {
+            packet = &p;
+            break;
+        }
+    }
+    if (packet == nullptr) {
+        chunkedPackets_.push_back(ChunkedPacket());
+        packet = &chunkedPackets_.back();
+        packet->origin_ = origin;
+        packet->id_ = id - 1;
+    }
+
+    if (packet->id_ != id) {
+        // new packet from this sender, anything incomplete is lost
+        packet->id_ = id;
+        packet->received_ = 0;
+        packet->buffer_.resize(total);
+        packet->arrived_.assign(total, false);
+    }
+    if (packet->buffer_.size() != total) return;
+
+    // a duplicated chunk must not count towards completion
+    if (packet->arrived_[offset]) return;
+    packet->arrived_[offset] = true;
+
+    memcpy(packet->buffer_.data() + offset, data, size);
+    packet->received_ += size;
+    if (packet->received_ == total) {
+        // taken out of the entry before processing, so nothing it contains can touch the buffer.
+        // the entry keeps only its id, a late duplicate then fails the size check rather than restarting
+        std::vector<char> buffer;
+        buffer.swap(packet->buffer_);
+        std::vector<bool>().swap(packet->arrived_);
+        packet->received_ = 0;
+
+        processingChunked_ = true;
+        try {
+            oscListener_->ProcessPacket(buffer.data(), (int) total, origin);
+        } catch (...) {
+            processingChunked_ = false;
+            throw;
+        }
+        processingChunked_ = false;
     }
 }
 
@@ -293,6 +650,14 @@ void OSCReceiver::createParam(
     model_->createParam(src, rackId, moduleId, args);
 }
 
+void OSCReceiver::createParams(
+        ChangeSource src,
+        const EntityId &rackId,
+        const EntityId &moduleId,
+        const std::vector<std::vector<ParamValue>> &args) const {
+    model_->createParams(src, rackId, moduleId, args);
+}
+
 void OSCReceiver::changeParam(
         ChangeSource src,
         const EntityId &rackId,
@@ -302,6 +667,16 @@ void OSCReceiver::changeParam(
     model_->changeParam(src, rackId, moduleId, paramId, f);
 }
 
+ParamHandle OSCReceiver::paramHandle(const EntityId &rackId,
+                                     const EntityId &moduleId,
+                                     const EntityId &paramId) const {
+    return model_->getParamHandle(rackId, moduleId, paramId);
+}
+
+bool OSCReceiver::changeParam(ChangeSource src, const ParamHandle &handle, ParamValue v) const {
+    return model_->changeParam(src, handle, v) != nullptr;
+}
+
 void OSCReceiver::createPage(
         ChangeSource src,
         const EntityId &rackId,
@@ -329,8 +704,10 @@ void OSCReceiver::deleteRack(ChangeSource src, const EntityId & rackId)
 void OSCReceiver::ping(ChangeSource src,
                        const std::string &host,
                        unsigned port,
-                       unsigned keepalive) {
-    model_->ping(src, host, port, keepalive);
+                       unsigned keepalive,
+                       uint64_t version,
+                       uint64_t lastSeen) {
+    model_->ping(src, host, port, keepalive, version, lastSeen);
 }
 
 void OSCReceiver::activeModule(ChangeSource src,
@@ -368,6 +745,10 @@ void OSCReceiver::publishRackFinished(ChangeSource src, const EntityId & rackId)
     model_->publishRackFinished(src, rackId);
 }
 
+void OSCReceiver::published(ChangeSource src, uint64_t version) {
+    model_->published(src, version);
+}
+
 void OSCReceiver::savePreset(ChangeSource src, const EntityId &rackId, std::string preset) {
     model_->savePreset(src, rackId, preset);
 }
@@ -1,8 +1,12 @@
 #pragma once
 
 #include "KontrolModel.h"
+#include "OSCBufferPool.h"
+#include "OSCReactor.h"
 #include <thread>
 #include <memory>
+#include <vector>
+#include <functional>
 
 #include <ip/UdpSocket.h>
 #include <readerwriterqueue.h>
@@ -20,7 +24,12 @@ public:
     OSCReceiver(const std::shared_ptr<KontrolModel> &param);
     ~OSCReceiver();
     bool listen(unsigned port = 9000);
+    // packets are received by the reactor thread if it is running, rather than a receive thread
+    bool listen(unsigned port, const std::shared_ptr<OSCReactor> &reactor);
     void poll();
+    // called on the receiving thread when a packet is queued, so poll can be
+    // scheduled when there is input, rather than called periodically
+    void readyNotify(std::function<void()> notify);
 
     void stop();
 
@@ -46,6 +55,13 @@ public:
             const std::vector<ParamValue> &args
     ) const;
 
+    void createParams(
+            ChangeSource src,
+            const EntityId &rackId,
+            const EntityId &moduleId,
+            const std::vector<std::vector<ParamValue>> &args
+    ) const;
+
     void createPage(
             ChangeSource src,
             const EntityId &rackId,
@@ -62,6 +78,10 @@ public:
             const EntityId &paramId,
             ParamValue v) const;
 
+    // handle based change, see KontrolModel::getParamHandle
+    ParamHandle paramHandle(const EntityId &rackId, const EntityId &moduleId, const EntityId &paramId) const;
+    bool changeParam(ChangeSource src, const ParamHandle &handle, ParamValue v) const;
+
     void createResource(ChangeSource src,
                         const EntityId &rackId,
                         const std::string &resType,
@@ -74,7 +94,8 @@ public:
                         const EntityId &rackId,
                         const EntityId &moduleId);
 
-    void ping(ChangeSource src, const std::string &host, unsigned port, unsigned keepalive);
+    void ping(ChangeSource src, const std::string &host, unsigned port, unsigned keepalive,
+              uint64_t version, uint64_t lastSeen);
 
     void assignMidiCC(ChangeSource src,
                       const EntityId &rackId,
@@ -101,6 +122,7 @@ public:
 
     void publishStart(ChangeSource src, unsigned numRacks);
     void publishRackFinished(ChangeSource src, const EntityId &rackId);
+    void published(ChangeSource src, uint64_t version);
 
     void savePreset(ChangeSource src,
                       const EntityId &rackId,
@@ -120,26 +142,51 @@ public:
 
     unsigned int port() { return port_; }
 
+    // messages processed since creation, for throughput measurement
+    unsigned long messageCount() const { return messageCount_; }
+
     std::shared_ptr<UdpListeningReceiveSocket> socket() { return socket_; }
 
 private:
     friend class KontrolPacketListener;
+    friend class KontrolOSCListener;
 
     struct OscMsg {
         static const int MAX_N_OSC_MSGS = 128;
         static const int MAX_OSC_MESSAGE_SIZE = 512;
         IpEndpointName origin_;
         int size_;
+        char *data_; // pooled buffer if larger than MAX_OSC_MESSAGE_SIZE
         char buffer_[MAX_OSC_MESSAGE_SIZE];
+
+        const char *data() const { return data_ ? data_ : buffer_; }
+    };
+
+    // reassembly of /Kontrol/chunk messages, per sender
+    struct ChunkedPacket {
+        IpEndpointName origin_;
+        int id_;
+        unsigned received_;
+        std::vector<char> buffer_;
+        std::vector<bool> arrived_; // by chunk offset, chunks are sent at fixed offsets
     };
 
+    void processChunk(const IpEndpointName &origin, int id, unsigned offset, unsigned total,
+                      const void *data, unsigned size);
+    void releaseMsg(OscMsg &msg);
+
     std::shared_ptr<KontrolModel> model_;
     unsigned int port_;
     std::thread receive_thread_;
     std::shared_ptr<UdpListeningReceiveSocket> socket_;
+    std::shared_ptr<OSCReactor> reactor_;
     std::shared_ptr<PacketListener> packetListener_;
     std::shared_ptr<KontrolOSCListener> oscListener_;
     moodycamel::ReaderWriterQueue<OscMsg> messageQueue_;
+    OSCBufferPool bufferPool_;
+    std::vector<ChunkedPacket> chunkedPackets_;
+    bool processingChunked_; // chunks are rejected while a reassembled packet is processed
+    unsigned long messageCount_;
 };
 
 } //namespace
\ No newline at end of file
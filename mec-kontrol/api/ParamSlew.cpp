@@ -0,0 +1,109 @@
+#include "ParamSlew.h"
+
+#include <cmath>
+
+namespace Kontrol {
+
+ParamSlew::ParamSlew() {
+    for (unsigned i = 0; i < NUM_TYPES; i++) slewTimes_[i] = 0.0f;
+}
+
+void ParamSlew::slewTime(ParameterType type, float ms) {
+    if ((unsigned) type >= NUM_TYPES) return;
+    switch (type) {
+        // only continuous values are smoothed
+        case PT_Invalid:
+        case PT_Boolean:
+        case PT_Int:
+        case PT_Pitch:
+            return;
+        default:
+            slewTimes_[type] = ms > 0.0f ? ms : 0.0f;
+            break;
+    }
+}
+
+float ParamSlew::slewTime(ParameterType type) const {
+    return (unsigned) type < NUM_TYPES ? slewTimes_[type] : 0.0f;
+}
+
+void ParamSlew::target(unsigned idx, ParameterType type, float current, float target, ChangeSource src) {
+    float ms = slewTime(type);
+    // exponential needs positive values
+    bool exponential = type == PT_Frequency && current > 0.0f && target > 0.0f;
+
+    unsigned slot;
+    auto i = slots_.find(idx);
+    if (i != slots_.end()) {
+        slot = i->second;
+        // continue from where it has got to
+        if (curve_[slot] == SC_EXPONENTIAL) current = std::exp(value_[slot]);
+        else current = value_[slot];
+        exponential &= current > 0.0f;
+        src_[slot] = src;
+    } else {
+        slot = paramIdx_.size();
+        slots_[idx] = slot;
+        paramIdx_.push_back(idx);
+        value_.push_back(0.0f);
+        target_.push_back(0.0f);
+        rate_.push_back(0.0f);
+        curve_.push_back(SC_LINEAR);
+        done_.push_back(0);
+        src_.push_back(src);
+    }
+
+    if (exponential) {
+        curve_[slot] = SC_EXPONENTIAL;
+        value_[slot] = std::log(current);
+        target_[slot] = std::log(target);
+        // time constant, so it is done by slew time
+        float d = std::fabs(target_[slot] - value_[slot]);
+        rate_[slot] = d > EXP_DONE ? ms / std::log(d / EXP_DONE) : ms;
+    } else {
+        curve_[slot] = SC_LINEAR;
+        value_[slot] = current;
+        target_[slot] = target;
+        rate_[slot] = std::fabs(target - current) / ms;
+    }
+}
+
+void ParamSlew::cancel(unsigned idx) {
+    auto i = slots_.find(idx);
+    if (i != slots_.end()) remove(i->second);
+}
+
+void ParamSlew::clear() {
+    paramIdx_.clear();
+    value_.clear();
+    target_.clear();
+    rate_.clear();
+    curve_.clear();
+    done_.clear();
+    src_.clear();
+    slots_.clear();
+}
+
+void ParamSlew::remove(unsigned slot) {
+    unsigned last = paramIdx_.size() - 1;
+    slots_.erase(paramIdx_[slot]);
+    if (slot != last) {
+        paramIdx_[slot] = paramIdx_[last];
+        value_[slot] = value_[last];
+        target_[slot] = target_[last];
+        rate_[slot] = rate_[last];
+        curve_[slot] = curve_[last];
+        done_[slot] = done_[last];
+        src_[slot] = src_[last];
+        slots_[paramIdx_[slot]] = slot;
+    }
+    paramIdx_.pop_back();
+    value_.pop_back();
+    target_.pop_back();
+    rate_.pop_back();
+    curve_.pop_back();
+    done_.pop_back();
+    src_.pop_back();
+}
+
+} //namespace
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "Parameter.h"
+#include "ChangeSource.h"
+
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace Kontrol {
+
+// smoothing of control rate changes for a module's params, to avoid zipper noise from jumps.
+// a change sets a target, params then move towards it as process is called (at control rate),
+// frequency exponentially (in log space), other float types linearly, over the slew time for their type.
+// not thread safe, used by the model owner, see KontrolModel::processSlew
+class ParamSlew {
+public:
+    ParamSlew();
+
+    // ms to reach target, 0 = not smoothed (default)
+    void slewTime(ParameterType type, float ms);
+    float slewTime(ParameterType type) const;
+    bool isSmoothed(ParameterType type) const { return slewTime(type) > 0.0f; }
+
+    // start (or retarget) smoothing of param idx, from current value
+    void target(unsigned idx, ParameterType type, float current, float target, ChangeSource src);
+    void cancel(unsigned idx);
+    // cancel all, e.g. as param indexes are redefined
+    void clear();
+
+    bool active() const { return !paramIdx_.empty(); }
+
+    // advance all params by elapsed ms, f(idx, value, src) called for each,
+    // params that reach their target are then removed
+    template<typename F>
+    void process(float elapsedMs, F f);
+
+private:
+    enum Curve : uint8_t {
+        SC_LINEAR,
+        SC_EXPONENTIAL
+    };
+
+    static constexpr unsigned NUM_TYPES = PT_Pan + 1;
+    // exponential is done when within 0.1% (in log space)
+    static constexpr float EXP_DONE = 0.001f;
+    float slewTimes_[NUM_TYPES];
+
+    void remove(unsigned slot);
+
+    // one slot per smoothed param, contiguous so process is a single pass
+    std::vector<unsigned> paramIdx_;
+    std::vector<float> value_; // log for SC_EXPONENTIAL
+    std::vector<float> target_;
+    std::vector<float> rate_; // units per ms, or time constant (ms) for SC_EXPONENTIAL
+    std::vector<uint8_t> curve_;
+    std::vector<uint8_t> done_;
+    std::vector<ChangeSource> src_;
+    std::unordered_map<unsigned, unsigned> slots_; // param idx -> slot
+};
+
+template<typename F>
+void ParamSlew::process(float elapsedMs, F f) {
+    unsigned n = paramIdx_.size();
+    for (unsigned s = 0; s < n; s++) {
+        float v = value_[s];
+        float t = target_[s];
+        if (curve_[s] == SC_EXPONENTIAL) {
+            v = t + (v - t) * std::exp(-elapsedMs / rate_[s]);
+            done_[s] = std::fabs(v - t) < EXP_DONE;
+        } else {
+            float step = rate_[s] * elapsedMs;
+            float d = t - v;
+            done_[s] = std::fabs(d) <= step;
+            v = v + (d > 0 ? step : -step);
+        }
+        value_[s] = done_[s] ? t : v;
+    }
+
+    for (unsigned s = 0; s < n; s++) {
+        float v = curve_[s] == SC_EXPONENTIAL ? std::exp(value_[s]) : value_[s];
+        f(paramIdx_[s], v, src_[s]);
+    }
+
+    for (unsigned s = n; s > 0; s--) {
+        if (done_[s - 1]) remove(s - 1);
+    }
+}
+
+} //namespace
@@ -39,7 +39,7 @@ bool operator==(const ParamValue &lhs, const ParamValue &rhs) {
             return lhs.floatValue() == rhs.floatValue();
         }
         case ParamValue::T_String:
-            return lhs.stringValue() == rhs.stringValue();
+            return lhs.sameString(rhs) || lhs.stringValue() == rhs.stringValue();
         default:;
     }
     return lhs.stringValue() == rhs.stringValue();
@@ -2,11 +2,14 @@
 
 #include <string>
 #include <limits>
+#include <memory>
 
 static const float PV_INITVALUE=std::numeric_limits<float>::max();
 
 namespace Kontrol {
 
+// numeric values are held inline, so copies/compares never touch the heap.
+// strings are immutable and shared by reference, copying only bumps a refcount
 class ParamValue {
 public:
     enum Type {
@@ -14,26 +17,29 @@ public:
         T_String
     };
 
-    ParamValue(const ParamValue& p) : type_(p.type_), strValue_(p.strValue_), floatValue_(p.floatValue_) {;}
-    ParamValue& operator=(const ParamValue& p)  {
-        type_ = p.type_;
-        strValue_ = p.strValue_;
-        floatValue_ = p.floatValue_;
-        return *this;
-    }
+    ParamValue() : type_(T_Float), floatValue_(PV_INITVALUE) {;}
+    ParamValue(float value) : type_(T_Float), floatValue_(value) {;}
+    ParamValue(const char* value) :
+        type_(T_String), floatValue_(PV_INITVALUE), strValue_(std::make_shared<const std::string>(value)) {;}
+    ParamValue(const std::string& value) :
+        type_(T_String), floatValue_(PV_INITVALUE), strValue_(std::make_shared<const std::string>(value)) {;}
 
-    ParamValue() { type_ = T_Float; floatValue_ = PV_INITVALUE; strValue_ = "";}
-    ParamValue(const char* value) { type_ = T_String; strValue_ = value; floatValue_ = PV_INITVALUE;}
-    ParamValue(const std::string& value) { type_ = T_String; strValue_ = value; floatValue_ = PV_INITVALUE; }
-    ParamValue(float value) { type_ = T_Float; floatValue_ = value; strValue_ = "";}
     Type type() const { return type_;}
-    const std::string& stringValue() const {return strValue_;}
+    const std::string& stringValue() const {return strValue_ ? *strValue_ : emptyString();}
     float  floatValue() const {return floatValue_;}
 
+    // same underlying string, without comparing content
+    bool sameString(const ParamValue& p) const { return strValue_ == p.strValue_;}
+
 private:
+    static const std::string& emptyString() {
+        static const std::string empty;
+        return empty;
+    }
+
     Type type_;
-    std::string strValue_;
     float floatValue_;
+    std::shared_ptr<const std::string> strValue_;
 };
 
 
@@ -15,10 +15,17 @@ static void throwError(const std::string &id, const char *what) {
 
 
 // Parameter : type id displayname
-Parameter::Parameter(ParameterType type) : Entity("", ""), type_(type), current_(PV_INITVALUE) {
+Parameter::Parameter(ParameterType type) : Entity("", ""), type_(type), currentFloat_(PV_INITVALUE),
+                                           midiTable_(nullptr), midiTableHiRes_(nullptr),
+                                           linear_(false), linearMin_(0.0f), linearMax_(0.0f) {
     ;
 }
 
+Parameter::~Parameter() {
+    delete[] midiTable_.load();
+    delete[] midiTableHiRes_.load();
+}
+
 void Parameter::init(const std::vector<ParamValue> &args, unsigned &pos) {
     if (args.size() > pos && args[pos].type() == ParamValue::T_String) id_ = args[pos++].stringValue();
     else
@@ -37,6 +44,18 @@ static const char *PTS_Time = "time";
 static const char *PTS_Pitch = "pitch";
 static const char *PTS_Pan = "pan";
 
+ParameterType Parameter::typeFromString(const std::string &t) {
+    if (t == PTS_Float) return PT_Float;
+    else if (t == PTS_Int) return PT_Int;
+    else if (t == PTS_Boolean) return PT_Boolean;
+    else if (t == PTS_Percent) return PT_Percent;
+    else if (t == PTS_Frequency) return PT_Frequency;
+    else if (t == PTS_Time) return PT_Time;
+    else if (t == PTS_Pitch) return PT_Pitch;
+    else if (t == PTS_Pan) return PT_Pan;
+    return PT_Invalid;
+}
+
 std::shared_ptr<Parameter> createParameter(const std::string &t) {
     if (t == PTS_Float) return std::make_shared<Parameter_Float>(PT_Float);
     else if (t == PTS_Int) return std::make_shared<Parameter_Int>(PT_Int);
@@ -95,7 +114,10 @@ std::shared_ptr<Parameter> Parameter::create(const std::vector<ParamValue> &args
 
     if (args.size() > pos && args[pos].type() == ParamValue::T_String) p = createParameter(args[pos++].stringValue());
     try {
-        if (p->type() != PT_Invalid) p->init(args, pos);
+        if (p->type() != PT_Invalid) {
+            p->init(args, pos);
+            p->compile();
+        }
     } catch (const std::runtime_error &e) {
         // perhaps report here why
         std::cerr << "error: " << e.what() << std::endl;
@@ -118,26 +140,26 @@ const std::string &Parameter::displayUnit() const {
 
 
 ParamValue Parameter::calcRelative(float f) {
-    switch (current_.type()) {
+    switch (current().type()) {
         case ParamValue::T_Float : {
-            float v = current_.floatValue() + f;
+            float v = currentFloat() + f;
             return calcFloat(v);
         }
         case ParamValue::T_String:
         default:;
     }
-    return current_;
+    return current();
 }
 
 ParamValue Parameter::calcFloat(float f) {
-    switch (current_.type()) {
+    switch (current().type()) {
         case ParamValue::T_Float : {
             return ParamValue(f);
         }
         case ParamValue::T_String:
         default:;
     }
-    return current_;
+    return current();
 }
 
 ParamValue Parameter::calcMinimum() const {
@@ -148,9 +170,69 @@ ParamValue Parameter::calcMaximum() const {
     return ParamValue();
 }
 
-ParamValue Parameter::calcMidi(int midi) {
-    float f = (float) midi / 127.0f;
-    return calcFloat(f);
+// normalise a midi value of given bit resolution to 0..1
+static inline float midiToFloat(int midi, unsigned bits) {
+    float f = (float) midi / (float) ((1 << bits) - 1);
+    f = std::max(f, 0.0f);
+    f = std::min(f, 1.0f);
+    return f;
+}
+
+ParamValue Parameter::calcMidi(int midi, unsigned bits) {
+    return calcFloat(midiToFloat(midi, bits));
+}
+
+// lookups are only rebuilt when the definition changes, i.e. on init
+// before the parameter is shared, so only the lazy 14 bit table is built concurrently
+void Parameter::compile() {
+    delete[] midiTable_.exchange(nullptr);
+    delete[] midiTableHiRes_.exchange(nullptr);
+    linear_ = linearRange(linearMin_, linearMax_);
+    midiTable_.store(buildMidiTable(MIDI_TABLE_BITS));
+}
+
+const float *Parameter::buildMidiTable(unsigned bits) {
+    if (calcMidi(0, bits).type() != ParamValue::T_Float) return nullptr;
+    unsigned n = 1u << bits;
+    float *table = new float[n];
+    for (unsigned i = 0; i < n; i++) {
+        table[i] = calcMidi(i, bits).floatValue();
+    }
+    return table;
+}
+
+ParamValue Parameter::midiValue(int midi, unsigned bits) {
+    const float *table = nullptr;
+    if (bits == MIDI_TABLE_BITS) {
+        table = midiTable_.load(std::memory_order_acquire);
+    } else if (bits == MIDI_TABLE_BITS_HIRES) {
+        table = midiTableHiRes_.load(std::memory_order_acquire);
+        if (table == nullptr && midiTable_.load(std::memory_order_acquire) != nullptr) {
+            // first use, if another thread beat us to it, use theirs
+            const float *expected = nullptr;
+            const float *built = buildMidiTable(bits);
+            if (midiTableHiRes_.compare_exchange_strong(expected, built, std::memory_order_acq_rel)) {
+                table = built;
+            } else {
+                delete[] built;
+                table = expected;
+            }
+        }
+    }
+    if (table == nullptr) return calcMidi(midi, bits);
+
+    int top = (1 << bits) - 1;
+    midi = std::max(midi, 0);
+    midi = std::min(midi, top);
+    return ParamValue(table[midi]);
+}
+
+ParamValue Parameter::normalisedValue(float f) {
+    if (!linear_) return calcFloat(f);
+    float v = (f * (linearMax_ - linearMin_)) + linearMin_;
+    v = std::max(v, linearMin_);
+    v = std::min(v, linearMax_);
+    return ParamValue(v);
 }
 
 float Parameter::asFloat(const ParamValue& pv) const {
@@ -160,9 +242,11 @@ float Parameter::asFloat(const ParamValue& pv) const {
     return v;
 }
 
+// all parameter types are numeric, so the value is held as a single atomic float
 bool Parameter::change(const ParamValue &c, bool force) {
-    if (force || current_ != c) {
-        current_ = c;
+    if (c.type() != ParamValue::T_Float) return false;
+    if (force || currentFloat() != c.floatValue()) {
+        currentFloat_.store(c.floatValue(), std::memory_order_relaxed);
         return true;
     }
     return false;
@@ -211,22 +295,23 @@ void Parameter_Float::createArgs(std::vector<ParamValue> &args) const {
 
 std::string Parameter_Float::displayValue() const {
     char numbuf[11];
-    snprintf(numbuf,11, "%.1f", current_.floatValue());
+    snprintf(numbuf,11, "%.1f", currentFloat());
     return std::string(numbuf);
 }
 
 
 // Parameter_Float can assume float value
 ParamValue Parameter_Float::calcRelative(float f) {
-    float v = current().floatValue() + (f * (max() - min()));
+    float v = currentFloat() + (f * (max() - min()));
     v = std::max(v, min());
     v = std::min(v, max());
     return ParamValue(v);
 }
 
-ParamValue Parameter_Float::calcMidi(int midi) {
-    float f = (float) midi / 127.0f;
-    return calcFloat(f);
+bool Parameter_Float::linearRange(float &min, float &max) const {
+    min = min_;
+    max = max_;
+    return true;
 }
 
 ParamValue Parameter_Float::calcFloat(float f) {
@@ -252,7 +337,7 @@ float Parameter_Float::asFloat(const ParamValue& v) const {
 
 
 bool Parameter_Float::change(const ParamValue &c, bool force) {
-    switch (current_.type()) {
+    switch (current().type()) {
         case ParamValue::T_Float  : {
             float v = c.floatValue();
             v = std::max(v, min());
@@ -272,7 +357,7 @@ Parameter_Boolean::Parameter_Boolean(ParameterType type) : Parameter(type) {
 
 
 std::string Parameter_Boolean::displayValue() const {
-    if (current_.floatValue() > 0.5) {
+    if (currentFloat() > 0.5) {
         return "on";
     } else {
         return "off";
@@ -294,7 +379,7 @@ void Parameter_Boolean::createArgs(std::vector<ParamValue> &args) const {
 }
 
 bool Parameter_Boolean::change(const ParamValue &c, bool force) {
-    switch (current_.type()) {
+    switch (current().type()) {
         case ParamValue::T_Float  : {
             float v = c.floatValue() > 0.5f ? 1.0f : 0.0f;
             return Parameter::change(ParamValue(v), force);
@@ -306,13 +391,13 @@ bool Parameter_Boolean::change(const ParamValue &c, bool force) {
 }
 
 ParamValue Parameter_Boolean::calcRelative(float f) {
-    if (current_.floatValue() > 0.5 && f < -0.0001) {
+    if (currentFloat() > 0.5 && f < -0.0001) {
         return ParamValue(0.0);
     }
-    if (current_.floatValue() <= 0.5 && f > 0.0001) {
+    if (currentFloat() <= 0.5 && f > 0.0001) {
         return ParamValue(1.0);
     }
-    return current_;
+    return current();
 }
 
 ParamValue Parameter_Boolean::calcFloat(float f) {
@@ -327,12 +412,13 @@ ParamValue Parameter_Boolean::calcMaximum() const {
     return ParamValue(1.0f);
 }
 
-ParamValue Parameter_Boolean::calcMidi(int midi) {
-    return ParamValue(midi > 63 ? 1.0f : 0.0f);
+ParamValue Parameter_Boolean::calcMidi(int midi, unsigned bits) {
+    int half = (1 << (bits - 1)) - 1;
+    return ParamValue(midi > half ? 1.0f : 0.0f);
 }
 
 float Parameter_Boolean::asFloat(const ParamValue& v) const {
-    return (current().floatValue() > 0.5f ? 1.0f : 0.0f);
+    return (currentFloat() > 0.5f ? 1.0f : 0.0f);
 }
 
 
@@ -375,13 +461,13 @@ void Parameter_Int::createArgs(std::vector<ParamValue> &args) const {
 
 std::string Parameter_Int::displayValue() const {
     char numbuf[11];
-    snprintf(numbuf, 11,"%d", (int) current_.floatValue());
+    snprintf(numbuf, 11,"%d", (int) currentFloat());
     return std::string(numbuf);
 }
 
 
 bool Parameter_Int::change(const ParamValue &c, bool force) {
-    switch (current_.type()) {
+    switch (current().type()) {
         case ParamValue::T_Float  : {
             int v = static_cast<int>(c.floatValue());
             v = std::max(v, min());
@@ -401,14 +487,14 @@ ParamValue Parameter_Int::calcRelative(float f) {
     if (chg > 0.001 && chg < step) chg = step;
     else if (chg < 0.001 && chg > -step) chg = -step;
     int ichg = static_cast<int>(std::round(chg * rng));
-    int v = static_cast<int>(current().floatValue()) + ichg;
+    int v = static_cast<int>(currentFloat()) + ichg;
     v = std::max(v, min());
     v = std::min(v, max());
     return ParamValue((float) v);
 }
 
-ParamValue Parameter_Int::calcMidi(int midi) {
-    float f = (float) midi / 127.0f;
+ParamValue Parameter_Int::calcMidi(int midi, unsigned bits) {
+    float f = midiToFloat(midi, bits);
     int v = static_cast<int>((f * (max() - min())) + min());
     v = std::max(v, min());
     v = std::min(v, max());
@@ -445,7 +531,7 @@ const std::string &Parameter_Pitch::displayUnit() const {
 
 std::string Parameter_Pan::displayValue() const {
     char buf[11];
-    float c = current_.floatValue();
+    float c = currentFloat();
     if(c==0.5f) {
         snprintf(buf,11, "C");
     } else if (c>0.5f) {
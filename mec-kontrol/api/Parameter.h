@@ -3,6 +3,7 @@
 #include <string>
 #include <memory>
 #include <vector>
+#include <atomic>
 
 
 #include "Entity.h"
@@ -25,6 +26,8 @@ enum ParameterType {
 class Parameter : public Entity {
 public:
     static std::shared_ptr<Parameter> create(const std::vector<ParamValue> &args);
+    // type from its name in module definitions (e.g. "freq"), PT_Invalid if unknown
+    static ParameterType typeFromString(const std::string &t);
 
     Parameter(ParameterType type);
     virtual void createArgs(std::vector<ParamValue> &args) const;
@@ -34,12 +37,20 @@ public:
     virtual std::string displayValue() const;
     virtual const std::string &displayUnit() const;
 
-    ParamValue current() const { return current_; }
+    // lock free, so safe for hot paths and readers on other threads
+    ParamValue current() const { return ParamValue(currentFloat()); }
+    float currentFloat() const { return currentFloat_.load(std::memory_order_relaxed); }
 
     virtual bool change(const ParamValue &c, bool force);
     virtual ParamValue calcRelative(float f);
     virtual ParamValue calcFloat(float f);
-    virtual ParamValue calcMidi(int midi);
+    // midi value at given resolution, 7 bit cc or 14 bit cc pair/nrpn
+    virtual ParamValue calcMidi(int midi, unsigned bits = 7);
+
+    // calcMidi from precomputed tables, 7 bit built with the definition, 14 bit on first use
+    ParamValue midiValue(int midi, unsigned bits = 7);
+    // calcFloat, without virtual dispatch for linear ranges
+    ParamValue normalisedValue(float f);
 
     virtual ParamValue calcMinimum() const;
     virtual ParamValue calcMaximum() const;
@@ -50,11 +61,30 @@ public:
 
     void dump() const;
 
+    virtual ~Parameter();
+
 protected:
     virtual void init(const std::vector<ParamValue> &args, unsigned &pos);
+    // true if calcFloat is a clamped linear map onto min..max
+    virtual bool linearRange(float & /*min*/, float & /*max*/) const { return false; }
 
     ParameterType type_;
-    ParamValue current_;
+    std::atomic<float> currentFloat_;
+
+private:
+    static const unsigned MIDI_TABLE_BITS = 7;
+    static const unsigned MIDI_TABLE_BITS_HIRES = 14;
+
+    // (re)build lookups from the definition, called once init has completed
+    void compile();
+    const float *buildMidiTable(unsigned bits);
+
+    // owned, null if not built or not numeric
+    std::atomic<const float *> midiTable_;
+    std::atomic<const float *> midiTableHiRes_;
+    bool linear_;
+    float linearMin_;
+    float linearMax_;
 };
 
 
@@ -67,7 +97,7 @@ public:
 
     bool change(const ParamValue &c, bool force) override;
     ParamValue calcRelative(float f) override;
-    ParamValue calcMidi(int midi) override;
+    ParamValue calcMidi(int midi, unsigned bits = 7) override;
     ParamValue calcFloat(float f) override;
 
     ParamValue calcMinimum() const override;
@@ -98,7 +128,6 @@ public:
 
     bool change(const ParamValue &c, bool force) override;
     ParamValue calcRelative(float f) override;
-    ParamValue calcMidi(int midi) override;
     ParamValue calcFloat(float f) override;
 
     ParamValue calcMinimum() const override;
@@ -108,6 +137,7 @@ public:
 
 protected:
     void init(const std::vector<ParamValue> &args, unsigned &pos) override;
+    bool linearRange(float &min, float &max) const override;
 
     float def() const { return def_; }
 
@@ -128,7 +158,7 @@ public:
 
     bool change(const ParamValue &c, bool force) override;
     ParamValue calcRelative(float f) override;
-    ParamValue calcMidi(int midi) override;
+    ParamValue calcMidi(int midi, unsigned bits = 7) override;
     ParamValue calcFloat(float f) override;
 
     ParamValue calcMinimum() const override;
@@ -0,0 +1,143 @@
+#include "PresetCache.h"
+
+#include <mec_log.h>
+
+namespace Kontrol {
+
+const unsigned PresetCache::DEFAULT_CAPACITY;
+
+PresetCache::PresetCache(Loader loader, unsigned capacity) :
+        loader_(loader),
+        capacity_(capacity > 0 ? capacity : 1),
+        hits_(0),
+        misses_(0),
+        running_(false) {
+}
+
+PresetCache::~PresetCache() {
+    stop();
+}
+
+void *preset_cache_prefetch_thread_func(void *pCache) {
+    PresetCache *pThis = static_cast<PresetCache *>(pCache);
+    pThis->prefetchRun();
+    return nullptr;
+}
+
+void PresetCache::start() {
+    std::lock_guard<std::mutex> lock(threadMutex_);
+    if (running_) return;
+    running_ = true;
+#ifdef __COBALT__
+    pthread_t ph = prefetch_thread_.native_handle();
+    pthread_create(&ph, 0, preset_cache_prefetch_thread_func, this);
+#else
+    prefetch_thread_ = std::thread(preset_cache_prefetch_thread_func, this);
+#endif
+}
+
+void PresetCache::stop() {
+    std::lock_guard<std::mutex> lock(threadMutex_);
+    if (running_) {
+        running_ = false;
+        if (prefetch_thread_.joinable()) prefetch_thread_.join();
+    }
+}
+
+void PresetCache::prefetchRun() {
+    std::string presetId;
+    while (running_) {
+        if (!prefetchQueue_.wait_dequeue_timed(presetId, (std::int64_t) POLL_TIMEOUT_MS * 1000)) continue;
+        if (lookup(presetId) != nullptr) continue;
+
+        std::shared_ptr<const RackPreset> preset = loader_(presetId);
+        if (preset == nullptr) continue;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        // may have been loaded or saved, while we were reading it
+        if (entries_.find(presetId) == entries_.end()) insert(presetId, preset);
+    }
+}
+
+std::shared_ptr<const RackPreset> PresetCache::lookup(const std::string &presetId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto e = entries_.find(presetId);
+    if (e == entries_.end()) return nullptr;
+    lru_.splice(lru_.begin(), lru_, e->second.lru_);
+    return e->second.preset_;
+}
+
+std::shared_ptr<const RackPreset> PresetCache::find(const std::string &presetId) {
+    return lookup(presetId);
+}
+
+std::shared_ptr<const RackPreset> PresetCache::get(const std::string &presetId) {
+    auto preset = lookup(presetId);
+    if (preset != nullptr) {
+        hits_++;
+        return preset;
+    }
+
+    misses_++;
+    preset = loader_(presetId);
+    if (preset == nullptr) return nullptr;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    insert(presetId, preset);
+    return preset;
+}
+
+void PresetCache::prefetch(const std::string &presetId) {
+    if (presetId.empty()) return;
+    start();
+    prefetchQueue_.enqueue(presetId);
+}
+
+void PresetCache::put(const std::string &presetId, const std::shared_ptr<const RackPreset> &preset) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    insert(presetId, preset);
+}
+
+void PresetCache::invalidate(const std::string &presetId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto e = entries_.find(presetId);
+    if (e == entries_.end()) return;
+    lru_.erase(e->second.lru_);
+    entries_.erase(e);
+}
+
+void PresetCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    lru_.clear();
+}
+
+void PresetCache::capacity(unsigned capacity) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    capacity_ = capacity > 0 ? capacity : 1;
+    trim();
+}
+
+// mutex_ must be held
+void PresetCache::insert(const std::string &presetId, const std::shared_ptr<const RackPreset> &preset) {
+    auto e = entries_.find(presetId);
+    if (e != entries_.end()) {
+        e->second.preset_ = preset;
+        lru_.splice(lru_.begin(), lru_, e->second.lru_);
+        return;
+    }
+    lru_.push_front(presetId);
+    entries_[presetId] = Entry{preset, lru_.begin()};
+    trim();
+}
+
+// mutex_ must be held
+void PresetCache::trim() {
+    while (entries_.size() > capacity_) {
+        LOG_1("PresetCache::trim dropping preset " << lru_.back());
+        entries_.erase(lru_.back());
+        lru_.pop_back();
+    }
+}
+
+} //namespace
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Rack.h"
+
+#include <atomic>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <blockingconcurrentqueue.h>
+
+namespace Kontrol {
+
+// parsed rack presets, kept in memory so a preset load is only an apply.
+// least recently used presets are dropped once capacity is reached,
+// prefetched presets are read and parsed on a background thread.
+class PresetCache {
+public:
+    static const unsigned DEFAULT_CAPACITY = 8;
+
+    // reads and parses a preset, nullptr if it does not exist
+    typedef std::function<std::shared_ptr<RackPreset>(const std::string &presetId)> Loader;
+
+    PresetCache(Loader loader, unsigned capacity = DEFAULT_CAPACITY);
+    ~PresetCache();
+
+    // cached preset, if not cached (or prefetched yet) it is loaded on the calling thread
+    std::shared_ptr<const RackPreset> get(const std::string &presetId);
+    // cached preset or nullptr, never loads
+    std::shared_ptr<const RackPreset> find(const std::string &presetId);
+
+    // load in the background, if not already cached
+    void prefetch(const std::string &presetId);
+
+    // replace cached preset, e.g. after it has been saved
+    void put(const std::string &presetId, const std::shared_ptr<const RackPreset> &preset);
+    void invalidate(const std::string &presetId);
+    void clear();
+
+    void capacity(unsigned capacity);
+
+    unsigned capacity() const { return capacity_; }
+
+    unsigned long hits() const { return hits_; }
+
+    unsigned long misses() const { return misses_; }
+
+    void stop();
+    void prefetchRun();
+
+private:
+    static const unsigned POLL_TIMEOUT_MS = 100;
+
+    typedef std::list<std::string> LruList;
+    struct Entry {
+        std::shared_ptr<const RackPreset> preset_;
+        LruList::iterator lru_;
+    };
+
+    void start();
+    std::shared_ptr<const RackPreset> lookup(const std::string &presetId);
+    void insert(const std::string &presetId, const std::shared_ptr<const RackPreset> &preset);
+    void trim();
+
+    Loader loader_;
+    unsigned capacity_;
+    std::mutex mutex_;
+    std::unordered_map<std::string, Entry> entries_;
+    LruList lru_; // most recently used first
+    std::atomic<unsigned long> hits_;
+    std::atomic<unsigned long> misses_;
+
+    moodycamel::BlockingConcurrentQueue<std::string> prefetchQueue_;
+    std::mutex threadMutex_;
+    std::atomic<bool> running_;
+    std::thread prefetch_thread_;
+};
+
+} //namespace
@@ -0,0 +1,177 @@
+#include "PresetMorph.h"
+#include "Module.h"
+#include "KontrolModel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+#include <mec_log.h>
+
+namespace Kontrol {
+
+void PresetMorph::clear() {
+    presetIds_.clear();
+    numPresets_ = 0;
+    handles_.clear();
+    interpolation_.clear();
+    last_.clear();
+    out_.clear();
+    changed_.clear();
+    values_.clear();
+}
+
+bool PresetMorph::prepare(Rack &rack, const std::vector<std::string> &presetIds) {
+    clear();
+    if (presetIds.size() < 2) return false;
+
+    std::vector<std::shared_ptr<const RackPreset>> presets;
+    for (const auto &presetId : presetIds) {
+        auto preset = rack.getPreset(presetId);
+        if (preset == nullptr) {
+            LOG_0("PresetMorph::prepare preset not found : " << presetId);
+            return false;
+        }
+        presets.push_back(preset);
+    }
+
+    presetIds_ = presetIds;
+    numPresets_ = presets.size();
+
+    // params in module order, current values for any not in a preset
+    auto model = KontrolModel::model();
+    std::vector<EntityId> moduleIds;
+    std::vector<EntityId> paramIds;
+    std::vector<std::shared_ptr<Parameter>> params;
+    for (const auto &module : rack.getModules()) {
+        for (const auto &param : module->getParams()) {
+            if (param->current().type() != ParamValue::T_Float) continue;
+            ParamHandle h = model->getParamHandle(rack, *module, *param);
+            if (!h.valid()) continue;
+            handles_.push_back(h);
+            moduleIds.push_back(module->id());
+            paramIds.push_back(param->id());
+            params.push_back(param);
+        }
+    }
+    unsigned numParams = handles_.size();
+    values_.resize(numPresets_ * numParams);
+    for (unsigned p = 0; p < numPresets_; p++) {
+        float *values = &values_[p * numParams];
+        for (unsigned i = 0; i < numParams; i++) values[i] = params[i]->currentFloat();
+
+        unsigned i = 0;
+        while (i < numParams) {
+            // params are grouped by module
+            const EntityId &moduleId = moduleIds[i];
+            unsigned end = i;
+            while (end < numParams && moduleIds[end] == moduleId) end++;
+
+            auto mp = presets[p]->find(moduleId);
+            auto module = rack.getModule(moduleId);
+            if (mp != presets[p]->end() && module != nullptr && mp->second.moduleType() == module->type()) {
+                std::unordered_map<EntityId, float> presetValues;
+                for (const auto &v : mp->second.values()) {
+                    if (v.value().type() == ParamValue::T_Float) presetValues[v.paramId()] = v.value().floatValue();
+                }
+                for (unsigned k = i; k < end; k++) {
+                    auto pv = presetValues.find(paramIds[k]);
+                    if (pv != presetValues.end()) values[k] = pv->second;
+                }
+            }
+            i = end;
+        }
+    }
+
+    interpolation_.resize(numParams);
+    for (unsigned i = 0; i < numParams; i++) {
+        switch (params[i]->type()) {
+            case PT_Int:
+            case PT_Pitch:
+            case PT_Boolean:
+                interpolation_[i] = I_SNAP;
+                break;
+            case PT_Frequency: {
+                // log only makes sense if every value is positive
+                bool positive = true;
+                for (unsigned p = 0; p < numPresets_; p++) positive &= values_[p * numParams + i] > 0.0f;
+                interpolation_[i] = positive ? I_LOG : I_LINEAR;
+                break;
+            }
+            default:
+                interpolation_[i] = I_LINEAR;
+                break;
+        }
+        if (interpolation_[i] == I_LOG) {
+            for (unsigned p = 0; p < numPresets_; p++) values_[p * numParams + i] = std::log(values_[p * numParams + i]);
+        }
+    }
+
+    out_.resize(numParams);
+    last_.assign(numParams, std::numeric_limits<float>::quiet_NaN());
+    changed_.reserve(numParams);
+    return true;
+}
+
+unsigned PresetMorph::morph(float position) {
+    if (!valid()) return 0;
+    position = std::min(std::max(position, 0.0f), 1.0f);
+    position_ = position;
+
+    float segment = position * (numPresets_ - 1);
+    unsigned idx = std::min((unsigned) segment, numPresets_ - 2);
+    float t = segment - idx;
+
+    unsigned numParams = handles_.size();
+    const float *a = &values_[idx * numParams];
+    const float *b = &values_[(idx + 1) * numParams];
+    float *out = out_.data();
+    // contiguous, no branches, so compiler can vectorise
+    for (unsigned i = 0; i < numParams; i++) {
+        out[i] = a[i] + (b[i] - a[i]) * t;
+    }
+
+    // applied directly, as changeParams would on the owner, but by handle
+    auto model = KontrolModel::model();
+    std::shared_ptr<Rack> rack;
+    std::shared_ptr<Module> module;
+    changed_.clear();
+    for (unsigned i = 0; i < numParams; i++) {
+        float v = out[i];
+        switch (interpolation_[i]) {
+            case I_SNAP:
+                v = std::round(v);
+                break;
+            case I_LOG:
+                v = std::exp(v);
+                break;
+            default:
+                break;
+        }
+        if (v == last_[i]) continue;
+        // the owner is the only writer, so modules outlive the notification
+        auto param = model->getParam(handles_[i], rack, module);
+        if (param == nullptr) continue;
+        last_[i] = v;
+        if (module->changeParam(handles_[i].param_, ParamValue(v), false)) {
+            changed_.push_back(ChangedParam{module.get(), param.get(), param->current()});
+        }
+    }
+    if (changed_.empty()) return 0;
+    model->publishChangedParams(CS_LOCAL, *rack, changed_);
+    return (unsigned) changed_.size();
+}
+
+bool PresetMorph::queue(float position) {
+    queued_ = position;
+    return !pending_.exchange(true);
+}
+
+unsigned PresetMorph::applyQueued() {
+    // cleared first, so a position queued from now on is either read here or posted again
+    pending_ = false;
+    return morph(queued_);
+}
+
+} //namespace
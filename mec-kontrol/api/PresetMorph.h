@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Rack.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Kontrol {
+
+// interpolates rack parameters between two or more presets, by a morph position.
+// start/end values and interpolation are prepared once into flat arrays, and params resolved to handles,
+// so an update is a lerp over all params, and one notification, without allocating.
+// updates are applied on the model owner thread, other threads queue a position (see Rack::morph)
+class PresetMorph {
+public:
+    PresetMorph() : numPresets_(0), position_(0.0f), queued_(0.0f), pending_(false) { ; }
+
+    // presets are taken from the rack preset cache, params not in a preset keep their current value
+    // handles are stale once the rack's modules or their definitions change, so prepare again
+    bool prepare(Rack &rack, const std::vector<std::string> &presetIds);
+    void clear();
+
+    bool valid() const { return numPresets_ >= 2 && !handles_.empty(); }
+
+    // position 0..1 spans all presets, owner thread only, returns number of params changed
+    unsigned morph(float position);
+
+    // from any thread, only the latest position is kept until applied.
+    // true if the owner needs to be posted applyQueued, false if already pending
+    bool queue(float position);
+    unsigned applyQueued();
+
+    float position() const { return position_; }
+
+    const std::vector<std::string> &presets() const { return presetIds_; }
+
+private:
+    enum Interpolation : uint8_t {
+        I_LINEAR,
+        I_SNAP, // ints and booleans
+        I_LOG // frequency
+    };
+
+    std::vector<std::string> presetIds_;
+    unsigned numPresets_;
+    std::atomic<float> position_;
+    std::atomic<float> queued_;
+    std::atomic<bool> pending_;
+
+    // per param, owner only once prepared
+    std::vector<ParamHandle> handles_;
+    std::vector<uint8_t> interpolation_;
+    std::vector<float> last_;
+    std::vector<float> out_;
+    std::vector<ChangedParam> changed_; // reused by morph
+    // [preset][param], log values for I_LOG
+    std::vector<float> values_;
+};
+
+} //namespace
@@ -1,8 +1,12 @@
 #include "Rack.h"
 #include "Module.h"
 #include "KontrolModel.h"
+#include "PresetCache.h"
+#include "BinaryPreset.h"
+#include "PresetMorph.h"
 
 #include <algorithm>
+#include <cstdlib>
 #include <limits>
 #include <string.h>
 #include <iostream>
@@ -28,6 +32,18 @@
 
 namespace Kontrol {
 
+std::atomic<unsigned> Rack::heldMidi_(0);
+
+static const char *RESOURCE_INDEX_FILE = "resources.json";
+
+Rack::~Rack() {
+    // held msbs are dropped, but no longer counted
+    std::lock_guard<std::mutex> lock(midiStateMutex_);
+    auto now = std::chrono::steady_clock::now();
+    for (unsigned ch = 0; ch < MIDI_CHANNELS; ch++) {
+        releaseHeldMidi(midiState_[ch], ch, true, now, heldOut_);
+    }
+}
 
 // mainDir_  : directory where main patch is based, usually ".", this is important since modules are loaded relative to it
 // dataDir_  : used for presets
@@ -44,6 +60,16 @@ void  Rack::initPrefs() {
         mediaDir_ = prefs.getString("mediaDir", mediaDir_);
         moduleDir_ = prefs.getString("moduleDir", moduleDir_);
         userModuleDir_ = prefs.getString("userModuleDir", userModuleDir_);
+        presetCacheSize_ = (unsigned) prefs.getInt("presetCacheSize", presetCacheSize_);
+
+        // e.g. "slew" : { "freq" : 20, "time" : 50 }
+        mec::Preferences slew(prefs.getSubTree("slew"));
+        if (slew.valid()) {
+            for (const std::string &t : slew.getKeys()) {
+                ParameterType type = Parameter::typeFromString(t);
+                if (type != PT_Invalid) slewTimes_[type] = (float) slew.getDouble(t);
+            }
+        }
     }
 }
 
@@ -55,20 +81,61 @@ inline std::shared_ptr<KontrolModel> Rack::model() {
 
 void Rack::addModule(const std::shared_ptr<Module> &module) {
     if (module != nullptr) {
-        modules_[module->id()] = module;
+        module->generation(++generation_);
+        moduleTable_.update([&](ModuleTable &t) {
+            auto existing = t.modules_.find(module->id());
+            if (existing != t.modules_.end() && existing->second != nullptr) {
+                // replaced, keep its index, but its params may differ
+                for (auto &im : t.index_) {
+                    if (im == existing->second) {
+                        im = module;
+                        break;
+                    }
+                }
+            } else {
+                t.index_.push_back(module);
+            }
+            t.modules_[module->id()] = module;
+        });
+        for (const auto &st : slewTimes_) module->slewTime(st.first, st.second);
+        invalidateDispatch();
     }
 }
 
+unsigned Rack::moduleIndex(const EntityId &moduleId) const {
+    auto t = moduleTable_.get();
+    for (unsigned i = 0; i < t->index_.size(); i++) {
+        if (t->index_[i]->id() == moduleId) return i;
+    }
+    return ParamHandle::INVALID_IDX;
+}
+
+unsigned Rack::moduleIndex(const Module *module) const {
+    auto t = moduleTable_.get();
+    for (unsigned i = 0; i < t->index_.size(); i++) {
+        if (t->index_[i].get() == module) return i;
+    }
+    return ParamHandle::INVALID_IDX;
+}
+
+std::shared_ptr<Module> Rack::moduleAt(unsigned idx) const {
+    auto t = moduleTable_.get();
+    return idx < t->index_.size() ? t->index_[idx] : nullptr;
+}
+
 std::vector<std::shared_ptr<Module>> Rack::getModules() {
+    auto t = moduleTable_.get();
     std::vector<std::shared_ptr<Module>> ret;
-    for (const auto &p : modules_) {
+    for (const auto &p : t->modules_) {
         if (p.second != nullptr) ret.push_back(p.second);
     }
     return ret;
 }
 
 std::shared_ptr<Module> Rack::getModule(const EntityId &moduleId) {
-    return modules_[moduleId];
+    auto t = moduleTable_.get();
+    auto module = t->modules_.find(moduleId);
+    return module != t->modules_.end() ? module->second : nullptr;
 }
 
 
@@ -76,7 +143,12 @@ bool Rack::loadModuleDefinitions(const EntityId &moduleId, const mec::Preference
     bool ret = false;
     auto module = getModule(moduleId);
     if (module != nullptr) {
-        if (module->loadModuleDefinitions(prefs)) {
+        bool layoutChanged = false;
+        bool loaded = module->loadModuleDefinitions(prefs, layoutChanged);
+        // handles only go stale if an index now refers to another param
+        if (layoutChanged) module->generation(++generation_);
+        invalidateDispatch();
+        if (loaded) {
             publishMetaData(module);
             ret = true;
         }
@@ -108,29 +180,11 @@ bool Rack::loadSettings(const std::string &filename) {
     }
 
     // load presets
-    presets_.clear();
+    presetCache()->clear();
     std::string presetsdir = dataDir_ + "/presets";
     std::setlocale(LC_ALL, "en_US.UTF-8");
-
-    struct stat st;
-    struct dirent **namelist;
-
-    int n = scandir(presetsdir.c_str(), &namelist, NULL, alphasort);
-    if (n > 0) {
-        for (int i = 0; i < n; i++) {
-            if (namelist[i]->d_type == DT_DIR &&
-                strcmp(namelist[i]->d_name, "..") != 0
-                && strcmp(namelist[i]->d_name, ".") != 0) {
-                std::string presetId = namelist[i]->d_name;
-                std::string paramfile = presetsdir + "/" + presetId+ "/params.json";
-                int fs = stat(paramfile.c_str(), &st);
-                if(fs == 0) {
-                    presets_.push_back(presetId);
-                    addResource("preset",presetId);
-                }
-            }
-        }
-    }
+    auto presets = indexResources("preset", FsIndex::K_PRESETS, presetsdir);
+    resources_.update([&](ResourceTable &t) { t.presets_ = presets; });
 
     if(currentPreset().length()>0) loadFilePreset(currentPreset_);
 
@@ -140,63 +194,56 @@ bool Rack::loadSettings(const std::string &filename) {
 
 
 bool Rack::saveSettings(const std::string &filename) {
-    {
-        std::string rackPrefFile = dataDir_+ "/" + filename;
-        std::ofstream outfile(rackPrefFile.c_str());
+    // written in the background, see writer_
+    std::string rackPrefFile = dataDir_+ "/" + filename;
+    std::string currentPreset = currentPreset_;
+    writer_.submit(rackPrefFile, [rackPrefFile, currentPreset]() {
         cJSON *root = cJSON_CreateObject();
-
-        cJSON_AddStringToObject(root, "currentPreset", currentPreset_.c_str());
-        const char *text = cJSON_Print(root);
-        outfile << text << std::endl;
-        outfile.close();
+        cJSON_AddStringToObject(root, "currentPreset", currentPreset.c_str());
+        char *text = cJSON_Print(root);
+        bool ret = AsyncWriter::writeFile(rackPrefFile, std::string(text) + "\n");
+        free(text);
         cJSON_Delete(root);
-    }
+        return ret;
+    });
     return true;
 }
 
 std::vector<std::string> Rack::getPresetList() {
-    std::vector<std::string> presets;
-    for (const auto &p : presets_) {
-        presets.push_back(p);
-    }
-    return presets;
+    return resources_.get()->presets_;
 }
 
 
-bool Rack::savePreset(std::string presetId) {
+bool Rack::savePreset(std::string presetId, ChangeSource src) {
     bool ret = false;
 
-    // store preset in rackPreset_
-    for (const auto &m : modules_) {
+    // store preset in rackPreset_, copied as the loaded preset is shared with the cache
+    auto preset = std::make_shared<RackPreset>(*rackPreset_);
+    auto modules = moduleTable_.get();
+    for (const auto &m : modules->modules_) {
         auto module = m.second;
         if (module != nullptr) {
-            auto moduleId = module->id();
-            ModulePreset modulePreset = rackPreset_[moduleId];
-            ret |= updateModulePreset(module, modulePreset);
-            rackPreset_[moduleId] = modulePreset;
+            ret |= updateModulePreset(module, (*preset)[module->id()]);
         }
     }
+    rackPreset_ = preset;
 
     //FIXME: probably presets_ should not exist, should use resources
     //also new preset ID, should not be done on client, but on server
     //other multi clients might trip over each other!
-    bool found=false;
-    for(auto p: presets_) {
-        if(p==presetId) {
-            found=true;
-            break;
+    resources_.update([&](ResourceTable &t) {
+        if (std::find(t.presets_.begin(), t.presets_.end(), presetId) == t.presets_.end()) {
+            t.presets_.push_back(presetId);
         }
-    }
-    if(!found) presets_.push_back(presetId);
-
-    addResource("preset",presetId);
+        t.resources_["preset"].insert(presetId);
+    });
     model()->publishResource(CS_LOCAL,*this,"preset",presetId);
 
-    //save rackPreset_ to file
-    saveFilePreset(presetId);
+    //save rackPreset_ to file, listeners are told once written
+    saveFilePreset(presetId, src);
+    presetCache()->put(presetId, rackPreset_);
 
     currentPreset_ = presetId;
-    model()->savePreset(CS_LOCAL, id(), currentPreset());
 
     //    dumpSettings();
     return ret;
@@ -207,132 +254,399 @@ bool Rack::loadPreset(std::string presetId) {
     return ret;
 }
 
-bool Rack::loadFilePreset(const std::string& presetId) {
-    bool ret = false;
+std::shared_ptr<PresetCache> Rack::presetCache() {
+    std::lock_guard<std::mutex> lock(presetCacheMutex_);
+    // the loader runs on the prefetch thread, so is given the directory rather than reading dataDir_
+    std::string dir = dataDir_ + "/presets/";
+    if (presetCache_ == nullptr || dir != presetCacheDir_) {
+        presetCacheDir_ = dir;
+        presetCache_ = std::make_shared<PresetCache>(
+                [dir, this](const std::string &presetId) {
+                    // writer_ outlives the cache, see member order
+                    return readFilePreset(dir + presetId, &writer_);
+                },
+                presetCacheSize_ > 0 ? presetCacheSize_ : PresetCache::DEFAULT_CAPACITY);
+    }
+    return presetCache_;
+}
 
-    std::string dir = dataDir_ + "/presets/"+presetId;
-    std::string filename = dir+"/params.json";
+void Rack::presetCacheSize(unsigned n) {
+    presetCacheSize_ = n;
+    presetCache()->capacity(n > 0 ? n : PresetCache::DEFAULT_CAPACITY);
+}
+
+void Rack::slewTime(ParameterType type, float ms) {
+    slewTimes_[type] = ms;
+    for (const auto &module : getModules()) module->slewTime(type, ms);
+}
+
+std::shared_ptr<const RackPreset> Rack::getPreset(const std::string &presetId) {
+    return presetCache()->get(presetId);
+}
+
+bool Rack::morphPresets(const std::vector<std::string> &presetIds) {
+    auto morph = std::make_shared<PresetMorph>();
+    bool ret = morph->prepare(*this, presetIds);
+    morph_.store(ret ? morph : nullptr);
+    return ret;
+}
+
+unsigned Rack::morph(float position) {
+    auto morph = morph_.load();
+    if (morph == nullptr) return 0;
+    if (model()->isOwnerThread()) return morph->morph(position);
+
+    // e.g. from the midi thread, positions arriving before the owner applies one replace it
+    if (morph->queue(position)) model()->post([morph]() { morph->applyQueued(); });
+    return 0;
+}
+
+// load neighbours in the background, ready for next/prev preset
+void Rack::prefetchPresets(const std::string &presetId) {
+    auto t = resources_.get();
+    const auto &presets = t->presets_;
+    unsigned n = presets.size();
+    for (unsigned i = 0; i < n; i++) {
+        if (presets[i] == presetId) {
+            presetCache()->prefetch(presets[(i + 1) % n]);
+            presetCache()->prefetch(presets[(i + n - 1) % n]);
+            return;
+        }
+    }
+}
+
+std::shared_ptr<RackPreset> Rack::readFilePreset(const std::string &dir, AsyncWriter *writer) {
+    std::string filename = dir + "/params.json";
+    std::string binfile = dir + "/params.bin";
+
+    // binary is generated from the json, so only used if it records the json as it is now
+    BinaryPreset::Source source;
+    bool hasJson = BinaryPreset::source(filename, source);
+    auto binPreset = BinaryPreset::open(binfile);
+    if (binPreset != nullptr && (!hasJson || binPreset->generatedFrom(source))) {
+        return binPreset->rackPreset();
+    }
 
-    rackPreset_.clear();
     mec::Preferences preset(filename);
-    if(!preset.valid()) return false;
+    if (!preset.valid()) return nullptr;
 
-    // load preset from file
+    auto rackPreset = std::make_shared<RackPreset>();
     for (const std::string &moduleId :preset.getKeys()) {
         mec::Preferences modulepresetspref(preset.getSubTree(moduleId));
         if (modulepresetspref.valid()) {
-            ret |= loadModulePreset(rackPreset_, moduleId, modulepresetspref);
+            loadModulePreset(*rackPreset, moduleId, modulepresetspref);
         }
     }
 
-    // publish it
-    for (const auto &m : modules_) {
+    // regenerated in the background, loading does not wait on the write
+    if (writer != nullptr) {
+        std::shared_ptr<const RackPreset> generated = rackPreset;
+        writer->submit(binfile, [binfile, generated, source]() {
+            return BinaryPreset::write(binfile, *generated, source);
+        });
+    }
+    return rackPreset;
+}
+
+bool Rack::loadFilePreset(const std::string& presetId) {
+    bool ret = false;
+
+    // usually already parsed, see prefetchPresets. applied from the cached copy, without copying it
+    rackPreset_ = std::make_shared<const RackPreset>();
+    auto preset = presetCache()->get(presetId);
+    if (preset == nullptr) return false;
+    rackPreset_ = preset;
+    ret = !preset->empty();
+
+    // publish it, all modules values as one change
+    std::vector<ParamChange> changes;
+    auto modules = moduleTable_.get();
+    for (const auto &m : modules->modules_) {
         auto module = m.second;
         if (module != nullptr) {
             auto moduleId = module->id();
-            if (rackPreset_.count(moduleId) > 0) {
-                ModulePreset modulePreset = rackPreset_[moduleId];
+            auto mp = preset->find(moduleId);
+            if (mp != preset->end()) {
+                const ModulePreset &modulePreset = mp->second;
                 if (module->type() != modulePreset.moduleType()) {
                     model()->loadModule(CS_PRESET, id(), module->id(), modulePreset.moduleType());
                     module = getModule(moduleId);
                 }
 
-                ret |= applyModulePreset(module, modulePreset);
+                ret |= applyModulePreset(module, modulePreset, changes);
             }
         }
     }
+    changeParams(CS_PRESET, changes);
     currentPreset_ = presetId;
     model()->loadPreset(CS_LOCAL, id(), currentPreset());
+    prefetchPresets(presetId);
     return ret;
 }
 
-bool Rack::saveFilePreset(const std::string& presetId) {
-    bool ret = true;
-
+bool Rack::saveFilePreset(const std::string& presetId, ChangeSource src) {
     std::string dir = dataDir_ + "/presets/"+presetId;
-    std::string filename = dir+"/params.json";
-    mkdir(dir.c_str(),S_IRWXU|S_IRWXG|S_IRWXO);
 
-    std::ofstream outfile(filename.c_str());
+    // snapshot values, serialised and written in the background
+    auto preset = std::make_shared<RackPreset>();
+    for (const auto &mp : *rackPreset_) {
+        // check module exists still, useful if renaming
+        if(getModule(mp.first)) {
+            preset->insert(mp);
+        }
+    }
+
+    EntityId rackId = id();
+    // not kept alive by pending saves, at exit the model may be going before the writer is stopped
+    std::weak_ptr<KontrolModel> wmodel = model();
+    writer_.submit(dir, [dir, preset]() {
+        mkdir(dir.c_str(),S_IRWXU|S_IRWXG|S_IRWXO);
+        bool ret = writeJsonPreset(dir + "/params.json", *preset);
+        // generated cache of the json, so later loads need no parsing
+        BinaryPreset::Source source;
+        if (ret && BinaryPreset::source(dir + "/params.json", source)) {
+            BinaryPreset::write(dir + "/params.bin", *preset, source);
+        }
+        return ret;
+    }, [wmodel, rackId, presetId, src](bool success) {
+        // always queued, so listeners are never called on the writer thread, even before an owner is set
+        auto m = wmodel.lock();
+        if (m) m->post([rackId, presetId, src, success]() { model()->presetSaved(src, rackId, presetId, success); });
+    });
+    return true;
+}
+
+bool Rack::writeJsonPreset(const std::string &filename, const RackPreset &preset) {
     cJSON *root = cJSON_CreateObject();
 
     // store modules sorted, so easier to find ;)
     std::set<EntityId> moduleIds;
-    for (const auto &mp : rackPreset_) {
-        // check module exists still, useful if renaming
-        if(getModule(mp.first)) {
-            moduleIds.insert(mp.first);
-        }
+    for (const auto &mp : preset) {
+        moduleIds.insert(mp.first);
     }
 
     for (const auto &mid : moduleIds) {
-        auto mp = rackPreset_.find(mid);
-        if(mp!=rackPreset_.end()) {
-            auto moduleId = mp->first;
-            auto modulePreset = mp->second;
-            cJSON *mjson = cJSON_CreateObject();
-            cJSON_AddItemToObject(root, moduleId.c_str(), mjson);
-            saveModulePreset(modulePreset, mjson);
-        }
+        auto modulePreset = preset.at(mid);
+        cJSON *mjson = cJSON_CreateObject();
+        cJSON_AddItemToObject(root, mid.c_str(), mjson);
+        saveModulePreset(modulePreset, mjson);
     }
 
     // const char* text = cJSON_PrintUnformatted(root);
-    const char *text = cJSON_Print(root);
-    outfile << text << std::endl;
-    outfile.close();
+    char *text = cJSON_Print(root);
+    bool ret = AsyncWriter::writeFile(filename, std::string(text) + "\n");
+    free(text);
     cJSON_Delete(root);
     return ret;
 }
 
 
 bool Rack::changeMidiCC(unsigned midiCC, unsigned midiValue) {
-    bool ret = false;
-    for (const auto &m : modules_) {
-        auto module = m.second;
-        if (module != nullptr) {
-            std::vector<EntityId> mmvec = module->getParamsForCC(midiCC);
-            for (const auto &paramId : mmvec) {
-                auto param = module->getParam(paramId);
-                if (param != nullptr) {
-                    ParamValue pv = param->calcMidi(midiValue);
-                    if (pv != param->current()) {
-                        model()->changeParam(CS_MIDI, id(), module->id(), param->id(), pv);
-                        ret = true;
+    unsigned ch = midiCC / 128;
+    unsigned cc = midiCC % 128;
+    midiValue = midiValue & 0x7F;
+    if ((int) midiCC == morphMidiCC_) return morph((float) midiValue / 127.0f) > 0;
+    if (ch >= MIDI_CHANNELS) return dispatchMidiCC(midiCC, midiValue, 7);
+
+    // msb are sent as 7 bit, so 7 bit controllers still reach full range,
+    // the lsb of a mapped msb refines it to 14 bit
+    bool refine = cc >= 32 && cc < 64 && !isMidiCCMapped(midiCC) && isMidiCCMapped(midiCC - 32);
+
+    // parser state is shared by midi sources, which may be on different threads
+    bool nrpnData = false;
+    bool held = false;
+    unsigned nrpn = 0;
+    unsigned msb = 0;
+    unsigned lsb = midiValue;
+    bool replaced = false;
+    unsigned replacedNrpn = 0;
+    unsigned replacedValue = 0; // msb held for a previous nrpn
+    {
+        std::lock_guard<std::mutex> lock(midiStateMutex_);
+        MidiChannelState &state = midiState_[ch];
+        switch (cc) {
+            case 99 : // nrpn msb
+                state.nrpn_ = midiValue << 7;
+                state.nrpnActive_ = true;
+                break;
+            case 98 : // nrpn lsb
+                state.nrpn_ = (state.nrpn_ & 0x3F80) | midiValue;
+                state.nrpnActive_ = true;
+                break;
+            case 101 : // rpn, deselects nrpn
+            case 100 :
+                state.nrpnActive_ = false;
+                break;
+            case 6 : // data entry msb
+                if (state.nrpnActive_) {
+                    if (state.nrpnLsbSeen_) {
+                        if (state.nrpnHeld_ && state.heldNrpn_ != state.nrpn_) {
+                            replaced = true;
+                            replacedNrpn = state.heldNrpn_;
+                            replacedValue = (unsigned) state.nrpnMsb_ << 7;
+                        } else if (!state.nrpnHeld_) {
+                            heldMidi_++;
+                        }
+                        state.nrpnHeld_ = true;
+                        state.heldNrpn_ = state.nrpn_;
+                        state.heldAt_[32] = std::chrono::steady_clock::now();
+                        held = true;
+                    } else {
+                        nrpnData = true;
+                        nrpn = state.nrpn_;
+                        msb = midiValue;
+                        lsb = 0;
                     }
+                    state.nrpnMsb_ = static_cast<unsigned char>(midiValue);
+                }
+                break;
+            case 38 : // data entry lsb
+                if (state.nrpnActive_) {
+                    nrpnData = true;
+                    nrpn = state.nrpn_;
+                    msb = state.nrpnMsb_;
+                    state.nrpnLsbSeen_ = true;
+                    if (state.nrpnHeld_ && state.heldNrpn_ == nrpn) {
+                        state.nrpnHeld_ = false;
+                        heldMidi_--;
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+
+        if (!nrpnData && !held) {
+            if (cc < 32) {
+                uint32_t bit = 1u << cc;
+                state.ccMsb_[cc] = static_cast<unsigned char>(midiValue);
+                if (state.ccLsbSeen_ & bit) {
+                    if (!(state.ccHeld_ & bit)) heldMidi_++;
+                    state.ccHeld_ |= bit;
+                    state.heldAt_[cc] = std::chrono::steady_clock::now();
+                    held = true;
+                }
+            } else if (refine) {
+                uint32_t bit = 1u << (cc - 32);
+                msb = state.ccMsb_[cc - 32];
+                state.ccLsbSeen_ |= bit;
+                if (state.ccHeld_ & bit) {
+                    state.ccHeld_ &= ~bit;
+                    heldMidi_--;
                 }
             }
         }
     }
+
+    if (replaced) changeMidiNRPN(ch, replacedNrpn, replacedValue);
+    // sent with its lsb, or by processHeldMidi
+    if (held) return true;
+    if (nrpnData) return changeMidiNRPN(ch, nrpn, (msb << 7) | lsb);
+    if (refine) return changeMidiCC14(midiCC - 32, (msb << 7) | midiValue);
+    return dispatchMidiCC(midiCC, midiValue, 7);
+}
+
+// midiStateMutex_ must be held, all releases everything held on the channel, otherwise only those overdue
+void Rack::releaseHeldMidi(MidiChannelState &state, unsigned ch, bool all,
+                           std::chrono::steady_clock::time_point now, std::vector<HeldMidi> &out) {
+    auto wait = std::chrono::milliseconds(MIDI_LSB_WAIT_MS);
+    for (unsigned cc = 0; state.ccHeld_ != 0 && cc < 32; cc++) {
+        uint32_t bit = 1u << cc;
+        if (!(state.ccHeld_ & bit)) continue;
+        if (!all && now - state.heldAt_[cc] < wait) continue;
+        state.ccHeld_ &= ~bit;
+        heldMidi_--;
+        out.push_back(HeldMidi{false, ch, (ch * 128) + cc, state.ccMsb_[cc]});
+    }
+    if (state.nrpnHeld_ && (all || now - state.heldAt_[32] >= wait)) {
+        state.nrpnHeld_ = false;
+        heldMidi_--;
+        out.push_back(HeldMidi{true, ch, state.heldNrpn_, (unsigned) state.nrpnMsb_ << 7});
+    }
+}
+
+unsigned Rack::processHeldMidi() {
+    if (heldMidi_ == 0) return 0;
+    heldOut_.clear();
+    {
+        std::lock_guard<std::mutex> lock(midiStateMutex_);
+        auto now = std::chrono::steady_clock::now();
+        for (unsigned ch = 0; ch < MIDI_CHANNELS; ch++) {
+            releaseHeldMidi(midiState_[ch], ch, false, now, heldOut_);
+        }
+    }
+    for (const auto &h : heldOut_) {
+        if (h.nrpn_) changeMidiNRPN(h.ch_, h.id_, h.value_);
+        else dispatchMidiCC(h.id_, h.value_, 7);
+    }
+    return (unsigned) heldOut_.size();
+}
+
+bool Rack::changeMidiCC14(unsigned midiCC, unsigned midiValue) {
+    return dispatchMidiCC(midiCC, midiValue & 0x3FFF, 14);
+}
+
+bool Rack::changeMidiNRPN(unsigned ch, unsigned nrpn, unsigned midiValue) {
+    return dispatchMidiCC(nrpnMappingId(ch, nrpn & 0x3FFF), midiValue & 0x3FFF, 14);
+}
+
+unsigned Rack::midiLearnId(unsigned midiCC) const {
+    unsigned ch = midiCC / 128;
+    unsigned cc = midiCC % 128;
+    if (ch < MIDI_CHANNELS && (cc == 6 || cc == 38)) {
+        std::lock_guard<std::mutex> lock(midiStateMutex_);
+        if (midiState_[ch].nrpnActive_) return nrpnMappingId(ch, midiState_[ch].nrpn_);
+    }
+    return midiCC;
+}
+
+bool Rack::isMidiCCMapped(unsigned mapId) {
+    auto tables = dispatch_.get();
+    auto slot = tables->midi(mapId);
+    return slot != nullptr && !slot->empty();
+}
+
+bool Rack::dispatchMidiCC(unsigned mapId, unsigned midiValue, unsigned bits) {
+    auto tables = dispatch_.get();
+    auto slot = tables->midi(mapId);
+    if (slot == nullptr) return false;
+
+    bool ret = false;
+    for (const auto &d : *slot) {
+        ParamValue pv = d.param_->midiValue(midiValue, bits);
+        if (pv != d.param_->current()) {
+            model()->changeParam(CS_MIDI, d.handle_, pv);
+            ret = true;
+        }
+    }
     return ret;
 }
 
 void Rack::addMidiCCMapping(unsigned ccnum, const EntityId &moduleId, const EntityId &paramId) {
     auto module = getModule(moduleId);
     if (module != nullptr) module->addMidiCCMapping(ccnum, paramId);
+    invalidateDispatch();
 }
 
 void Rack::removeMidiCCMapping(unsigned ccnum, const EntityId &moduleId, const EntityId &paramId) {
     auto module = getModule(moduleId);
     if (module != nullptr) module->removeMidiCCMapping(ccnum, paramId);
+    invalidateDispatch();
 }
 
 
 bool Rack::changeModulation(unsigned bus, float value) {
+    if ((int) bus == morphBus_) return morph(value) > 0;
+    auto tables = dispatch_.get();
+    auto slot = tables->modulation(bus);
+    if (slot == nullptr) return false;
+
     bool ret = false;
-    for (const auto &m : modules_) {
-        auto module = m.second;
-        if (module != nullptr) {
-            std::vector<EntityId> mmvec = module->getParamsForModulation(bus);
-            for (const auto &paramId : mmvec) {
-                auto param = module->getParam(paramId);
-                if (param != nullptr) {
-                    ParamValue pv = param->calcFloat(value);
-                    if (pv != param->current()) {
-                        model()->changeParam(CS_MODULATION, id(), module->id(), param->id(), pv);
-                        ret = true;
-                    }
-                }
-            }
+    for (const auto &d : *slot) {
+        ParamValue pv = d.param_->normalisedValue(value);
+        if (pv != d.param_->current()) {
+            model()->changeParam(CS_MODULATION, d.handle_, pv);
+            ret = true;
         }
     }
     return ret;
@@ -341,11 +655,88 @@ bool Rack::changeModulation(unsigned bus, float value) {
 void Rack::addModulationMapping(const std::string &src, unsigned bus, const EntityId &moduleId, const EntityId &paramId) {
     auto module = getModule(moduleId);
     if (module != nullptr) module->addModulationMapping(src, bus, paramId);
+    invalidateDispatch();
 }
 
 void Rack::removeModulationMapping(const std::string &src, unsigned bus, const EntityId &moduleId, const EntityId &paramId) {
     auto module = getModule(moduleId);
     if (module != nullptr) module->removeModulationMapping(src, bus, paramId);
+    invalidateDispatch();
+}
+
+const Rack::DispatchSlot *Rack::DispatchTables::midi(unsigned mapId) const {
+    if (mapId < cc_.size()) return &cc_[mapId];
+    auto it = nrpn_.find(mapId);
+    return it != nrpn_.end() ? &it->second : nullptr;
+}
+
+const Rack::DispatchSlot *Rack::DispatchTables::modulation(unsigned bus) const {
+    if (bus < mod_.size()) return &mod_[bus];
+    auto it = modExt_.find(bus);
+    return it != modExt_.end() ? &it->second : nullptr;
+}
+
+void Rack::invalidateDispatch() {
+    auto model = Rack::model();
+    if (!model->isOwnerThread()) {
+        EntityId rackId = id();
+        model->post([rackId]() {
+            auto rack = Rack::model()->getRack(rackId);
+            if (rack != nullptr) rack->buildDispatch();
+        });
+        return;
+    }
+    buildDispatch();
+}
+
+// readers keep using the tables they have, until they next get them
+void Rack::buildDispatch() {
+    DispatchTables tables;
+    tables.cc_.resize(MIDI_CHANNELS * 128);
+    tables.mod_.resize(MAX_MOD_BUS);
+
+    auto modules = moduleTable_.get();
+
+    for (const auto &m : modules->modules_) {
+        auto module = m.second;
+        if (module == nullptr) continue;
+        const Module &cmodule = *module;
+
+        for (const auto &mm : module->getMidiMapping()) {
+            for (const auto &paramId : mm.second) {
+                auto param = cmodule.getParam(paramId);
+                if (param == nullptr) continue;
+
+                Dispatch d;
+                d.handle_ = model()->getParamHandle(id(), module->id(), paramId);
+                d.param_ = param;
+                if (!d.handle_.valid()) continue;
+                if (mm.first < tables.cc_.size()) {
+                    tables.cc_[mm.first].push_back(d);
+                } else {
+                    tables.nrpn_[mm.first].push_back(d);
+                }
+            }
+        }
+
+        for (const auto &mm : module->getModulationMapping()) {
+            for (const auto &paramId : mm.second) {
+                auto param = cmodule.getParam(paramId);
+                if (param == nullptr) continue;
+
+                Dispatch d;
+                d.handle_ = model()->getParamHandle(id(), module->id(), paramId);
+                d.param_ = param;
+                if (!d.handle_.valid()) continue;
+                if (mm.first < tables.mod_.size()) {
+                    tables.mod_[mm.first].push_back(d);
+                } else {
+                    tables.modExt_[mm.first].push_back(d);
+                }
+            }
+        }
+    }
+    dispatch_.set(std::move(tables));
 }
 
 
@@ -361,8 +752,13 @@ void Rack::publishCurrentValues(const std::shared_ptr<Module> &module) const {
 }
 
 
+unsigned Rack::changeParams(ChangeSource src, const std::vector<ParamChange> &changes) {
+    return model()->changeParams(src, id(), changes);
+}
+
 void Rack::publishCurrentValues() const {
-    for (const auto &p : modules_) {
+    auto modules = moduleTable_.get();
+    for (const auto &p : modules->modules_) {
         if (p.second != nullptr) publishCurrentValues(p.second);
     }
 }
@@ -382,16 +778,16 @@ void Rack::publishMetaData(const std::shared_ptr<Module> &module) const {
             }
         }
     }
-    for (const auto &rt : resources_) {
-        for (const auto &res : rt.second) {
-            model()->publishResource(CS_LOCAL, *this, rt.first, res);
-        }
+    auto resources = resources_.get();
+    for (const auto &rt : resources->resources_) {
+        model()->publishResources(CS_LOCAL, *this, rt.first, std::vector<std::string>(rt.second.begin(), rt.second.end()));
     }
 }
 
 std::set<std::string> Rack::getResourceTypes() {
     std::set<std::string> resTypes;
-    for (const auto &r : resources_) {
+    auto t = resources_.get();
+    for (const auto &r : t->resources_) {
         resTypes.insert(r.first);
     }
     return resTypes;
@@ -399,18 +795,74 @@ std::set<std::string> Rack::getResourceTypes() {
 
 
 void Rack::addResource(const std::string &type, const std::string &resource) {
-    resources_[type].insert(resource);
+    resources_.update([&](ResourceTable &t) { t.resources_[type].insert(resource); });
 //    model()->publishResource(CS_LOCAL,*this,type,resource);
 }
 
 
-const std::set<std::string> &Rack::getResources(const std::string &type) {
-    return resources_[type];
+void Rack::removeResource(const std::string &type, const std::string &resource) {
+    resources_.update([&](ResourceTable &t) {
+        auto it = t.resources_.find(type);
+        if (it != t.resources_.end()) it->second.erase(resource);
+    });
+}
+
+
+std::vector<std::string> Rack::indexResources(const std::string &resType, FsIndex::Kind kind, const std::string &dir) {
+    if (!indexStarted_) {
+        indexStarted_ = true;
+        index_.load(dataDir_ + "/" + RESOURCE_INDEX_FILE);
+        EntityId rackId = id();
+        // always queued, so changes are applied by the owner when it processes commands.
+        // weak, as the model may be being destroyed (with the rack) when the watch thread calls
+        std::weak_ptr<KontrolModel> weakModel = model();
+        index_.watch([rackId, weakModel](const std::string &resType, const std::string &res, bool added) {
+            auto model = weakModel.lock();
+            if (model) model->post([=]() { indexChanged(rackId, resType, res, added); });
+        });
+    }
+
+    std::vector<std::string> found = index_.add(resType, kind, dir);
+    // one update for all, as the table is copied on each
+    resources_.update([&](ResourceTable &t) { t.resources_[resType].insert(found.begin(), found.end()); });
+    return found;
+}
+
+
+// resource added or removed on disk, see indexResources
+void Rack::indexChanged(const EntityId &rackId, const std::string &resType, const std::string &res, bool added) {
+    auto model = Rack::model();
+    auto rack = model->getRack(rackId);
+    if (rack == nullptr) return;
+
+    bool isPreset = resType == "preset";
+    bool inserted = false;
+    rack->resources_.update([&](ResourceTable &t) {
+        auto preset = std::find(t.presets_.begin(), t.presets_.end(), res);
+        if (added) {
+            if (isPreset && preset == t.presets_.end()) t.presets_.push_back(res);
+            inserted = t.resources_[resType].insert(res).second;
+        } else {
+            if (isPreset && preset != t.presets_.end()) t.presets_.erase(preset);
+            auto it = t.resources_.find(resType);
+            if (it != t.resources_.end()) it->second.erase(res);
+        }
+    });
+    // note: clients are not told of removals, there is no message for it
+    if (inserted) model->publishResource(CS_LOCAL, *rack, resType, res);
+}
+
+
+std::set<std::string> Rack::getResources(const std::string &type) {
+    auto t = resources_.get();
+    auto it = t->resources_.find(type);
+    return it != t->resources_.end() ? it->second : std::set<std::string>();
 }
 
 
 void Rack::publishMetaData() const {
-    for (const auto &p : modules_) {
+    auto modules = moduleTable_.get();
+    for (const auto &p : modules->modules_) {
         if (p.second != nullptr) publishMetaData(p.second);
     }
 }
@@ -559,27 +1011,30 @@ bool Rack::updateModulePreset(std::shared_ptr<Module> module, ModulePreset &modu
     return ret;
 }
 
-bool Rack::applyModulePreset(std::shared_ptr<Module> module, const ModulePreset &modulePreset) {
+bool Rack::applyModulePreset(std::shared_ptr<Module> module, const ModulePreset &modulePreset,
+                             std::vector<ParamChange> &changes) {
     bool ret = false;
 
-
     // restore parameter values
+    std::set<EntityId> presetParams;
     for (auto p : modulePreset.values()) {
         if (p.value().type() == ParamValue::T_Float) {
-            model()->changeParam(CS_PRESET, model()->localRack()->id(), module->id(), p.paramId(), p.value());
+            changes.push_back(ParamChange{module->id(), p.paramId(), p.value()});
+            presetParams.insert(p.paramId());
             ret |= true;
         } //iffloat
         //TODO: preset, support non numeric types
     }
+    // preset changes are forced, so params not in the preset are resent with their current value
     for(const auto &param: module->getParams()) {
-        if (param->current().type() ==  ParamValue::T_Float) {
-            model()->changeParam(CS_PRESET, model()->localRack()->id(), module->id(), param->id(),
-                                 param->current().floatValue());
+        if (param->current().type() ==  ParamValue::T_Float && presetParams.count(param->id()) == 0) {
+            changes.push_back(ParamChange{module->id(), param->id(), param->current()});
         }
     }
 
     module->setMidiMapping(modulePreset.midiMap());
     module->setModulationMapping(modulePreset.modulationMap());
+    invalidateDispatch();
 
     return ret;
 }
@@ -594,7 +1049,8 @@ void Rack::dumpSettings() const {
     LOG_1("moduleDir : "  << moduleDir());
     LOG_1("userModuleDir : "  << userModuleDir());
     LOG_1("currentPreset : "  << currentPreset());
-    for (const auto &preset : presets_) {
+    auto resources = resources_.get();
+    for (const auto &preset : resources->presets_) {
         LOG_1("Preset : " << preset);
     }
 }
@@ -602,7 +1058,8 @@ void Rack::dumpSettings() const {
 void Rack::dumpParameters() {
     LOG_1("Rack Parameters :" << id());
     LOG_1("------------------------");
-    for (const auto &m : modules_) {
+    auto modules = moduleTable_.get();
+    for (const auto &m : modules->modules_) {
         if (m.second != nullptr) m.second->dumpParameters();
     }
 }
@@ -610,7 +1067,8 @@ void Rack::dumpParameters() {
 void Rack::dumpCurrentValues() {
     LOG_1("Rack Values : " << id());
     LOG_1("-----------------------");
-    for (const auto &m : modules_) {
+    auto modules = moduleTable_.get();
+    for (const auto &m : modules->modules_) {
         if (m.second != nullptr) m.second->dumpCurrentValues();
     }
 }
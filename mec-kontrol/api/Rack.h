@@ -1,14 +1,21 @@
 #pragma once
 
 #include "Entity.h"
+#include "AsyncWriter.h"
+#include "ChangeSource.h"
+#include "FsIndex.h"
 #include "ParamValue.h"
 #include "Parameter.h"
+#include "Snapshot.h"
 
+#include <atomic>
+#include <chrono>
 #include <map>
 #include <unordered_map>
 #include <string>
 #include <vector>
 #include <memory>
+#include <mutex>
 #include <set>
 
 class cJSON;
@@ -17,6 +24,21 @@ namespace Kontrol {
 
 class Module;
 
+// a param in a set changed together, valid for the duration of the notification
+// value_ is the value it changed to, listeners called on another thread should use it rather than current()
+struct ChangedParam {
+    const Module *module_;
+    const Parameter *param_;
+    ParamValue value_;
+};
+
+// a value to apply with KontrolModel::changeParams
+struct ParamChange {
+    EntityId moduleId_;
+    EntityId paramId_;
+    ParamValue value_;
+};
+
 typedef std::unordered_map<unsigned, std::vector<EntityId>> MidiMap;
 
 typedef std::unordered_map<unsigned, std::vector<EntityId>> ModulationMap;
@@ -28,9 +50,9 @@ public:
 
     ModulePresetValue(const ModulePresetValue &src) : paramId_(src.paramId_), value_(src.value_) { ; }
 
-    const EntityId &paramId() { return paramId_; }
+    const EntityId &paramId() const { return paramId_; }
 
-    ParamValue value() { return value_; }
+    ParamValue value() const { return value_; }
 
 private:
     EntityId paramId_;
@@ -81,8 +103,12 @@ private:
     std::vector<ModulePresetValue> values_;
 };
 
+typedef std::unordered_map<EntityId, ModulePreset> RackPreset;
+
 
 class KontrolModel;
+class PresetCache;
+class PresetMorph;
 
 
 class Rack : public Entity {
@@ -96,9 +122,18 @@ public:
                 dataDir_("./data/orac"),
                 mediaDir_("./media"),
                 userModuleDir_("./usermodules"),
-                moduleDir_("modules") {
+                moduleDir_("modules"),
+                indexStarted_(false),
+                generation_(0),
+                rackPreset_(std::make_shared<const RackPreset>()),
+                presetCacheSize_(0),
+                morphMidiCC_(-1),
+                morphBus_(-1),
+                midiState_() {
     }
 
+    ~Rack();
+
     void initPrefs();
 
     static EntityId createId(const std::string &host, unsigned port) {
@@ -109,6 +144,11 @@ public:
     std::shared_ptr<Module> getModule(const EntityId &moduleId);
     void addModule(const std::shared_ptr<Module> &module);
 
+    // index based access, see ParamHandle
+    unsigned moduleIndex(const EntityId &moduleId) const;
+    unsigned moduleIndex(const Module *module) const;
+    std::shared_ptr<Module> moduleAt(unsigned idx) const;
+
 
     bool loadModuleDefinitions(const EntityId &moduleId, const mec::Preferences &prefs);
 
@@ -117,12 +157,34 @@ public:
 
     bool saveSettings();
     bool saveSettings(const std::string &filename);
+    // wait for background saves to be written
+    void flushSaves() { writer_.flush(); }
+    // parsed preset, from the preset cache
+    std::shared_ptr<const RackPreset> getPreset(const std::string &presetId);
+
+    // morph between presets, position 0..1 spans all presets, see PresetMorph
+    bool morphPresets(const std::vector<std::string> &presetIds);
+    // applied by the owner, from other threads the position is queued for it (and 0 returned)
+    unsigned morph(float position);
+    // smoothing of midi, modulation and remote changes for all modules, 0 = off, see ParamSlew
+    void slewTime(ParameterType type, float ms);
+
+    // morph position driven by a midi cc ((ch * 128) + cc) or modulation bus, -1 = none
+    void morphMidiCC(int midiCC) { morphMidiCC_ = midiCC; }
+    void morphModulation(int bus) { morphBus_ = bus; }
 
     // local racks
     bool loadPreset(std::string presetId);
-    bool savePreset(std::string presetId);
+    // saves are written in the background, savePreset listeners are called by the owner once written,
+    // with src, a failed write is logged and listeners are not called
+    bool savePreset(std::string presetId, ChangeSource src = CS_LOCAL);
     std::vector<std::string> getPresetList();
 
+    // presets are read from params.bin if current, otherwise params.json, and params.bin is regenerated
+    // in the background on writer, if given
+    static std::shared_ptr<RackPreset> readFilePreset(const std::string &dir, AsyncWriter *writer = nullptr);
+    static bool writeJsonPreset(const std::string &filename, const RackPreset &preset);
+
     const std::string &mainDir() const { return mainDir_; }
     const std::string &dataDir() const { return dataDir_; }
     const std::string &mediaDir() const { return mediaDir_; }
@@ -134,13 +196,36 @@ public:
     void moduleDir(const std::string &d) { moduleDir_ = d; }
     void userModuleDir(const std::string &d) { userModuleDir_ = d; }
 
+    // parsed presets kept in memory, 0 = default size
+    void presetCacheSize(unsigned n);
+
     // used on non-local rack
     const std::string &currentPreset() const { return currentPreset_; }
 
     void currentPreset(const std::string &preset) { currentPreset_ = preset; }
 
 
+    // midiCC is (ch * 128) + cc, 7 bit value
+    // 14 bit pairs (cc 0-31 msb, 32-63 lsb) and nrpn (99/98 + 6/38) are decoded per channel.
+    // once a controller has sent an lsb, its msb is held until the lsb arrives, so a pair is one change,
+    // or sent alone by processHeldMidi if the lsb has not arrived within MIDI_LSB_WAIT_MS
     bool changeMidiCC(unsigned midiCC, unsigned midiValue);
+    bool changeMidiCC14(unsigned midiCC, unsigned midiValue);
+    bool changeMidiNRPN(unsigned ch, unsigned nrpn, unsigned midiValue);
+
+    // mapping id to learn for midiCC, the nrpn id if midiCC is nrpn data entry
+    unsigned midiLearnId(unsigned midiCC) const;
+
+    static constexpr unsigned MIDI_LSB_WAIT_MS = 5;
+    // send held msbs whose lsb is overdue, called by the owner at control rate, see KontrolModel::processSlew
+    unsigned processHeldMidi();
+    // msbs held, in all racks, so the owner keeps to control rate while any are
+    static unsigned heldMidi() { return heldMidi_; }
+
+    // nrpn mappings are keyed from MIDI_NRPN_BASE + (ch * 16384) + nrpn
+    static constexpr unsigned MIDI_NRPN_BASE = 0x10000;
+    static unsigned nrpnMappingId(unsigned ch, unsigned nrpn) { return MIDI_NRPN_BASE + (ch * 16384) + nrpn; }
+
     void addMidiCCMapping(unsigned ccnum, const EntityId &moduleId, const EntityId &paramId);
     void removeMidiCCMapping(unsigned ccnum, const EntityId &moduleId, const EntityId &paramId);
 
@@ -149,6 +234,13 @@ public:
     void addModulationMapping(const std::string &src, unsigned bus, const EntityId &moduleId, const EntityId &paramId);
     void removeModulationMapping(const std::string &src, unsigned bus, const EntityId &moduleId, const EntityId &paramId);
 
+    // midi/modulation dispatch tables are rebuilt on the model owner thread, and published for readers
+    // (e.g. the midi thread), call if modules/params/mappings change
+    void invalidateDispatch();
+
+    // listeners are notified once for all changes, see KontrolModel::changeParams
+    unsigned changeParams(ChangeSource src, const std::vector<ParamChange> &changes);
+
 
     static std::shared_ptr<KontrolModel> model();
 
@@ -159,8 +251,13 @@ public:
     void publishCurrentValues() const;
 
     std::set<std::string> getResourceTypes();
-    const std::set<std::string> &getResources(const std::string &type);
+    std::set<std::string> getResources(const std::string &type);
     void addResource(const std::string &type, const std::string &resource);
+    void removeResource(const std::string &type, const std::string &resource);
+
+    // add resources found under dir, using the rack's resource index (dataDir_), which then
+    // keeps them up to date as the directory changes
+    std::vector<std::string> indexResources(const std::string &resType, FsIndex::Kind kind, const std::string &dir);
 
 
     void dumpSettings() const;
@@ -172,14 +269,66 @@ public:
     unsigned port() const { return port_; }
 
 private:
-    typedef std::unordered_map<EntityId, ModulePreset> RackPreset;
     bool loadFilePreset(const std::string &presetId);
-    bool saveFilePreset(const std::string &presetId);
+    bool saveFilePreset(const std::string &presetId, ChangeSource src);
 
-    bool loadModulePreset(RackPreset &rackPreset, const EntityId &moduleId, const mec::Preferences &prefs);
-    bool saveModulePreset(ModulePreset &, cJSON *root);
+    std::shared_ptr<PresetCache> presetCache();
+    void prefetchPresets(const std::string &presetId);
+    static bool loadModulePreset(RackPreset &rackPreset, const EntityId &moduleId, const mec::Preferences &prefs);
+    static bool saveModulePreset(ModulePreset &, cJSON *root);
     bool updateModulePreset(std::shared_ptr<Module> module, ModulePreset &modulePreset);
-    bool applyModulePreset(std::shared_ptr<Module> module, const ModulePreset &modulePreset);
+    bool applyModulePreset(std::shared_ptr<Module> module, const ModulePreset &modulePreset,
+                           std::vector<ParamChange> &changes);
+
+    static void indexChanged(const EntityId &rackId, const std::string &resType, const std::string &res, bool added);
+
+    bool dispatchMidiCC(unsigned mapId, unsigned midiValue, unsigned bits);
+    bool isMidiCCMapped(unsigned mapId);
+
+    // compiled from module midi/modulation mappings
+    struct Dispatch {
+        ParamHandle handle_;
+        std::shared_ptr<Parameter> param_;
+    };
+
+    // params mapped to a midi id or modulation bus
+    typedef std::vector<Dispatch> DispatchSlot;
+
+    static constexpr unsigned MAX_MOD_BUS = 128;
+    struct DispatchTables {
+        std::vector<DispatchSlot> cc_; // (ch * 128) + cc
+        std::unordered_map<unsigned, DispatchSlot> nrpn_; // nrpn and other mapping ids
+        std::vector<DispatchSlot> mod_; // bus < MAX_MOD_BUS
+        std::unordered_map<unsigned, DispatchSlot> modExt_; // bus >= MAX_MOD_BUS
+
+        const DispatchSlot *midi(unsigned mapId) const;
+        const DispatchSlot *modulation(unsigned bus) const;
+    };
+
+    void buildDispatch();
+
+    static constexpr unsigned MIDI_CHANNELS = 16;
+    struct MidiChannelState {
+        unsigned char ccMsb_[32];
+        unsigned nrpn_;
+        unsigned char nrpnMsb_;
+        bool nrpnActive_;
+        uint32_t ccLsbSeen_; // bit per msb cc, set once its lsb has been seen, so the msb is held for it
+        uint32_t ccHeld_; // bit per msb cc, msb in ccMsb_ not yet sent
+        bool nrpnLsbSeen_;
+        bool nrpnHeld_; // nrpnMsb_ not yet sent, for heldNrpn_
+        unsigned heldNrpn_;
+        std::chrono::steady_clock::time_point heldAt_[33]; // per msb cc, then nrpn
+    };
+    // a held msb, sent outside the lock
+    struct HeldMidi {
+        bool nrpn_;
+        unsigned ch_;
+        unsigned id_; // midiCC or nrpn
+        unsigned value_;
+    };
+    void releaseHeldMidi(MidiChannelState &state, unsigned ch, bool all,
+                         std::chrono::steady_clock::time_point now, std::vector<HeldMidi> &out);
 
     // platform prefs
     std::string host_;
@@ -194,12 +343,41 @@ private:
     std::string currentPreset_;
 
     std::string settingsFile_;
+    // preset and settings saves, pending saves are written when the rack is destroyed
+    AsyncWriter writer_;
+    // presets and module types found on disk, see indexResources
+    FsIndex index_;
+    bool indexStarted_;
     std::shared_ptr<mec::Preferences> settings_;
 
-    std::map<EntityId, std::shared_ptr<Module>> modules_;
-    std::unordered_map<std::string, std::set<std::string>> resources_;
-    std::vector<std::string> presets_;
-    RackPreset rackPreset_;
+    // structure, read from any thread, replaced when modules are added
+    struct ModuleTable {
+        std::map<EntityId, std::shared_ptr<Module>> modules_;
+        std::vector<std::shared_ptr<Module>> index_; // in creation order
+    };
+    Snapshot<ModuleTable> moduleTable_;
+    std::atomic<uint16_t> generation_; // last given to a module, so a replaced module's handles are stale
+    // changed by the owner and the index, read from any thread
+    struct ResourceTable {
+        std::unordered_map<std::string, std::set<std::string>> resources_;
+        std::vector<std::string> presets_; // in index order, for next/prev
+    };
+    Snapshot<ResourceTable> resources_;
+    std::shared_ptr<const RackPreset> rackPreset_; // shared with the cache, replaced on load and save
+    unsigned presetCacheSize_;
+    std::mutex presetCacheMutex_;
+    std::string presetCacheDir_; // presetCache_ is rebuilt if the data dir changes
+    std::shared_ptr<PresetCache> presetCache_;
+    AtomicShared<PresetMorph> morph_;
+    std::map<ParameterType, float> slewTimes_;
+    std::atomic<int> morphMidiCC_;
+    std::atomic<int> morphBus_;
+    mutable std::mutex midiStateMutex_;
+    MidiChannelState midiState_[MIDI_CHANNELS];
+    std::vector<HeldMidi> heldOut_; // owner only, reused by processHeldMidi
+    static std::atomic<unsigned> heldMidi_;
+
+    Snapshot<DispatchTables> dispatch_;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Kontrol {
+
+// shared_ptr that can be read and replaced from any thread.
+// std::atomic_load/store on a shared_ptr take a lock from a global pool, so are not used here.
+// loads are wait-free: the current holder is found through an atomic pointer, and copying the
+// shared_ptr out of it only bumps its refcount. a replaced holder is retired, and deleted by a
+// later store once no load is in progress, so stores never wait for readers.
+// stores are serialised between themselves, and are expected to be infrequent
+template<typename T>
+class AtomicShared {
+public:
+    AtomicShared() : current_(new std::shared_ptr<T>()), readers_(0) { ; }
+
+    explicit AtomicShared(std::shared_ptr<T> value) : current_(new std::shared_ptr<T>(std::move(value))), readers_(0) {
+        ;
+    }
+
+    ~AtomicShared() {
+        for (auto p : retired_) delete p;
+        delete current_.load();
+    }
+
+    std::shared_ptr<T> load() const {
+        // seq_cst pairs with store, either it sees this reader, or this reader sees the new holder
+        readers_.fetch_add(1);
+        std::shared_ptr<T> ret = *current_.load();
+        readers_.fetch_sub(1);
+        return ret;
+    }
+
+    void store(std::shared_ptr<T> value) {
+        std::lock_guard<std::mutex> lock(writeMutex_);
+        storeLocked(std::move(value));
+    }
+
+protected:
+    // caller holds writeMutex_, e.g. to read, modify and store
+    void storeLocked(std::shared_ptr<T> value) {
+        retired_.push_back(current_.exchange(new std::shared_ptr<T>(std::move(value))));
+        // readers arriving from now on only see the new holder
+        if (readers_.load() == 0) {
+            for (auto p : retired_) delete p;
+            retired_.clear();
+        }
+    }
+
+    std::mutex writeMutex_;
+
+private:
+    AtomicShared(const AtomicShared &) = delete;
+    AtomicShared &operator=(const AtomicShared &) = delete;
+
+    std::atomic<std::shared_ptr<T> *> current_;
+    mutable std::atomic<unsigned> readers_;
+    std::vector<std::shared_ptr<T> *> retired_; // guarded by writeMutex_
+};
+
+// copy on write holder (rcu style) for structure shared between threads.
+// readers take an immutable snapshot without waiting, and can keep using it while it is replaced.
+// writers copy, modify and publish under a mutex, so are expected to be infrequent (creation, deletion)
+template<typename T>
+class Snapshot : private AtomicShared<const T> {
+public:
+    Snapshot() : AtomicShared<const T>(std::make_shared<const T>()) { ; }
+
+    std::shared_ptr<const T> get() const { return this->load(); }
+
+    template<typename F>
+    void update(F f) {
+        std::lock_guard<std::mutex> lock(this->writeMutex_);
+        auto copy = std::make_shared<T>(*get());
+        f(*copy);
+        this->storeLocked(std::shared_ptr<const T>(std::move(copy)));
+    }
+
+    void set(T value) {
+        std::lock_guard<std::mutex> lock(this->writeMutex_);
+        this->storeLocked(std::shared_ptr<const T>(std::make_shared<T>(std::move(value))));
+    }
+};
+
+} //namespace
@@ -1,4 +1,5 @@
 #include "KontrolMonitor.h"
+#include "KontrolRack.h"
 #include <KontrolModel.h>
 
 #include "../m_pd.h"
@@ -11,25 +12,41 @@ static t_class *KontrolMonitor_class;
 struct t_KontrolMonitor {
     t_object x_obj;
     t_symbol *symbol;
+    // resolved once, rather than on each bang
+    t_symbol *rangeSymbol;
+    t_symbol *nameSymbol;
+    t_symbol *loadSymbol;
+    t_symbol *displayName;
+    Kontrol::ParamHandle displayHandle; // of the param displayName was resolved from
 
     char *rack;
     char *module;
     char *param;
+    Kontrol::ParamHandle handle;
+    t_KontrolRackWake *wake;
 };
 
-t_KontrolMonitor * KontrolMonitor_new(t_symbol *symbol, const Kontrol::Rack &rack, const Kontrol::Module &module, const Kontrol::Parameter &param) {
+t_KontrolMonitor * KontrolMonitor_new(t_symbol *symbol, const Kontrol::Rack &rack, const Kontrol::Module &module, const Kontrol::Parameter &param,
+                                      t_KontrolRackWake *wake) {
     auto *x = (t_KontrolMonitor*)pd_new(KontrolMonitor_class);
 
     x->symbol = symbol;
     x->rack = strdup(rack.id().c_str());
     x->module = strdup(module.id().c_str());
     x->param = strdup(param.id().c_str());
-
-    pd_bind(&x->x_obj.ob_pd, x->symbol);
+    x->handle = Kontrol::KontrolModel::model()->getParamHandle(rack.id(), module.id(), param.id());
+    x->wake = wake;
 
     std::string symbolString = std::string(x->symbol->s_name);
+    x->rangeSymbol = gensym((symbolString + "-range").c_str());
+    x->nameSymbol = gensym((symbolString + "-name").c_str());
+    x->loadSymbol = gensym((symbolString + "-load").c_str());
+    x->displayName = nullptr;
+    x->displayHandle = Kontrol::ParamHandle::invalid();
 
-    t_pd *range = gensym((symbolString + "-range").c_str())->s_thing;
+    pd_bind(&x->x_obj.ob_pd, x->symbol);
+
+    t_pd *range = x->rangeSymbol->s_thing;
     if (range) {
         t_atom args[2];
         SETFLOAT(&args[0], param.calcMinimum().floatValue());
@@ -37,15 +54,14 @@ t_KontrolMonitor * KontrolMonitor_new(t_symbol *symbol, const Kontrol::Rack &rac
         pd_forwardmess(range, 2, args);
     }
 
-    pd_bind(&x->x_obj.ob_pd, gensym((symbolString + "-load").c_str()));
+    pd_bind(&x->x_obj.ob_pd, x->loadSymbol);
 
     return x;
 }
 
 void KontrolMonitor_free(t_KontrolMonitor *x) {
-    std::string loadSymbol = std::string(x->symbol->s_name) + "-load";
     pd_unbind(&x->x_obj.ob_pd, x->symbol);
-    pd_unbind(&x->x_obj.ob_pd, gensym(loadSymbol.c_str()));
+    pd_unbind(&x->x_obj.ob_pd, x->loadSymbol);
     free(x->rack);
     free(x->module);
     free(x->param);
@@ -53,20 +69,32 @@ void KontrolMonitor_free(t_KontrolMonitor *x) {
     pd_free((t_pd*)&x->x_obj);
 }
 
+// handles go stale if the module is replaced or redefined, so re-resolve once by id
+static std::shared_ptr<Kontrol::Parameter> KontrolMonitor_param(t_KontrolMonitor *x) {
+    auto model = Kontrol::KontrolModel::model();
+    auto param = model->getParam(x->handle);
+    if (param) return param;
+    x->handle = model->getParamHandle(x->rack, x->module, x->param);
+    return model->getParam(x->handle);
+}
+
 static void KontrolMonitor_float(t_KontrolMonitor *x, t_floatarg f) {
-    Kontrol::KontrolModel::model()->changeParam(Kontrol::CS_LOCAL, x->rack, x->module, x->param, f);
+    auto model = Kontrol::KontrolModel::model();
+    if (!model->changeParam(Kontrol::CS_LOCAL, x->handle, f)) {
+        x->handle = model->getParamHandle(x->rack, x->module, x->param);
+        model->changeParam(Kontrol::CS_LOCAL, x->handle, f);
+    }
+    // the device may have started a popup, so the rack sets its clock for the popup's deadline
+    if (x->wake) KontrolRack_wake(x->wake);
 }
 
 static void KontrolMonitor_bang(t_KontrolMonitor *x) {
-    auto model = Kontrol::KontrolModel::model();
-    auto rack = model->getRack(x->rack);
-    auto module = model->getModule(rack, x->module);
-    auto param = model->getParam(module, x->param);
+    auto param = KontrolMonitor_param(x);
 
     if (!param)
         return;
 
-    float value = param->current().floatValue();
+    float value = param->currentFloat();
     float min = param->calcMinimum().floatValue();
     float max = param->calcMaximum().floatValue();
 
@@ -77,8 +105,7 @@ static void KontrolMonitor_bang(t_KontrolMonitor *x) {
         pd_forwardmess(sendsym, 1, &arg);
     }
 
-    std::string symbolString = x->symbol->s_name;
-    t_pd *range = gensym((symbolString + "-range").c_str())->s_thing;
+    t_pd *range = x->rangeSymbol->s_thing;
     if (range) {
         t_atom args[2];
         SETFLOAT(&args[0], min);
@@ -86,17 +113,22 @@ static void KontrolMonitor_bang(t_KontrolMonitor *x) {
         pd_forwardmess(range, 2, args);
     }
 
-    t_pd *name = gensym((symbolString + "-name").c_str())->s_thing;
+    t_pd *name = x->nameSymbol->s_thing;
     if (name) {
         t_atom arg;
 
-        std::string displayName = param->displayName();
-        for (auto &c : displayName) {
-            if (c == ' ')
-                c = '_';
+        // handle is current, as param was just resolved from it
+        if (!(x->displayHandle == x->handle)) {
+            std::string displayName = param->displayName();
+            for (auto &c : displayName) {
+                if (c == ' ')
+                    c = '_';
+            }
+            x->displayName = gensym(displayName.c_str());
+            x->displayHandle = x->handle;
         }
 
-        SETSYMBOL(&arg, gensym(displayName.c_str()));
+        SETSYMBOL(&arg, x->displayName);
         pd_forwardmess(name, 1, &arg);
     }
 }
@@ -3,6 +3,7 @@
 #include "../m_pd.h"
 
 struct t_KontrolMonitor;
+struct t_KontrolRackWake;
 
 namespace Kontrol {
     class Rack;
@@ -10,6 +11,8 @@ namespace Kontrol {
     class Parameter;
 }
 
-t_KontrolMonitor * KontrolMonitor_new(t_symbol *symbol, const Kontrol::Rack &rack, const Kontrol::Module &module, const Kontrol::Parameter &param);
+// wake is the owning rack's (may be nullptr), it must outlive the monitor
+t_KontrolMonitor * KontrolMonitor_new(t_symbol *symbol, const Kontrol::Rack &rack, const Kontrol::Module &module, const Kontrol::Parameter &param,
+                                      t_KontrolRackWake *wake);
 void KontrolMonitor_free(t_KontrolMonitor *obj);
 void KontrolMonitor_setup(void);
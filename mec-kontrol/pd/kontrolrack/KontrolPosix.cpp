@@ -2,9 +2,71 @@
 
 #include "KontrolRack.h"
 
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
+
+// pd's fd polling (see s_stuff.h), handlers are called on the pd thread by the scheduler
+extern "C" {
+typedef void (*t_fdpollfn)(void *ptr, int fd);
+EXTERN void sys_addpollfn(int fd, t_fdpollfn fn, void *ptr);
+EXTERN void sys_rmpollfn(int fd);
+}
+
 __attribute__((destructor)) void kontrol_uninit(void)
 {
     KontrolRack_cleanup();
 }
 
+
+// self pipe, written by other threads and polled by pd
+struct t_KontrolRackWake {
+    t_KontrolRack *x_;
+    int fds_[2];
+    std::atomic<bool> pending_;
+};
+
+static void KontrolRack_wakeRead(void *ptr, int fd) {
+    auto wake = static_cast<t_KontrolRackWake *>(ptr);
+    char buf[16];
+    while (read(fd, buf, sizeof(buf)) > 0);
+    // cleared before the tick, so input arriving during it wakes us again
+    wake->pending_ = false;
+    KontrolRack_tick(wake->x_);
+}
+
+static void KontrolRack_wakeDelete(t_KontrolRackWake *wake) {
+    close(wake->fds_[0]);
+    close(wake->fds_[1]);
+    delete wake;
+}
+
+std::shared_ptr<t_KontrolRackWake> KontrolRack_wakeNew(t_KontrolRack *x) {
+    int fds[2];
+    if (pipe(fds) != 0) return nullptr;
+    for (int fd : fds) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    auto wake = new t_KontrolRackWake;
+    wake->x_ = x;
+    wake->fds_[0] = fds[0];
+    wake->fds_[1] = fds[1];
+    wake->pending_ = false;
+    sys_addpollfn(fds[0], KontrolRack_wakeRead, wake);
+    return std::shared_ptr<t_KontrolRackWake>(wake, KontrolRack_wakeDelete);
+}
+
+void KontrolRack_wake(t_KontrolRackWake *wake) {
+    if (wake->pending_.exchange(true)) return;
+    char c = 0;
+    // a full pipe is already pending
+    ssize_t n = write(wake->fds_[1], &c, 1);
+    (void) n;
+}
+
+void KontrolRack_wakeStop(t_KontrolRackWake *wake) {
+    sys_rmpollfn(wake->fds_[0]);
+}
+
 #endif
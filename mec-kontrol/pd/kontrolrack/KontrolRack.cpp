@@ -12,6 +12,7 @@
 
 #include <algorithm>
 #include <clocale>
+#include <thread>
 
 #if ! DISABLE_TTUI
     #include "devices/TerminalTedium.h"
@@ -70,10 +71,10 @@ private:
 
 // puredata methods implementation - start
 
-static const unsigned OSC_POLL_FREQUENCY = 1; // 10ms
-static const unsigned DEVICE_POLL_FREQUENCY = 1; // 10ms
 static const unsigned OSC_PING_FREQUENCY_SEC = 5;
-static const unsigned OSC_PING_FREQUENCY = (OSC_PING_FREQUENCY_SEC * (1000 / 10)); // 5 seconds
+static const double OSC_PING_MS = OSC_PING_FREQUENCY_SEC * 1000.0;
+// longest sleep when idle, a backstop for timers started without a reschedule
+static const double IDLE_MS = 1000.0;
 
 
 // see https://github.com/pure-data/pure-data/blob/master/src/x_time.c
@@ -133,29 +134,61 @@ void KontrolRack_dspState(bool onoff) {
 
 
 /// main PD methods
+// set the clock for the next deadline, unless it is already due sooner.
+// without a wake, input is only seen by polling, so tick at the control rate
+static void KontrolRack_schedule(t_KontrolRack *x) {
+    double ms = TICK_MS;
+    if (x->wake_ && !x->model_->isSlewing() && !(x->device_ && x->device_->pollRequired())) {
+        ms = IDLE_MS;
+        if (x->osc_broadcaster_ && x->osc_receiver_) {
+            ms = std::min(ms, std::max(OSC_PING_MS - clock_gettimesince(x->lastPing_), 0.0));
+        }
+    }
+
+    double remaining = x->scheduledMs_ - clock_gettimesince(x->scheduledAt_);
+    if (remaining >= 0.0 && remaining <= ms) return;
+    x->scheduledAt_ = clock_getlogicaltime();
+    x->scheduledMs_ = ms;
+    clock_delay(x->x_clock, ms / TICK_MS);
+}
+
 void KontrolRack_tick(t_KontrolRack *x) {
-    x->pollCount_++;
-    if (x->osc_receiver_ && x->pollCount_ % OSC_POLL_FREQUENCY == 0) {
+    // the clock or a wake may have triggered this, so reschedule from scratch
+    x->scheduledMs_ = -1.0;
+
+    // changes from other threads (e.g. completed preset saves)
+    x->model_->processCommands();
+    x->model_->processSlew();
+
+    if (x->osc_receiver_) {
         x->osc_receiver_->poll();
     }
 
-    if (x->device_ && x->pollCount_ % DEVICE_POLL_FREQUENCY == 0) {
+    // device timers count polls, so keep to the control rate however often we are woken
+    if (x->device_ && clock_gettimesince(x->lastDevicePoll_) >= TICK_MS) {
+        x->lastDevicePoll_ = clock_getlogicaltime();
         x->device_->poll();
     }
 
     if (x->osc_broadcaster_ && x->osc_receiver_
-        && x->pollCount_ % OSC_PING_FREQUENCY == 0) {
+        && clock_gettimesince(x->lastPing_) >= OSC_PING_MS) {
+        x->lastPing_ = clock_getlogicaltime();
         x->osc_broadcaster_->sendPing(x->osc_receiver_->port());
     }
 
-    clock_delay(x->x_clock, 1);
+    KontrolRack_schedule(x);
 }
 
 
 void KontrolRack_free(t_KontrolRack *x) {
     clock_free(x->x_clock);
+    if (x->wake_) KontrolRack_wakeStop(x->wake_.get());
+    x->model_->commandNotify(nullptr);
+    if (x->osc_receiver_) x->osc_receiver_->readyNotify(nullptr);
     x->model_->deleteRack(Kontrol::CS_LOCAL, x->model_->localRackId());
     x->model_->clearCallbacks();
+    x->model_->ownerThread(std::thread::id());
+    x->model_->processCommands();
     if (x->osc_receiver_) x->osc_receiver_->stop();
     x->osc_receiver_.reset();
     x->device_.reset();
@@ -164,11 +197,14 @@ void KontrolRack_free(t_KontrolRack *x) {
         KontrolMonitor_free(p.second);
     }
     delete x->param_monitors_;
+    delete x->param_symbols_;
+    x->wake_.reset();
 }
 
 void *KontrolRack_new(t_symbol* sym, int argc, t_atom *argv) {
     t_KontrolRack *x = (t_KontrolRack *) pd_new(KontrolRack_class);
     x->param_monitors_ = new std::unordered_map<t_symbol *, t_KontrolMonitor*>();
+    x->param_symbols_ = new std::unordered_map<uint64_t, t_symbol *>();
 
     int clientport = 0;
     int serverport = 0;
@@ -207,8 +243,19 @@ void *KontrolRack_new(t_symbol* sym, int argc, t_atom *argv) {
     x->single_module_mode_ = false;
     x->monitor_enable_ = false;
 
-    x->pollCount_ = 0;
     x->model_ = Kontrol::KontrolModel::model();
+    // pd thread owns the model, so listeners (which send to pd) are only called on it
+    x->model_->ownerThread(std::this_thread::get_id());
+
+    x->lastDevicePoll_ = clock_getlogicaltime();
+    x->lastPing_ = clock_getlogicaltime();
+    x->scheduledAt_ = clock_getlogicaltime();
+    x->scheduledMs_ = -1.0;
+    x->wake_ = KontrolRack_wakeNew(x);
+    if (x->wake_) {
+        auto wake = x->wake_;
+        x->model_->commandNotify([wake] { KontrolRack_wake(wake.get()); });
+    }
 
     x->model_->createLocalRack((unsigned int) clientport);
     x->model_->localRack()->initPrefs();
@@ -249,7 +296,7 @@ void *KontrolRack_new(t_symbol* sym, int argc, t_atom *argv) {
 
     x->x_clock = clock_new(x, (t_method) KontrolRack_tick);
     clock_setunit(x->x_clock, TICK_MS, 0);
-    clock_delay(x->x_clock, 1);
+    KontrolRack_schedule(x);
 
     KontrolRack_loadresources(x);
 
@@ -334,6 +381,19 @@ EXTERN void KontrolRack_setup(void) {
                     (t_method) KontrolRack_savecurrentpreset, gensym("savecurrentpreset"),
                     A_NULL);
 
+    class_addmethod(KontrolRack_class,
+                    (t_method) KontrolRack_morphpresets, gensym("morphpresets"),
+                    A_GIMME, A_NULL);
+    class_addmethod(KontrolRack_class,
+                    (t_method) KontrolRack_morph, gensym("morph"),
+                    A_DEFFLOAT, A_NULL);
+    class_addmethod(KontrolRack_class,
+                    (t_method) KontrolRack_morphcc, gensym("morphcc"),
+                    A_DEFFLOAT, A_DEFFLOAT, A_NULL);
+    class_addmethod(KontrolRack_class,
+                    (t_method) KontrolRack_morphbus, gensym("morphbus"),
+                    A_DEFFLOAT, A_NULL);
+
     class_addmethod(KontrolRack_class,
                     (t_method) KontrolRack_loadmodule, gensym("loadmodule"),
                     A_DEFSYMBOL, A_DEFSYMBOL, A_NULL);
@@ -418,15 +478,20 @@ void KontrolRack_loadmodule(t_KontrolRack *x, t_symbol *modId, t_symbol *modType
 
     std::string mType = modType->s_name;
 
-
+    x->param_symbols_->clear();
 
     // load the module
     std::string module_dir = rack->moduleDir();
     struct stat st;
     if (rack->userModuleDir().length() > 0) {
-        std::string module = rack->userModuleDir() + "/" + mType + "/module.pd";
-        int fs = stat(module.c_str(), &st);
-        if(fs == 0) {
+        // catalogued at startup, only modules added since need checking on disk
+        std::string baseDir = Kontrol::KontrolModel::model()->moduleCatalogue().baseDir(mType);
+        bool user = baseDir == rack->userModuleDir();
+        if (baseDir.empty()) {
+            std::string module = rack->userModuleDir() + "/" + mType + "/module.pd";
+            user = stat(module.c_str(), &st) == 0;
+        }
+        if(user) {
             module_dir = rack->userModuleDir();
             post ("loading user module %s", mType.c_str());
         }
@@ -597,6 +662,7 @@ void KontrolRack_loadmodule(t_KontrolRack *x, t_symbol *modId, t_symbol *modType
 void KontrolRack_singlemodulemode(t_KontrolRack *x, t_floatarg f) {
     bool enable = f >= 0.5f;
     post("KontrolRack: single module mode -> %d", enable);
+    if (x->single_module_mode_ != enable) x->param_symbols_->clear();
     x->single_module_mode_ = enable;
 }
 
@@ -631,6 +697,10 @@ void KontrolRack_connect(t_KontrolRack *x, t_floatarg f) {
 void KontrolRack_listen(t_KontrolRack *x, t_floatarg f) {
     if (f > 0) {
         auto p = std::make_shared<Kontrol::OSCReceiver>(x->model_);
+        if (x->wake_) {
+            auto wake = x->wake_;
+            p->readyNotify([wake] { KontrolRack_wake(wake.get()); });
+        }
         if (p->listen((unsigned) f)) {
             x->osc_receiver_ = p;
         }
@@ -641,34 +711,42 @@ void KontrolRack_listen(t_KontrolRack *x, t_floatarg f) {
 
 void KontrolRack_enc(t_KontrolRack *x, t_floatarg f) {
     if (x->device_) x->device_->changeEncoder(0, f);
+    KontrolRack_schedule(x);
 }
 
 void KontrolRack_encbut(t_KontrolRack *x, t_floatarg f) {
     if (x->device_) x->device_->encoderButton(0, (bool) f);
+    KontrolRack_schedule(x);
 }
 
 void KontrolRack_knob1Raw(t_KontrolRack *x, t_floatarg f) {
     if (x->device_) x->device_->changePot(0, f);
+    KontrolRack_schedule(x);
 }
 
 void KontrolRack_knob2Raw(t_KontrolRack *x, t_floatarg f) {
     if (x->device_) x->device_->changePot(1, f);
+    KontrolRack_schedule(x);
 }
 
 void KontrolRack_knob3Raw(t_KontrolRack *x, t_floatarg f) {
     if (x->device_) x->device_->changePot(2, f);
+    KontrolRack_schedule(x);
 }
 
 void KontrolRack_knob4Raw(t_KontrolRack *x, t_floatarg f) {
     if (x->device_) x->device_->changePot(3, f);
+    KontrolRack_schedule(x);
 }
 
 void KontrolRack_midiCC(t_KontrolRack *x, t_floatarg ch, t_floatarg cc, t_floatarg value) {
     if (x->device_) x->device_->midiCC(unsigned (ch * 128 + cc) , (unsigned) value);
+    KontrolRack_schedule(x);
 }
 
 void KontrolRack_key(t_KontrolRack *x, t_floatarg key, t_floatarg value) {
     if (x->device_) x->device_->keyPress((unsigned) key, (unsigned) value);
+    KontrolRack_schedule(x);
 }
 
 void KontrolRack_pgm(t_KontrolRack *x, t_floatarg f) {
@@ -738,6 +816,39 @@ void KontrolRack_prevpreset(t_KontrolRack *x) {
 }
 
 
+void KontrolRack_morphpresets(t_KontrolRack *x, t_symbol *s, int argc, t_atom *argv) {
+    auto rack = x->model_->getLocalRack();
+    if (!rack) { post("No local rack found"); return;}
+
+    std::vector<std::string> presets;
+    for (int i = 0; i < argc; i++) {
+        t_atom *arg = argv + i;
+        if (arg->a_type == A_SYMBOL) presets.push_back(atom_getsymbol(arg)->s_name);
+    }
+    if (rack->morphPresets(presets)) {
+        post("morph presets : %d presets", (int) presets.size());
+    } else {
+        post("morph presets : need 2 or more presets");
+    }
+}
+
+void KontrolRack_morph(t_KontrolRack *x, t_floatarg pos) {
+    auto rack = x->model_->getLocalRack();
+    if (rack) rack->morph(pos);
+}
+
+// morph position from midi cc, cc < 0 = off
+void KontrolRack_morphcc(t_KontrolRack *x, t_floatarg ch, t_floatarg cc) {
+    auto rack = x->model_->getLocalRack();
+    if (rack) rack->morphMidiCC(cc < 0 ? -1 : (int) (ch * 128 + cc));
+}
+
+// morph position from modulation bus, bus < 0 = off
+void KontrolRack_morphbus(t_KontrolRack *x, t_floatarg bus) {
+    auto rack = x->model_->getLocalRack();
+    if (rack) rack->morphModulation(bus < 0 ? -1 : (int) bus);
+}
+
 void KontrolRack_savecurrentpreset(t_KontrolRack *x) {
     auto rack = Kontrol::KontrolModel::model()->getLocalRack();
     if (!rack) {
@@ -826,6 +937,7 @@ void KontrolRack_modulate(t_KontrolRack *x, t_symbol* src, t_floatarg bus, t_flo
     if (x->device_) {
         x->device_->modulate(src->s_name, (unsigned) bus, value);
     }
+    KontrolRack_schedule(x);
 }
 
 
@@ -846,7 +958,7 @@ void KontrolRack_setparam(t_KontrolRack* x, t_symbol* modId, t_symbol* paramId,
                         rack->id(),
                         module->id(),
                         param->id(),
-                        param->calcFloat(value)
+                        param->normalisedValue(value)
                         );
             }
         }
@@ -931,41 +1043,6 @@ void KontrolRack_getsetting(t_KontrolRack* x,
 }
 
 
-void loadModuleDir(const std::string& baseDir, const std::string& subDir) {
-    auto rack = Kontrol::KontrolModel::model()->getLocalRack();
-
-    struct stat st;
-    struct dirent **namelist;
-    std::string dir = baseDir;
-    if(subDir.length()>0) dir = baseDir + "/" + subDir;
-
-    int n = scandir(dir.c_str(), &namelist, NULL, alphasort);
-    if (n > 0) {
-        for (int i = 0; i < n; i++) {
-            if (namelist[i]->d_type == DT_DIR &&
-                strcmp(namelist[i]->d_name, "..") != 0
-                && strcmp(namelist[i]->d_name, ".") != 0) {
-
-                std::string mname = std::string(namelist[i]->d_name);
-                if(subDir.length()>0) mname = subDir + "/" + mname;
-
-                std::string module = baseDir + "/" + mname + "/module.pd";
-                int fs = stat(module.c_str(), &st);
-                if (fs == 0) {
-                    rack->addResource("module", mname);
-                    post("KontrolRack::module found: %s", mname.c_str());
-                } else {
-                    loadModuleDir(baseDir, mname);
-                }
-            }
-            free(namelist[i]);
-        }
-        free(namelist);
-    }
-
-}
-
-
 void KontrolRack_loadresources(t_KontrolRack *x) {
     post("KontrolRack::loading resources");
 
@@ -973,18 +1050,26 @@ void KontrolRack_loadresources(t_KontrolRack *x) {
     if (rack == nullptr) return;
 
     //load available modules
-    struct dirent **namelist;
-    struct stat st;
-
     std::setlocale(LC_ALL, "en_US.UTF-8");
 
     std::string moddir;
     if(rack->moduleDir().at(0)=='/') moddir = rack->moduleDir();
     else moddir = rack->mainDir()+"/"+rack->moduleDir();
 
-    loadModuleDir(moddir,"");
+    std::vector<std::string> dirs = { moddir };
     if (rack->userModuleDir().length() > 0) {
-        loadModuleDir(rack->userModuleDir(),"");
+        dirs.push_back(rack->userModuleDir());
+    }
+
+    // only rescanned if changed since indexed, modules added later are picked up by the index.
+    // definitions are parsed in the background, module patches are warmed as the module menu reaches them
+    auto &catalogue = Kontrol::KontrolModel::model()->moduleCatalogue();
+    for (const auto &dir : dirs) {
+        auto modules = rack->indexResources("module", Kontrol::FsIndex::K_MODULES, dir);
+        catalogue.add(dir, modules);
+        for (const auto &mname : modules) {
+            post("KontrolRack::module found: %s", mname.c_str());
+        }
     }
 }
 
@@ -1004,6 +1089,19 @@ static std::string getParamSymbol(bool singleModuleMode, const Kontrol::Module &
     }
 }
 
+// gensym is a symbol table lookup, so resolve once per parameter.
+// symbols live as long as pd, but s_thing is read on each send as receivers come and go
+static t_symbol *KontrolRack_paramSymbol(t_KontrolRack *x, const Kontrol::Rack &rack,
+                                         const Kontrol::Module &module, const Kontrol::Parameter &param) {
+    auto h = Kontrol::KontrolModel::model()->getParamHandle(rack, module, param);
+    if (!h.valid()) return gensym(getParamSymbol(x->single_module_mode_, module, param).c_str());
+    auto it = x->param_symbols_->find(h.key());
+    if (it != x->param_symbols_->end()) return it->second;
+    t_symbol *symbol = gensym(getParamSymbol(x->single_module_mode_, module, param).c_str());
+    (*x->param_symbols_)[h.key()] = symbol;
+    return symbol;
+}
+
 void KontrolRack_setmoduleorder(t_KontrolRack *x,t_symbol* s, int argc, t_atom *argv) {
     std::string buf;
     for(int i=0; i<argc;i++) {
@@ -1024,10 +1122,12 @@ void KontrolRack_setmoduleorder(t_KontrolRack *x,t_symbol* s, int argc, t_atom *
 
 void KontrolRack_selectpage(t_KontrolRack* x, t_floatarg page) {
     if (x->device_) x->device_->selectPage((unsigned) page);
+    KontrolRack_schedule(x);
 }
 
 void KontrolRack_selectmodule(t_KontrolRack* x, t_floatarg module) {
     if (x->device_) x->device_->selectModule((unsigned) module);
+    KontrolRack_schedule(x);
 }
 
 
@@ -1049,10 +1149,7 @@ void PdCallback::changed(Kontrol::ChangeSource src,
     auto prack = Kontrol::KontrolModel::model()->getLocalRack();
     if (prack == nullptr || prack->id() != rack.id()) return;
 
-    std::string sendsym = getParamSymbol(x_->single_module_mode_, module, param);
-
-    t_pd *sendobj = gensym(sendsym.c_str())->s_thing;
-
+    t_pd *sendobj = KontrolRack_paramSymbol(x_, rack, module, param)->s_thing;
 
     if (!sendobj) {
         post("send to %s failed", param.id().c_str());
@@ -1063,7 +1160,7 @@ void PdCallback::changed(Kontrol::ChangeSource src,
     switch (param.current().type()) {
         case Kontrol::ParamValue::T_Float : {
 //            post("changed : %s %f", sendsym.c_str(),param.current().floatValue());
-            SETFLOAT(&a, param.current().floatValue());
+            SETFLOAT(&a, param.currentFloat());
             break;
         }
         case Kontrol::ParamValue::T_String:
@@ -1081,10 +1178,10 @@ void PdCallback::param(Kontrol::ChangeSource src,
                        const Kontrol::Parameter &param) {
     PdCallback::changed(src, rack, module, param);
 
-    t_symbol *symbol = gensym(getParamSymbol(x_->single_module_mode_, module, param).c_str());
+    t_symbol *symbol = KontrolRack_paramSymbol(x_, rack, module, param);
 
     if (x_->monitor_enable_ && x_->param_monitors_->find(symbol) == x_->param_monitors_->end()) {
-        t_KontrolMonitor *x = (t_KontrolMonitor*)KontrolMonitor_new(symbol, rack, module, param);
+        t_KontrolMonitor *x = (t_KontrolMonitor*)KontrolMonitor_new(symbol, rack, module, param, x_->wake_.get());
 
         (*x_->param_monitors_)[symbol] = x;
     }
@@ -13,6 +13,7 @@
 #include <unordered_map>
 
 struct t_KontrolMonitor;
+struct t_KontrolRackWake;
 
 typedef struct _KontrolRack {
     t_object x_obj;
@@ -21,7 +22,13 @@ typedef struct _KontrolRack {
     std::shared_ptr<Kontrol::KontrolModel> model_;
     std::shared_ptr<KontrolDevice> device_;
 
-    long pollCount_;
+    // the clock is only set for the next deadline (device timers, slew, ping),
+    // input from other threads wakes the rack, see KontrolRack_wakeNew
+    std::shared_ptr<t_KontrolRackWake> wake_;
+    double lastDevicePoll_;
+    double lastPing_;
+    double scheduledAt_;
+    double scheduledMs_;
     std::shared_ptr<Kontrol::OSCReceiver> osc_receiver_;
     std::shared_ptr<Kontrol::OSCBroadcaster> osc_broadcaster_;
     t_symbol* active_module_;
@@ -29,6 +36,9 @@ typedef struct _KontrolRack {
     bool monitor_enable_; // Enable monitoring control changes within PD, and forwarding to KontrolModel.
 
     std::unordered_map<t_symbol *, t_KontrolMonitor*> *param_monitors_;
+    // send symbol per parameter, keyed by ParamHandle::key, so params recreated by a reload are not confused.
+    // cleared on module load and single module mode change
+    std::unordered_map<uint64_t, t_symbol *> *param_symbols_;
 } t_KontrolRack;
 
 
@@ -65,6 +75,11 @@ void KontrolRack_savecurrentpreset(t_KontrolRack *x);
 void KontrolRack_nextpreset(t_KontrolRack *x);
 void KontrolRack_prevpreset(t_KontrolRack *x);
 
+void KontrolRack_morphpresets(t_KontrolRack *x, t_symbol *s, int argc, t_atom *argv);
+void KontrolRack_morph(t_KontrolRack *x, t_floatarg pos);
+void KontrolRack_morphcc(t_KontrolRack *x, t_floatarg ch, t_floatarg cc);
+void KontrolRack_morphbus(t_KontrolRack *x, t_floatarg bus);
+
 
 void KontrolRack_loadmodule(t_KontrolRack *x, t_symbol *modId, t_symbol* mod);
 void KontrolRack_singlemodulemode(t_KontrolRack *x, t_floatarg f);
@@ -88,3 +103,11 @@ void KontrolRack_setmoduleorder(t_KontrolRack *x,t_symbol* s, int argc, t_atom *
 }
 
 extern void KontrolRack_cleanup(void);
+
+// platform specific, wakes the pd thread to run KontrolRack_tick.
+// KontrolRack_wake can be called from any thread, for as long as it holds the wake,
+// KontrolRack_wakeStop (pd thread) stops ticks being run, before the rack is freed.
+// KontrolRack_wakeNew returns nullptr if unsupported, in which case the rack polls every tick
+extern std::shared_ptr<t_KontrolRackWake> KontrolRack_wakeNew(t_KontrolRack *x);
+extern void KontrolRack_wake(t_KontrolRackWake *wake);
+extern void KontrolRack_wakeStop(t_KontrolRackWake *wake);
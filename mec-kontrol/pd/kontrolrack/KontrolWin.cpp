@@ -18,4 +18,17 @@ BOOLEAN WINAPI DllMain(
     return TRUE;
 }
 
+// no fd polling in pd on windows, so the rack polls every tick
+std::shared_ptr<t_KontrolRackWake> KontrolRack_wakeNew(t_KontrolRack *) {
+    return nullptr;
+}
+
+void KontrolRack_wake(t_KontrolRackWake *) {
+    ;
+}
+
+void KontrolRack_wakeStop(t_KontrolRackWake *) {
+    ;
+}
+
 #endif
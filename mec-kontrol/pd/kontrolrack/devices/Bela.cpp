@@ -14,6 +14,7 @@ public:
     bool init() override { return true; }
 
     void poll() override { ; }
+    bool pollRequired() override { return false; }
     void activate() override { ; }
 
     void changePot(unsigned, float) override { ; }
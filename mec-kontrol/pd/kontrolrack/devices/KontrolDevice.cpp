@@ -44,6 +44,11 @@ void KontrolDevice::poll() {
     if (m != nullptr) m->poll();
 }
 
+bool KontrolDevice::pollRequired() {
+    auto m = modes_[currentMode_];
+    return m != nullptr && m->pollRequired();
+}
+
 void KontrolDevice::changePot(unsigned pot, float value) {
     auto m = modes_[currentMode_];
     if (m != nullptr) m->changePot(pot, value);
@@ -162,18 +167,21 @@ void KontrolDevice::loadModule(Kontrol::ChangeSource src, const Kontrol::Rack &r
 
 void KontrolDevice::midiCC(unsigned num, unsigned value) {
     if (midiLearnActive_) {
+        // nrpn data entry learns the selected nrpn, rather than the cc
+        auto localRack = model()->getLocalRack();
+        unsigned learnId = localRack != nullptr ? localRack->midiLearnId(num) : num;
         if (!modModuleId_.empty() && !modParamId_.empty()
-             && (modSource_ < 0 || modSource_ == num)
+             && (modSource_ < 0 || modSource_ == learnId)
         ) {
             auto rack = model()->getRack(currentRackId_);
             if (rack != nullptr) {
                 if (value > 0) {
-                    rack->addMidiCCMapping(num, modModuleId_, modParamId_);
+                    rack->addMidiCCMapping(learnId, modModuleId_, modParamId_);
                 } else {
                     //std::cerr << "midiCC unlearn" << num << " " << modParamId_ << std::endl;
-                    rack->removeMidiCCMapping(num, modModuleId_, modParamId_);
+                    rack->removeMidiCCMapping(learnId, modModuleId_, modParamId_);
                 }
-                modSource_ = num;
+                modSource_ = learnId;
             }
         }
     }
@@ -15,6 +15,8 @@ public:
 
     virtual bool init() = 0;
     virtual void poll() = 0;
+    // true while poll has work to do (e.g. a popup timing out), so the host can stop polling when idle
+    virtual bool pollRequired() { return true; }
     virtual void activate() = 0;
     virtual void changePot(unsigned pot, float value) = 0;
     virtual void changeEncoder(unsigned encoder, float value) = 0;
@@ -36,6 +38,7 @@ public:
 
     virtual bool init();
     virtual void poll();
+    virtual bool pollRequired();
     virtual void changePot(unsigned pot, float value);
     virtual void changeEncoder(unsigned encoder, float value);
     virtual void encoderButton(unsigned encoder, bool value);
@@ -45,6 +45,8 @@ public:
 
     void poll() override;
 
+    bool pollRequired() override { return popupTime_ >= 0; }
+
     void changePot(unsigned, float) override { ; }
 
     void changeEncoder(unsigned, float) override { ; }
@@ -140,6 +142,8 @@ public:
     virtual unsigned getSize() = 0;
     virtual std::string getItemText(unsigned idx) = 0;
     virtual void clicked(unsigned idx) = 0;
+    // cursor moved to item
+    virtual void highlighted(unsigned idx) { ; }
 
     bool init() override { return true; }
 
@@ -199,6 +203,7 @@ public:
 
     void activate() override;
     void clicked(unsigned idx) override;
+    void highlighted(unsigned idx) override;
 private:
     void populateMenu(const std::string& catSel);
     std::string cat_;
@@ -312,7 +317,7 @@ void OParamMode::changePot(unsigned pot, float rawvalue) {
 
         if (rawvalue != std::numeric_limits<float>::max()) {
             float value = rawvalue / MAX_POT_VALUE;
-            calc = param->calcFloat(value);
+            calc = param->normalisedValue(value);
             //std::cerr << "changePot " << pot << " " << value << " cv " << calc.floatValue() << " pv " << param->current().floatValue() << std::endl;
         }
 
@@ -652,6 +657,7 @@ void OMenuMode::changeEncoder(unsigned, float value) {
             if (line <= ORGANELLE_NUM_TEXTLINES) parent_.invertLine(line);
             parent_.flipDisplay();
         }
+        highlighted(cur_);
     }
     popupTime_ = MENU_TIMEOUT;
 }
@@ -934,9 +940,19 @@ void OModuleMenu::activate() {
     populateMenu(cat_);
 
     OFixedMenuMode::activate();
+    highlighted(cur_);
 }
 
 
+// warm the modules either side of the cursor, ahead of one being selected
+// (categories and .. are not module types, so are ignored by the catalogue)
+void OModuleMenu::highlighted(unsigned idx) {
+    auto &catalogue = model()->moduleCatalogue();
+    for (unsigned i = (idx > 0 ? idx - 1 : idx); i <= idx + 1 && i < getSize(); i++) {
+        catalogue.prefetch(cat_ + items_[i]);
+    }
+}
+
 void OModuleMenu::clicked(unsigned idx) {
     if (idx < getSize()) {
         auto modtype = items_[idx];
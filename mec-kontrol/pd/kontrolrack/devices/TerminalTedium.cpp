@@ -52,6 +52,8 @@ public:
 
     void poll() override;
 
+    bool pollRequired() override { return popupTime_ >= 0; }
+
     void changePot(unsigned, float) override { ; }
 
     void changeEncoder(unsigned, float) override { ; }
@@ -318,7 +320,7 @@ void TTParamMode::changePot(unsigned pot, float rawvalue) {
 
         if (rawvalue != std::numeric_limits<float>::max()) {
             float value = rawvalue / MAX_POT_VALUE;
-            calc = param->calcFloat(value);
+            calc = param->normalisedValue(value);
             //std::cerr << "changePot " << pot << " " << value << " cv " << calc.floatValue() << " pv " << param->current().floatValue() << std::endl;
         }
 
@@ -1196,6 +1198,9 @@ void TerminalTedium::poll() {
     }
 }
 
+bool TerminalTedium::pollRequired() {
+    return KontrolDevice::pollRequired() || (encoderMenu_ && encoderMenuTime_ >= 0);
+}
 
 // send messages to both current mode, and paramdisplay
 void TerminalTedium::rack(Kontrol::ChangeSource src, const Kontrol::Rack &rack) {
@@ -19,6 +19,7 @@ public:
     //KontrolDevice
     virtual bool init() override;
     virtual void poll() override;
+    virtual bool pollRequired() override;
     virtual void changePot(unsigned pot, float value);
     virtual void changeEncoder(unsigned encoder, float value);
     virtual void encoderButton(unsigned encoder, bool value);
@@ -1,9 +1,14 @@
-#include <cassert>
+#include <cmath>
 #include <iostream>
+#include <thread>
+
+#include <cstdio>
+#include <sys/stat.h>
 
 #include <mec_prefs.h>
 #include <mec_log.h>
 #include <KontrolModel.h>
+#include <BinaryPreset.h>
 
 class LoggerCallback : public Kontrol::KontrolCallback {
 public:
@@ -43,6 +48,16 @@ public:
     }
 };
 
+// unlike assert, still checked in release builds
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    if (!ok) {
+        LOG_0("check failed : " << what);
+        failures++;
+    }
+}
+
 int main(int argc, char **argv) {
     LOG_0("test kontrol started");
     std::string file;
@@ -57,12 +72,11 @@ int main(int argc, char **argv) {
     auto cb = std::make_shared<LoggerCallback>();
     model->addCallback("logger", cb);
 
-    std::string host = "localhost";
     unsigned port = 9001;
 
-    Kontrol::EntityId rackId = Kontrol::Rack::createId(host, port);
+    // local, as settings and relative module paths are resolved from the local rack
+    Kontrol::EntityId rackId = model->createLocalRack(port)->id();
     Kontrol::EntityId moduleId = "module1";
-    model->createRack(Kontrol::CS_LOCAL, rackId, host, port);
     model->createModule(Kontrol::CS_LOCAL, rackId, moduleId, "Poly Synth", "polysynth");
     model->loadModuleDefinitions(rackId, moduleId, file + "-module.json");
     model->loadSettings(rackId, file + "-rack.json");
@@ -87,11 +101,133 @@ int main(int argc, char **argv) {
         rack->changeMidiCC(62, 64);
         // rack->dumpCurrentValues();
 
+        LOG_1("cc 30 + 62, 14 bit : rmix");
+        rack->changeMidiCC(30, 64);
+        rack->changeMidiCC(62, 127);
+        rack->changeMidiCC14(62, 0x3FFF);
+
+        LOG_1("nrpn 1.2 : no mapping");
+        rack->changeMidiCC(99, 1);
+        rack->changeMidiCC(98, 2);
+        rack->changeMidiCC(6, 64);
+        rack->changeMidiCC(38, 0);
+        check(rack->midiLearnId(6) == Kontrol::Rack::nrpnMappingId(0, (1 << 7) | 2), "nrpn data learns nrpn");
+        rack->changeMidiCC(101, 0);
+        check(rack->midiLearnId(6) == 6, "rpn deselects nrpn");
+
+        LOG_1("cc 7 + 39 and nrpn 1.2 : 14 bit values");
+        std::shared_ptr<Kontrol::Parameter> fparam;
+        auto fmodule = rack->getModule(moduleId);
+        if (fmodule != nullptr) {
+            for (const auto &p : fmodule->getParams()) {
+                if (p->current().type() == Kontrol::ParamValue::T_Float) {
+                    fparam = p;
+                    break;
+                }
+            }
+        }
+        if (fparam != nullptr) {
+            float lo = fparam->calcFloat(0.0f).floatValue();
+            float hi = fparam->calcFloat(1.0f).floatValue();
+            auto applied = [&](float expected) {
+                return std::fabs((fparam->current().floatValue() - lo) / (hi - lo) - expected) < 1e-3f;
+            };
+
+            rack->addMidiCCMapping(7, moduleId, fparam->id());
+            rack->changeMidiCC(7, 100);
+            check(applied(100 / 127.0f), "msb applied as 7 bit");
+            rack->changeMidiCC(39, 5);
+            check(applied(((100 << 7) | 5) / 16383.0f), "lsb refines msb");
+            // lsb now expected, so the msb waits for it
+            rack->changeMidiCC(7, 20);
+            check(applied(((100 << 7) | 5) / 16383.0f), "msb held for lsb");
+            rack->changeMidiCC(39, 9);
+            check(applied(((20 << 7) | 9) / 16383.0f), "pair applied once");
+            rack->changeMidiCC(7, 50);
+            std::this_thread::sleep_for(std::chrono::milliseconds(Kontrol::Rack::MIDI_LSB_WAIT_MS + 1));
+            model->processSlew();
+            check(applied(50 / 127.0f), "msb sent once lsb overdue");
+
+            rack->addMidiCCMapping(Kontrol::Rack::nrpnMappingId(0, (1 << 7) | 2), moduleId, fparam->id());
+            rack->changeMidiCC(99, 1);
+            rack->changeMidiCC(98, 2);
+            // lsb seen on this channel above, so held
+            rack->changeMidiCC(6, 64);
+            check(applied(50 / 127.0f), "nrpn msb held for lsb");
+            rack->changeMidiCC(38, 127);
+            check(applied(((64 << 7) | 127) / 16383.0f), "nrpn lsb refines msb");
+            rack->changeMidiCC(101, 0);
+
+            LOG_1("preset round trip : json, params.bin, load");
+            std::string dataDir = "t_kontrol_data";
+            mkdir(dataDir.c_str(), S_IRWXU | S_IRWXG | S_IRWXO);
+            mkdir((dataDir + "/presets").c_str(), S_IRWXU | S_IRWXG | S_IRWXO);
+            rack->dataDir(dataDir);
+            std::string presetDir = dataDir + "/presets/roundtrip";
+            std::string binFile = presetDir + "/params.bin";
+
+            Kontrol::ParamValue saved = fparam->calcFloat(0.25f);
+            model->changeParam(Kontrol::CS_LOCAL, rackId, moduleId, fparam->id(), saved);
+            rack->savePreset("roundtrip");
+            rack->flushSaves();
+
+            auto presetValue = [&](const std::shared_ptr<Kontrol::RackPreset> &preset, Kontrol::ParamValue &value) {
+                if (preset == nullptr) return false;
+                auto mp = preset->find(moduleId);
+                if (mp == preset->end()) return false;
+                for (const auto &v : mp->second.values()) {
+                    if (v.paramId() == fparam->id()) {
+                        value = v.value();
+                        return true;
+                    }
+                }
+                return false;
+            };
+
+            Kontrol::BinaryPreset::Source source;
+            check(Kontrol::BinaryPreset::source(presetDir + "/params.json", source), "json written");
+            auto binPreset = Kontrol::BinaryPreset::open(binFile);
+            check(binPreset != nullptr && binPreset->generatedFrom(source), "params.bin generated from json");
+            Kontrol::ParamValue value;
+            check(binPreset != nullptr && presetValue(binPreset->rackPreset(), value) && value == saved,
+                  "params.bin value");
+
+            // regenerated from the json when missing
+            std::remove(binFile.c_str());
+            Kontrol::AsyncWriter writer;
+            check(presetValue(Kontrol::Rack::readFilePreset(presetDir, &writer), value) && value == saved,
+                  "json value");
+            writer.flush();
+            check(presetValue(Kontrol::Rack::readFilePreset(presetDir), value) && value == saved,
+                  "regenerated params.bin value");
+
+            model->changeParam(Kontrol::CS_LOCAL, rackId, moduleId, fparam->id(), fparam->calcFloat(0.75f));
+            rack->loadPreset("roundtrip");
+            check(fparam->current() == saved, "preset loaded");
+        }
+
+        LOG_1("versions : changes stamp the param, mappings stamp the module");
+        auto module = rack->getModule(moduleId);
+        if (module != nullptr && !module->getParams().empty()) {
+            auto param = module->getParams()[0];
+            uint64_t since = Kontrol::Entity::currentVersion();
+            model->changeParam(Kontrol::CS_LOCAL, rackId, moduleId, param->id(), param->calcFloat(0.0f));
+            model->changeParam(Kontrol::CS_LOCAL, rackId, moduleId, param->id(), param->calcFloat(1.0f));
+            check(param->version() > since, "change stamps param");
+            check(module->version() <= since, "change does not stamp module");
+            rack->addMidiCCMapping(70, moduleId, param->id());
+            check(module->version() > param->version(), "mapping stamps module");
+        }
+
         // rack->addMidiCCMapping(62, "module1", "o_level");
         // rack->updatePreset("2");
         // rack->saveSettings("./rack.json");
     }
 
+    if (failures > 0) {
+        LOG_0("test failed, checks failed : " << failures);
+        return 1;
+    }
     LOG_0("test completed");
     return 0;
 }
\ No newline at end of file